@@ -0,0 +1,481 @@
+/**
+ * Measures the throughput of the shell on generated scripts.
+ *
+ * The script is a mix of lists joined with ";", "&&" and "||", and of pipelines, whose commands are mostly
+ * builtins so that the time goes to the tokenizer, the parser and the executor rather than to exec. It is
+ * fed to the standard input of the shell, or given as an argument with -f, and run three times:
+ *
+ * - with its output sent to /dev/null, for the commands per second and the peak RSS;
+ * - with its output sent to a pseudo-terminal, so that each line is written as soon as its command
+ *   finishes, for the latency of the commands: the time between two lines, divided among the commands
+ *   that ran in between;
+ * - under ptrace, for the number of system calls made by the shell and its threads, not its children.
+ *
+ * Usage: shell_bench [-n commands] [-p percentage of pipelines] [-s seed] [-f] [-o script] [shell]
+ */
+
+#define _GNU_SOURCE // posix_openpt, ptrace
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+// Number of system calls listed by the syscall pass
+#define SYSCALL_TOP 8
+
+// Number of entries of the table of system call counts
+#define SYSCALL_TABLE_SIZE 512
+
+#ifndef SHELL_PATH
+#define SHELL_PATH "../src/shell"
+#endif
+
+struct bench_options {
+    size_t commands; // Number of commands of the script
+    unsigned pipe_percentage; // Percentage of the lines that are pipelines
+    unsigned seed;
+    int script_argument; // The script is given as an argument instead of the standard input
+    const char *script_path; // Where the script is kept, NULL for a temporary file
+    const char *shell_path;
+};
+
+// Commands run by each line, and lines of output that it writes
+struct line_shape {
+    unsigned commands;
+    unsigned outputs;
+};
+
+struct run_result {
+    uint64_t elapsed; // Nanoseconds
+    struct rusage usage;
+    int status;
+};
+
+struct syscall_name {
+    long number;
+    const char *name;
+};
+
+static const struct syscall_name syscall_names[] = {
+        {SYS_read, "read"}, {SYS_write, "write"}, {SYS_writev, "writev"}, {SYS_pread64, "pread64"},
+        {SYS_openat, "openat"}, {SYS_close, "close"}, {SYS_clone, "clone"}, {SYS_clone3, "clone3"},
+        {SYS_wait4, "wait4"}, {SYS_pipe2, "pipe2"}, {SYS_dup2, "dup2"}, {SYS_dup3, "dup3"},
+        {SYS_fcntl, "fcntl"}, {SYS_execve, "execve"}, {SYS_mmap, "mmap"}, {SYS_munmap, "munmap"},
+        {SYS_brk, "brk"}, {SYS_rt_sigprocmask, "rt_sigprocmask"}, {SYS_rt_sigaction, "rt_sigaction"},
+        {SYS_ioctl, "ioctl"}, {SYS_newfstatat, "newfstatat"}, {SYS_fstat, "fstat"}, {SYS_lseek, "lseek"},
+        {SYS_futex, "futex"}, {SYS_epoll_wait, "epoll_wait"}, {SYS_epoll_ctl, "epoll_ctl"},
+        {SYS_pidfd_open, "pidfd_open"}, {SYS_sendmsg, "sendmsg"}, {SYS_recvmsg, "recvmsg"},
+        {SYS_getpid, "getpid"}, {SYS_memfd_create, "memfd_create"}, {SYS_getdents64, "getdents64"},
+        {SYS_exit_group, "exit_group"},
+};
+
+static uint64_t clock_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_latencies(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Writes one line of the script.
+ * @return the commands the line runs and the lines of output it writes
+ */
+static struct line_shape write_line(FILE *script, size_t line, unsigned pipe_percentage) {
+    unsigned kind = (unsigned) (rand() % 100);
+
+    if (kind < pipe_percentage) {
+        fprintf(script, "echo p%zu | cat\n", line);
+        return (struct line_shape) {2, 1};
+    }
+
+    switch (kind % 4) {
+        case 0:
+            fprintf(script, "echo a%zu; echo b%zu\n", line, line);
+            return (struct line_shape) {2, 2};
+        case 1:
+            fprintf(script, "echo a%zu && echo b%zu\n", line, line);
+            return (struct line_shape) {2, 2};
+        case 2:
+            fprintf(script, "cat /nonexistent/%zu 2> /dev/null || echo b%zu\n", line, line);
+            return (struct line_shape) {2, 1};
+        default:
+            fprintf(script, "echo a%zu; cat /nonexistent/%zu 2> /dev/null && echo b%zu\n", line, line, line);
+            return (struct line_shape) {3, 1};
+    }
+}
+
+/**
+ * Generates the script. The commands that run before each line of output are recorded, so that the
+ * latency pass can attribute the time between two lines to them.
+ * @return the number of lines of output, or 0 on error
+ */
+static size_t generate_script(const struct bench_options *options, int fd, unsigned **commands_per_output) {
+    // The last line may go past the number of commands
+    FILE *script = fdopen(dup(fd), "w");
+    unsigned *counts = malloc((options->commands + 3) * sizeof(unsigned));
+    if (script == NULL || counts == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        if (script) fclose(script);
+        free(counts);
+        return 0;
+    }
+
+    srand(options->seed);
+    size_t commands = 0;
+    size_t outputs = 0;
+
+    for (size_t line = 0; commands < options->commands; line++) {
+        struct line_shape shape = write_line(script, line, options->pipe_percentage);
+        commands += shape.commands;
+
+        // The commands of a line are spread over its lines of output, the last one takes the remainder
+        unsigned share = shape.commands / shape.outputs;
+        for (unsigned i = 0; i < shape.outputs; i++) {
+            counts[outputs++] = i + 1 < shape.outputs ? share : shape.commands - share * i;
+        }
+    }
+
+    fprintf(script, "exit\n");
+    fclose(script);
+    *commands_per_output = counts;
+    return outputs;
+}
+
+/**
+ * Starts the shell on the script, with its output sent to a file descriptor.
+ * @return the pid of the shell, or -1 on error
+ */
+static pid_t start_shell(const struct bench_options *options, const char *script_path, int output_fd, int traced) {
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+
+    int input_fd = options->script_argument ? open("/dev/null", O_RDONLY) : open(script_path, O_RDONLY);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (input_fd == -1 || null_fd == -1) _exit(EXIT_FAILURE);
+
+    dup2(input_fd, STDIN_FILENO);
+    dup2(output_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+    close(input_fd);
+    close(null_fd);
+    close(output_fd);
+
+    // The shell must not use the zygote or the history of the user
+    unsetenv("SHELL_ZYGOTE");
+    unsetenv("SHELL_HISTORY");
+    unsetenv("SHELL_TRACE");
+
+    if (traced && ptrace(PTRACE_TRACEME, 0, NULL, NULL) == -1) _exit(EXIT_FAILURE);
+
+    if (options->script_argument) execl(options->shell_path, options->shell_path, script_path, (char *) NULL);
+    else execl(options->shell_path, options->shell_path, (char *) NULL);
+    _exit(EXIT_FAILURE);
+}
+
+/**
+ * Waits for the shell and reports the resources it used.
+ */
+static int finish_shell(pid_t pid, uint64_t start, struct run_result *result) {
+    while (wait4(pid, &result->status, 0, &result->usage) == -1) {
+        if (errno != EINTR) {
+            perror("wait4");
+            return -1;
+        }
+    }
+    result->elapsed = clock_now() - start;
+    return 0;
+}
+
+/**
+ * Runs the script with its output sent to /dev/null.
+ */
+static int bench_throughput(const struct bench_options *options, const char *script_path,
+                            struct run_result *result) {
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd == -1) {
+        perror("/dev/null");
+        return -1;
+    }
+
+    uint64_t start = clock_now();
+    pid_t pid = start_shell(options, script_path, null_fd, 0);
+    close(null_fd);
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    }
+    return finish_shell(pid, start, result);
+}
+
+/**
+ * Runs the script with its output sent to a pseudo-terminal, and timestamps each line of output.
+ * @return the number of latencies, one per command, or 0 on error
+ */
+static size_t bench_latency(const struct bench_options *options, const char *script_path,
+                            const unsigned *commands_per_output, size_t outputs, uint64_t *latencies) {
+    int master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master_fd == -1 || grantpt(master_fd) == -1 || unlockpt(master_fd) == -1) {
+        perror("posix_openpt");
+        if (master_fd != -1) close(master_fd);
+        return 0;
+    }
+
+    int slave_fd = open(ptsname(master_fd), O_RDWR | O_NOCTTY);
+    if (slave_fd == -1) {
+        perror("ptsname");
+        close(master_fd);
+        return 0;
+    }
+
+    // The lines are read as they are, without "\r"
+    struct termios attributes;
+    tcgetattr(slave_fd, &attributes);
+    cfmakeraw(&attributes);
+    tcsetattr(slave_fd, TCSANOW, &attributes);
+
+    uint64_t previous = clock_now();
+    pid_t pid = start_shell(options, script_path, slave_fd, 0);
+    close(slave_fd);
+    if (pid == -1) {
+        perror("fork");
+        close(master_fd);
+        return 0;
+    }
+
+    size_t output = 0;
+    size_t count = 0;
+    char buffer[4096];
+    ssize_t length;
+
+    // The read fails with EIO once the shell and its children have closed the pseudo-terminal
+    while ((length = read(master_fd, buffer, sizeof(buffer))) != 0) {
+        if (length == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        uint64_t now = clock_now();
+        for (ssize_t i = 0; i < length; i++) {
+            if (buffer[i] != '\n' || output == outputs) continue;
+
+            unsigned commands = commands_per_output[output++];
+            uint64_t latency = (now - previous) / commands;
+            for (unsigned c = 0; c < commands; c++) latencies[count++] = latency;
+            previous = now;
+        }
+    }
+
+    close(master_fd);
+    struct run_result result;
+    finish_shell(pid, 0, &result);
+    return count;
+}
+
+/**
+ * Runs the script under ptrace and counts the system calls of the shell and of its threads.
+ * @return the total number of system calls, or -1 if the shell could not be traced
+ */
+static long long bench_syscalls(const struct bench_options *options, const char *script_path,
+                                unsigned long long *counts) {
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd == -1) {
+        perror("/dev/null");
+        return -1;
+    }
+
+    pid_t pid = start_shell(options, script_path, null_fd, 1);
+    close(null_fd);
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    }
+
+    // The shell stops once it has executed the new program
+    int status;
+    if (waitpid(pid, &status, 0) == -1 || !WIFSTOPPED(status)) return -1;
+
+    // The forks of the shell are not traced, its threads are
+    long trace_options = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL;
+    if (ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *) trace_options) == -1) {
+        perror("ptrace");
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return -1;
+    }
+
+    long long total = 0;
+    ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+
+    pid_t tid;
+    while ((tid = waitpid(-1, &status, __WALL)) != -1 || errno == EINTR) {
+        if (tid == -1 || !WIFSTOPPED(status)) continue;
+
+        int signal = WSTOPSIG(status);
+        if (signal == (SIGTRAP | 0x80)) {
+            struct __ptrace_syscall_info info;
+            if (ptrace(PTRACE_GET_SYSCALL_INFO, tid, (void *) sizeof(info), &info) > 0 &&
+                info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+                total++;
+                if (info.entry.nr < SYSCALL_TABLE_SIZE) counts[info.entry.nr]++;
+            }
+            signal = 0;
+        } else if (signal == SIGTRAP || signal == SIGSTOP) {
+            // Events of ptrace, and the first stop of a new thread
+            signal = 0;
+        }
+
+        ptrace(PTRACE_SYSCALL, tid, NULL, (void *) (long) signal);
+    }
+
+    return total;
+}
+
+static const char *syscall_name(long number) {
+    for (size_t i = 0; i < sizeof(syscall_names) / sizeof(syscall_names[0]); i++) {
+        if (syscall_names[i].number == number) return syscall_names[i].name;
+    }
+    return NULL;
+}
+
+/**
+ * Prints the system calls made most often.
+ */
+static void print_syscalls(unsigned long long *counts, long long total, size_t commands) {
+    printf("\nsyscalls: %lld, %.2f per command\n", total, (double) total / (double) commands);
+
+    for (int rank = 0; rank < SYSCALL_TOP; rank++) {
+        long highest = 0;
+        for (long number = 1; number < SYSCALL_TABLE_SIZE; number++) {
+            if (counts[number] > counts[highest]) highest = number;
+        }
+        if (counts[highest] == 0) break;
+
+        const char *name = syscall_name(highest);
+        if (name) printf("  %-16s %10llu\n", name, counts[highest]);
+        else printf("  syscall %-8ld %10llu\n", highest, counts[highest]);
+        counts[highest] = 0;
+    }
+}
+
+/**
+ * Runs the three passes on the generated script and prints their results.
+ * @return 0 on success, -1 if the shell failed
+ */
+static int run_passes(const struct bench_options *options, const char *script_path,
+                      const unsigned *commands_per_output, size_t outputs) {
+    uint64_t *latencies = malloc((options->commands + 3) * sizeof(uint64_t));
+    unsigned long long *syscall_counts = calloc(SYSCALL_TABLE_SIZE, sizeof(unsigned long long));
+    if (latencies == NULL || syscall_counts == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(latencies);
+        free(syscall_counts);
+        return -1;
+    }
+
+    printf("%zu commands, %u%% pipelines, run by %s from %s\n", options->commands, options->pipe_percentage,
+           options->shell_path, options->script_argument ? "a script argument" : "the standard input");
+
+    struct run_result run;
+    if (bench_throughput(options, script_path, &run) == -1 || !WIFEXITED(run.status) ||
+        WEXITSTATUS(run.status) != 0) {
+        fprintf(stderr, "The shell failed\n");
+        free(latencies);
+        free(syscall_counts);
+        return -1;
+    }
+
+    double seconds = (double) run.elapsed / 1e9;
+    printf("\nthroughput: %.0f commands/s, %.3f s, user %.3f s, system %.3f s, peak RSS %ld KiB\n",
+           (double) options->commands / seconds, seconds,
+           (double) run.usage.ru_utime.tv_sec + (double) run.usage.ru_utime.tv_usec / 1e6,
+           (double) run.usage.ru_stime.tv_sec + (double) run.usage.ru_stime.tv_usec / 1e6, run.usage.ru_maxrss);
+
+    size_t count = bench_latency(options, script_path, commands_per_output, outputs, latencies);
+    if (count > 0) {
+        qsort(latencies, count, sizeof(uint64_t), compare_latencies);
+        printf("\nlatency: p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n",
+               (double) latencies[count / 2] / 1e3, (double) latencies[count * 9 / 10] / 1e3,
+               (double) latencies[count * 99 / 100] / 1e3, (double) latencies[count - 1] / 1e3);
+    }
+
+    long long total = bench_syscalls(options, script_path, syscall_counts);
+    if (total >= 0) print_syscalls(syscall_counts, total, options->commands);
+    else printf("\nsyscalls: unavailable, the shell could not be traced\n");
+
+    free(latencies);
+    free(syscall_counts);
+    return 0;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-n commands] [-p percentage of pipelines] [-s seed] [-f] [-o script] [shell]\n",
+            program);
+}
+
+int main(int argc, char **argv) {
+    struct bench_options options = {10000, 5, 1, 0, NULL, SHELL_PATH};
+
+    int option;
+    while ((option = getopt(argc, argv, "n:p:s:fo:")) != -1) {
+        switch (option) {
+            case 'n':
+                options.commands = strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                options.pipe_percentage = (unsigned) strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                options.seed = (unsigned) strtoul(optarg, NULL, 10);
+                break;
+            case 'f':
+                options.script_argument = 1;
+                break;
+            case 'o':
+                options.script_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind < argc) options.shell_path = argv[optind];
+    if (options.commands == 0 || options.pipe_percentage > 100) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    char temporary_path[] = "/tmp/shell_bench_XXXXXX";
+    const char *script_path = options.script_path ? options.script_path : temporary_path;
+    int script_fd = options.script_path ? open(script_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)
+                                        : mkstemp(temporary_path);
+    if (script_fd == -1) {
+        perror(script_path);
+        return EXIT_FAILURE;
+    }
+
+    unsigned *commands_per_output;
+    size_t outputs = generate_script(&options, script_fd, &commands_per_output);
+    close(script_fd);
+
+    int result = outputs > 0 ? run_passes(&options, script_path, commands_per_output, outputs) : -1;
+
+    if (!options.script_path) unlink(script_path);
+    if (outputs > 0) free(commands_per_output);
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,142 @@
+/**
+ * Compares the launch latency of commands forked by the shell with commands launched by the zygote.
+ *
+ * The shell is simulated by a process whose address space is inflated with a heap of the given size,
+ * since the cost of fork grows with the number of pages to map in the child. Each launch runs
+ * /bin/true and is timed from the request until its pid is known, then the command is waited for.
+ *
+ * Usage: zygote_bench [launches] [heap size in MiB]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "zygote.h"
+
+// Number of buckets of the histogram, bucket i counts the launches under 2^i microseconds
+#define HISTOGRAM_BUCKETS 20
+
+static char *const command[] = {"/bin/true", NULL};
+
+static uint64_t clock_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_latencies(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Prints the percentiles and the histogram of a series of launch latencies, in nanoseconds.
+ */
+static void print_latencies(const char *name, uint64_t *latencies, size_t count) {
+    qsort(latencies, count, sizeof(uint64_t), compare_latencies);
+
+    printf("\n%s: p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n", name,
+           (double) latencies[count / 2] / 1e3, (double) latencies[count * 9 / 10] / 1e3,
+           (double) latencies[count * 99 / 100] / 1e3, (double) latencies[count - 1] / 1e3);
+
+    size_t buckets[HISTOGRAM_BUCKETS] = {0};
+    size_t highest = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t microseconds = latencies[i] / 1000;
+        size_t bucket = 0;
+        while (bucket < HISTOGRAM_BUCKETS - 1 && microseconds >= (1ULL << bucket)) bucket++;
+        buckets[bucket]++;
+        if (buckets[bucket] > buckets[highest]) highest = bucket;
+    }
+
+    for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        if (buckets[bucket] == 0) continue;
+        int width = (int) (buckets[bucket] * 50 / buckets[highest]);
+        printf("  < %7llu us %7zu |%.*s\n", 1ULL << bucket, buckets[bucket], width,
+               "##################################################");
+    }
+}
+
+/**
+ * Launches the command with fork and exec from the current process.
+ */
+static void bench_fork(uint64_t *latencies, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint64_t start = clock_now();
+        pid_t pid = fork();
+        if (pid == 0) {
+            execv(command[0], command);
+            _exit(EXIT_FAILURE);
+        }
+        latencies[i] = clock_now() - start;
+        waitpid(pid, NULL, 0);
+    }
+}
+
+/**
+ * Launches the command through the zygote.
+ */
+static void bench_zygote(uint64_t *latencies, size_t count) {
+    static char *const environment[] = {NULL};
+    const int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+
+    for (size_t i = 0; i < count; i++) {
+        int status;
+        struct rusage usage;
+
+        uint64_t start = clock_now();
+        pid_t pid = zygote_spawn(command, environment, fds);
+        latencies[i] = clock_now() - start;
+
+        if (pid < 0) {
+            fprintf(stderr, "The zygote could not launch %s\n", command[0]);
+            exit(EXIT_FAILURE);
+        }
+        zygote_wait(pid, &status, &usage);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t launches = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+    size_t heap_size = (argc > 2 ? strtoul(argv[2], NULL, 10) : 512) << 20;
+    if (launches == 0) {
+        fprintf(stderr, "Usage: %s [launches] [heap size in MiB]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // The zygote is started while the process is still small, like in the shell
+    setenv("SHELL_ZYGOTE", "1", 1);
+    zygote_start();
+    if (!zygote_active()) {
+        fprintf(stderr, "The zygote could not be started\n");
+        return EXIT_FAILURE;
+    }
+
+    // Touch every page of the heap so that it is mapped
+    char *heap = malloc(heap_size);
+    uint64_t *latencies = malloc(launches * sizeof(uint64_t));
+    if (heap == NULL || latencies == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return EXIT_FAILURE;
+    }
+    memset(heap, 1, heap_size);
+
+    printf("%zu launches of %s with a %zu MiB heap", launches, command[0], heap_size >> 20);
+
+    bench_fork(latencies, launches);
+    print_latencies("fork", latencies, launches);
+
+    bench_zygote(latencies, launches);
+    print_latencies("zygote", latencies, launches);
+
+    zygote_stop();
+    free(latencies);
+    free(heap);
+    return EXIT_SUCCESS;
+}
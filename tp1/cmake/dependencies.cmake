@@ -1,8 +1,8 @@
-#
-# Dependencies
-#
-
-# threads
-
-set(THREADS_PREFER_PTHREAD_FLAG ON)
+#
+# Dependencies
+#
+
+# threads
+
+set(THREADS_PREFER_PTHREAD_FLAG ON)
 find_package(Threads REQUIRED)
\ No newline at end of file
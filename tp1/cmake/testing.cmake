@@ -1,11 +1,11 @@
-#
-# Testing
-#
-
-option(BUILD_TESTING "Build tests" ON)
-
-if(BUILD_TESTING)
-  enable_testing()
-  include(CTest)
-  enable_testing()
+#
+# Testing
+#
+
+option(BUILD_TESTING "Build tests" ON)
+
+if(BUILD_TESTING)
+  enable_testing()
+  include(CTest)
+  enable_testing()
 endif ()
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include "builtins.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "cat.h"
+#include "env.h"
+#include "history.h"
+#include "jobs.h"
+#include "output.h"
+#include "parallel.h"
+#include "resource_limits.h"
+#include "shell.h"
+#include "stats.h"
+#include "timeout.h"
+
+struct builtin {
+    const char *name;
+    builtin_fn function;
+    builtin_accepts_fn accepts; // NULL if the builtin runs every form of the command
+    int pure; // 1 if the builtin does not change the state of the shell
+};
+
+/**
+ * Determines whether an argument of echo is made of options, e.g. "-n" or "-ne".
+ */
+static int is_echo_option(const char *arg) {
+    return arg[0] == '-' && arg[1] != '\0' && strspn(arg + 1, "neE") == strlen(arg + 1);
+}
+
+/**
+ * The escapes of -e and -E are left to the echo program.
+ */
+static int builtin_echo_accepts(char *const *args) {
+    for (int i = 1; args[i] && is_echo_option(args[i]); i++) {
+        if (strpbrk(args[i], "eE") != NULL) return 0;
+    }
+    return 1;
+}
+
+/**
+ * echo [-n] [arg]...: writes the arguments separated by spaces, followed by a newline unless -n is given.
+ * The output goes through the buffer of the shell, a script that echoes many lines writes them in batches.
+ */
+static int builtin_echo(char **args, struct command *block) {
+    (void) block;
+
+    int newline = 1;
+    int i = 1;
+    for (; args[i] && is_echo_option(args[i]); i++) newline = 0;
+
+    int failed = 0;
+    for (int first = i; args[i]; i++) {
+        if (i > first) failed |= output_write(STDOUT_FILENO, " ", 1);
+        failed |= output_write(STDOUT_FILENO, args[i], strlen(args[i]));
+    }
+    if (newline) failed |= output_write(STDOUT_FILENO, "\n", 1);
+
+    if (failed) {
+        fprintf(stderr, "echo: write error: %s\n", strerror(errno));
+        return EXECUTION_FAILED;
+    }
+    return EXECUTION_SUCCESS;
+}
+
+/**
+ * exit: leaves the shell.
+ */
+static int builtin_exit(char **args, struct command *block) {
+    (void) args;
+    (void) block;
+    return EXECUTION_REQUEST_EXIT;
+}
+
+/**
+ * true: does nothing and succeeds, as the condition of a loop it does not fork a process per iteration.
+ */
+static int builtin_true(char **args, struct command *block) {
+    (void) args;
+    (void) block;
+    return EXECUTION_SUCCESS;
+}
+
+/**
+ * false: does nothing and fails.
+ */
+static int builtin_false(char **args, struct command *block) {
+    (void) args;
+    (void) block;
+    return EXECUTION_FAILED;
+}
+
+/**
+ * jobs: lists the background jobs.
+ */
+static int builtin_jobs(char **args, struct command *block) {
+    (void) args;
+    (void) block;
+    jobs_print();
+    return EXECUTION_SUCCESS;
+}
+
+/**
+ * wait [%job | pid]...: waits for the given background jobs, or for all of them.
+ * The status is the one of the last job waited for.
+ */
+static int builtin_wait(char **args, struct command *block) {
+    (void) block;
+    if (args[1] == NULL) {
+        jobs_wait(0);
+        return EXECUTION_SUCCESS;
+    }
+
+    int result = EXECUTION_SUCCESS;
+    for (int i = 1; args[i]; i++) {
+        char *end;
+        int id;
+        if (args[i][0] == '%') {
+            id = (int) strtol(args[i] + 1, &end, 10);
+        } else {
+            id = jobs_find_pid((pid_t) strtol(args[i], &end, 10));
+        }
+
+        int status = *end == '\0' && id > 0 ? jobs_wait(id) : -1;
+        if (status == -1) {
+            fprintf(stderr, "wait: %s: no such job\n", args[i]);
+            result = EXECUTION_FAILED;
+        } else {
+            result = WIFEXITED(status) && WEXITSTATUS(status) == 0 ? EXECUTION_SUCCESS : EXECUTION_FAILED;
+        }
+    }
+
+    return result;
+}
+
+static const struct builtin builtins[] = {
+        {"cat", builtin_cat, builtin_cat_accepts, 1},
+        {"echo", builtin_echo, builtin_echo_accepts, 1},
+        {"exit", builtin_exit, NULL, 0},
+        {"export", builtin_export, NULL, 0},
+        {"false", builtin_false, NULL, 1},
+        {"history", builtin_history, NULL, 1},
+        {"jobs", builtin_jobs, NULL, 0},
+        {"parallel", builtin_parallel, NULL, 0},
+        {"stats", builtin_stats, NULL, 0},
+        {"timeout", builtin_timeout, builtin_timeout_accepts, 0},
+        {"true", builtin_true, NULL, 1},
+        {"ulimit", builtin_ulimit, NULL, 0},
+        {"wait", builtin_wait, NULL, 0},
+};
+
+builtin_fn builtin_find(char *const *args) {
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+        if (strcmp(builtins[i].name, args[0]) != 0) continue;
+        if (builtins[i].accepts != NULL && !builtins[i].accepts(args)) return NULL;
+        return builtins[i].function;
+    }
+    return NULL;
+}
+
+int builtin_is_pure(const char *name) {
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+        if (strcmp(builtins[i].name, name) == 0) return builtins[i].pure;
+    }
+    return 0;
+}
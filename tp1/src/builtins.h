@@ -0,0 +1,42 @@
+#ifndef TP1_BUILTINS_H
+#define TP1_BUILTINS_H
+
+#include "parser.h"
+
+/**
+ * A builtin command, run by the shell itself instead of a new program.
+ *
+ * @param args the arguments of the command, the last element is NULL
+ * @param block the commands of the block that follows the arguments, NULL if there is none
+ * @return the execution status of the command, see shell.h
+ */
+typedef int (*builtin_fn)(char **args, struct command *block);
+
+/**
+ * Tells whether a builtin runs a command with these arguments. The forms that a builtin does not
+ * support, e.g. options, are left to the program of the same name.
+ *
+ * @param args the arguments of the command, the last element is NULL
+ * @return 1 if the builtin runs the command, 0 otherwise
+ */
+typedef int (*builtin_accepts_fn)(char *const *args);
+
+/**
+ * Finds the builtin that runs a command.
+ *
+ * @param args the arguments of the command, the first one is its name, the last element is NULL
+ * @return the builtin or NULL if the command is not a builtin, or if the builtin does not support these
+ * arguments
+ */
+builtin_fn builtin_find(char *const *args);
+
+/**
+ * Tells whether a builtin leaves the state of the shell as it is, e.g. echo or cat, so that it can run in
+ * the shell rather than in a child when only its output is needed.
+ *
+ * @param name the name of the command
+ * @return 1 if the command is a builtin without side effects on the shell, 0 otherwise
+ */
+int builtin_is_pure(const char *name);
+
+#endif
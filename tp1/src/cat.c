@@ -0,0 +1,129 @@
+#define _GNU_SOURCE // copy_file_range, splice
+
+#include "cat.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+
+#include "output.h"
+#include "shell.h"
+
+// Maximum number of bytes moved by a single system call
+#define CAT_CHUNK_SIZE (1 << 30)
+
+// Size of the buffer of the read/write fallback
+#define CAT_BUFFER_SIZE 65536
+
+/**
+ * The ways to move data between two file descriptors, from the cheapest to the most general.
+ */
+enum copy_method {
+    COPY_FILE_RANGE = 0, // Between regular files, may share the blocks on the same file system
+    COPY_SENDFILE, // From a regular file to anything
+    COPY_SPLICE, // From or to a pipe
+    COPY_READ_WRITE, // Through a buffer, always supported
+};
+
+/**
+ * Moves the next chunk of data from a file descriptor to another.
+ * @return the number of bytes moved, 0 at the end of the input, -1 on error
+ */
+static ssize_t copy_chunk(enum copy_method method, int in_fd, int out_fd) {
+    switch (method) {
+        case COPY_FILE_RANGE:
+            return copy_file_range(in_fd, NULL, out_fd, NULL, CAT_CHUNK_SIZE, 0);
+        case COPY_SENDFILE:
+            return sendfile(out_fd, in_fd, NULL, CAT_CHUNK_SIZE);
+        case COPY_SPLICE:
+            return splice(in_fd, NULL, out_fd, NULL, CAT_CHUNK_SIZE, SPLICE_F_MOVE);
+        default: {
+            static char buffer[CAT_BUFFER_SIZE];
+            ssize_t length = read(in_fd, buffer, sizeof(buffer));
+            for (ssize_t written = 0, n; written < length; written += n) {
+                n = write(out_fd, buffer + written, length - written);
+                if (n == -1) return -1;
+            }
+            return length;
+        }
+    }
+}
+
+/**
+ * Determines whether an error means that a method does not apply to the file descriptors, in which
+ * case the next one is tried.
+ */
+static int is_unsupported(int error) {
+    return error == EINVAL || error == EXDEV || error == ENOSYS || error == EBADF || error == EOPNOTSUPP ||
+           error == ESPIPE;
+}
+
+/**
+ * Copies a file descriptor to another until the end of the input.
+ * @return 0 on success, -1 on error
+ */
+static int copy_fd(int in_fd, int out_fd) {
+    enum copy_method method = COPY_FILE_RANGE;
+    int copied = 0;
+
+    for (;;) {
+        ssize_t n = copy_chunk(method, in_fd, out_fd);
+        if (n > 0) {
+            copied = 1;
+        } else if (n == 0) {
+            // Some special files, e.g. in /proc, report an empty content to copy_file_range
+            if (copied || method != COPY_FILE_RANGE) return 0;
+            method++;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (method != COPY_READ_WRITE && is_unsupported(errno)) {
+            method++; // The offsets of the file descriptors hold the progress, the next method continues from it
+        } else {
+            return -1;
+        }
+    }
+}
+
+int builtin_cat_accepts(char *const *args) {
+    for (int i = 1; args[i]; i++) {
+        if (args[i][0] == '-' && args[i][1] != '\0') return 0;
+    }
+    return 1;
+}
+
+int builtin_cat(char **args, struct command *block) {
+    (void) block;
+
+    // The data is written directly to the file descriptor
+    output_flush();
+
+    if (args[1] == NULL) {
+        if (copy_fd(STDIN_FILENO, STDOUT_FILENO) == -1) {
+            perror("cat");
+            return EXECUTION_FAILED;
+        }
+        return EXECUTION_SUCCESS;
+    }
+
+    int result = EXECUTION_SUCCESS;
+    for (int i = 1; args[i]; i++) {
+        int fd = strcmp(args[i], "-") == 0 ? STDIN_FILENO : open(args[i], O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            fprintf(stderr, "cat: %s: %s\n", args[i], strerror(errno));
+            result = EXECUTION_FAILED;
+            continue;
+        }
+
+        if (copy_fd(fd, STDOUT_FILENO) == -1) {
+            fprintf(stderr, "cat: %s: %s\n", args[i], strerror(errno));
+            result = EXECUTION_FAILED;
+        }
+
+        if (fd != STDIN_FILENO) close(fd);
+    }
+
+    return result;
+}
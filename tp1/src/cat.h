@@ -0,0 +1,27 @@
+#ifndef TP1_CAT_H
+#define TP1_CAT_H
+
+#include "parser.h"
+
+/**
+ * Tells whether the builtin runs a cat command, the options are left to the cat program.
+ *
+ * @param args the arguments of the command, the last element is NULL
+ * @return 1 if no argument is an option, a lone "-" is the standard input, 0 otherwise
+ */
+int builtin_cat_accepts(char *const *args);
+
+/**
+ * cat [file]...: writes the content of the files, or of the standard input if there are none or for
+ * "-", to the standard output.
+ *
+ * The data is moved by the kernel with copy_file_range, sendfile or splice depending on what the
+ * file descriptors support, and only goes through a buffer of the shell when none of them applies.
+ *
+ * @param args the arguments of the command, the last element is NULL
+ * @param block unused
+ * @return execution_success if every file was copied, execution_failed otherwise
+ */
+int builtin_cat(char **args, struct command *block);
+
+#endif
@@ -0,0 +1,406 @@
+#define _GNU_SOURCE // environ
+
+#include "env.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "shell.h"
+
+// Initial number of slots of the table of variables, a power of two
+#define ENV_TABLE_CAPACITY 64
+
+struct variable {
+    char *entry; // "NAME=value", NULL if the slot of the table is empty
+    size_t name_length;
+    size_t slot; // Index of the entry in the block, if the variable is exported
+    unsigned char exported;
+    unsigned char owned; // The entry was allocated by the shell, the inherited ones are shared
+};
+
+struct saved_variable {
+    const char *name; // Points to the assignment word
+    size_t name_length;
+    char *entry; // Copy of the previous entry, NULL if the variable was not set
+    int exported;
+};
+
+struct env_saved {
+    size_t count;
+    struct saved_variable variables[];
+};
+
+static struct variable *table = NULL; // Open addressing with linear probing
+static size_t table_capacity = 0;
+static size_t table_count = 0;
+
+static char **block = NULL; // Entries of the exported variables, the last element is NULL
+static size_t block_count = 0;
+static size_t block_capacity = 0;
+
+static char **inherited_environ = NULL;
+
+static uint64_t hash_name(const char *name, size_t length) {
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) name[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Finds the slot of a variable in the table.
+ * @return the slot of the variable, or the empty slot where it would be inserted
+ */
+static size_t table_find(const char *name, size_t length) {
+    size_t mask = table_capacity - 1;
+    size_t i = hash_name(name, length) & mask;
+
+    while (table[i].entry != NULL &&
+           (table[i].name_length != length || memcmp(table[i].entry, name, length) != 0)) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/**
+ * Doubles the capacity of the table when it is three quarters full.
+ * @return 0 on success, -1 on error
+ */
+static int table_reserve(void) {
+    if ((table_count + 1) * 4 <= table_capacity * 3) return 0;
+
+    struct variable *old_table = table;
+    size_t old_capacity = table_capacity;
+
+    table = calloc(old_capacity * 2, sizeof(struct variable));
+    if (table == NULL) {
+        table = old_table;
+        fprintf(stderr, "Memory allocation error\n");
+        return -1;
+    }
+    table_capacity = old_capacity * 2;
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_table[i].entry == NULL) continue;
+        table[table_find(old_table[i].entry, old_table[i].name_length)] = old_table[i];
+    }
+    free(old_table);
+    return 0;
+}
+
+/**
+ * Makes room for one more entry in the block, environ follows it when it moves.
+ * @return 0 on success, -1 on error
+ */
+static int block_reserve(void) {
+    if (block_count + 1 < block_capacity) return 0;
+
+    size_t capacity = block_capacity * 2;
+    char **entries = realloc(block, capacity * sizeof(char *));
+    if (entries == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return -1;
+    }
+
+    block = entries;
+    block_capacity = capacity;
+    environ = block;
+    return 0;
+}
+
+/**
+ * Appends an entry to the block, which must have room for it.
+ * @return the slot of the entry
+ */
+static size_t block_append(char *entry) {
+    block[block_count] = entry;
+    block[block_count + 1] = NULL;
+    return block_count++;
+}
+
+/**
+ * Removes an entry from the block, the last entry takes its slot.
+ */
+static void block_remove(size_t slot) {
+    char *last = block[--block_count];
+    block[block_count] = NULL;
+    if (slot == block_count) return;
+
+    block[slot] = last;
+    size_t length = (size_t) (strchr(last, '=') - last);
+    table[table_find(last, length)].slot = slot;
+}
+
+/**
+ * Removes a variable from the block, it is then only seen by the shell.
+ */
+static void unexport(const char *name, size_t length) {
+    struct variable *variable = &table[table_find(name, length)];
+    if (variable->entry == NULL || !variable->exported) return;
+
+    block_remove(variable->slot);
+    variable->exported = 0;
+}
+
+/**
+ * Marks a variable as exported, a variable that is not set is ignored.
+ */
+static int export_name(const char *name, size_t length) {
+    struct variable *variable = &table[table_find(name, length)];
+    if (variable->entry == NULL || variable->exported) return 0;
+    if (block_reserve() == -1) return -1;
+
+    variable->slot = block_append(variable->entry);
+    variable->exported = 1;
+    return 0;
+}
+
+/**
+ * @return the length of the name that starts a word
+ */
+static size_t name_length(const char *word) {
+    if (!isalpha((unsigned char) word[0]) && word[0] != '_') return 0;
+
+    size_t length = 1;
+    while (isalnum((unsigned char) word[length]) || word[length] == '_') length++;
+    return length;
+}
+
+int env_init(void) {
+    inherited_environ = environ;
+
+    table_capacity = ENV_TABLE_CAPACITY;
+    table = calloc(table_capacity, sizeof(struct variable));
+    block_capacity = 16;
+    block = malloc(block_capacity * sizeof(char *));
+    if (table == NULL || block == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        env_free();
+        return -1;
+    }
+    block[0] = NULL;
+    environ = block;
+
+    for (char **inherited = inherited_environ; inherited != NULL && *inherited != NULL; inherited++) {
+        char *equal = strchr(*inherited, '=');
+        if (equal == NULL || equal == *inherited) continue;
+
+        if (table_reserve() == -1 || block_reserve() == -1) {
+            env_free();
+            return -1;
+        }
+
+        // The first entry wins, as with getenv
+        size_t length = (size_t) (equal - *inherited);
+        struct variable *variable = &table[table_find(*inherited, length)];
+        if (variable->entry != NULL) continue;
+
+        *variable = (struct variable) {*inherited, length, block_append(*inherited), 1, 0};
+        table_count++;
+    }
+
+    return 0;
+}
+
+void env_free(void) {
+    for (size_t i = 0; table != NULL && i < table_capacity; i++) {
+        if (table[i].entry != NULL && table[i].owned) free(table[i].entry);
+    }
+
+    free(table);
+    free(block);
+    table = NULL;
+    block = NULL;
+    table_capacity = 0;
+    table_count = 0;
+    block_count = 0;
+    block_capacity = 0;
+    environ = inherited_environ;
+}
+
+const char *env_get(const char *name, size_t length) {
+    if (table == NULL) return NULL;
+
+    const struct variable *variable = &table[table_find(name, length)];
+    return variable->entry != NULL ? variable->entry + length + 1 : NULL;
+}
+
+int env_assign(const char *assignment, int export) {
+    size_t length = env_assignment_name(assignment);
+    if (length == 0) return -1;
+    if (table_reserve() == -1 || block_reserve() == -1) return -1;
+
+    char *entry = strdup(assignment);
+    if (entry == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return -1;
+    }
+
+    struct variable *variable = &table[table_find(assignment, length)];
+    if (variable->entry == NULL) {
+        *variable = (struct variable) {NULL, length, 0, 0, 0};
+        table_count++;
+    } else if (variable->owned) {
+        free(variable->entry);
+    }
+
+    variable->entry = entry;
+    variable->owned = 1;
+
+    // An exported variable only changes its own entry of the block
+    if (variable->exported) block[variable->slot] = entry;
+    else if (export) {
+        variable->slot = block_append(entry);
+        variable->exported = 1;
+    }
+    return 0;
+}
+
+void env_unset(const char *name, size_t length) {
+    if (table == NULL) return;
+
+    size_t i = table_find(name, length);
+    if (table[i].entry == NULL) return;
+
+    if (table[i].exported) block_remove(table[i].slot);
+    if (table[i].owned) free(table[i].entry);
+    table[i].entry = NULL;
+    table_count--;
+
+    // Shift back the variables that follow, so that no probe sequence has a hole
+    size_t mask = table_capacity - 1;
+    for (size_t j = (i + 1) & mask; table[j].entry != NULL; j = (j + 1) & mask) {
+        size_t home = hash_name(table[j].entry, table[j].name_length) & mask;
+        int in_place = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (in_place) continue;
+
+        table[i] = table[j];
+        table[j].entry = NULL;
+        i = j;
+    }
+}
+
+size_t env_assignment_name(const char *word) {
+    size_t length = name_length(word);
+    return length > 0 && word[length] == '=' ? length : 0;
+}
+
+size_t env_assignment_count(char *const *args) {
+    size_t count = 0;
+    while (args[count] != NULL && env_assignment_name(args[count]) > 0) count++;
+    return count;
+}
+
+char **env_block(void) {
+    return block;
+}
+
+char **env_block_with(char *const *assignments, size_t count) {
+    char **entries = malloc((block_count + count + 1) * sizeof(char *));
+    if (entries == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+
+    memcpy(entries, block, block_count * sizeof(char *));
+    size_t entries_count = block_count;
+
+    for (size_t i = 0; i < count; i++) {
+        size_t length = env_assignment_name(assignments[i]);
+        const struct variable *variable = &table[table_find(assignments[i], length)];
+
+        if (variable->entry != NULL && variable->exported) {
+            entries[variable->slot] = assignments[i];
+            continue;
+        }
+
+        // A variable that the shell does not export may be assigned twice
+        size_t j = block_count;
+        while (j < entries_count && strncmp(entries[j], assignments[i], length + 1) != 0) j++;
+        entries[j] = assignments[i];
+        if (j == entries_count) entries_count++;
+    }
+
+    entries[entries_count] = NULL;
+    return entries;
+}
+
+struct env_saved *env_override(char *const *assignments, size_t count) {
+    struct env_saved *saved = malloc(sizeof(struct env_saved) + count * sizeof(struct saved_variable));
+    if (saved == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+
+    for (saved->count = 0; saved->count < count; saved->count++) {
+        const char *name = assignments[saved->count];
+        size_t length = env_assignment_name(name);
+        const struct variable *variable = &table[table_find(name, length)];
+
+        struct saved_variable *previous = &saved->variables[saved->count];
+        *previous = (struct saved_variable) {name, length, NULL, variable->exported};
+        if (variable->entry != NULL) {
+            previous->entry = strdup(variable->entry);
+            if (previous->entry == NULL) break;
+        }
+
+        if (env_assign(name, 1) == -1) {
+            free(previous->entry);
+            break;
+        }
+    }
+
+    if (saved->count < count) {
+        env_restore(saved);
+        return NULL;
+    }
+    return saved;
+}
+
+void env_restore(struct env_saved *saved) {
+    // From the last assignment, a variable assigned twice gets the value it had before the first one
+    for (size_t i = saved->count; i-- > 0;) {
+        struct saved_variable *previous = &saved->variables[i];
+
+        if (previous->entry == NULL) {
+            env_unset(previous->name, previous->name_length);
+            continue;
+        }
+
+        env_assign(previous->entry, 0);
+        if (!previous->exported) unexport(previous->name, previous->name_length);
+        free(previous->entry);
+    }
+    free(saved);
+}
+
+int builtin_export(char **args, struct command *block_commands) {
+    (void) block_commands;
+
+    if (args[1] == NULL) {
+        for (size_t i = 0; i < block_count; i++) output_printf(STDOUT_FILENO, "export %s\n", block[i]);
+        return EXECUTION_SUCCESS;
+    }
+
+    int result = EXECUTION_SUCCESS;
+    for (int i = 1; args[i] != NULL; i++) {
+        size_t length = name_length(args[i]);
+
+        if (length > 0 && args[i][length] == '=') {
+            if (env_assign(args[i], 1) == -1) result = EXECUTION_FAILED;
+        } else if (length > 0 && args[i][length] == '\0') {
+            if (export_name(args[i], length) == -1) result = EXECUTION_FAILED;
+        } else {
+            fprintf(stderr, "export: %s: not a valid identifier\n", args[i]);
+            result = EXECUTION_FAILED;
+        }
+    }
+    return result;
+}
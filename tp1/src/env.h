@@ -0,0 +1,104 @@
+#ifndef TP1_ENV_H
+#define TP1_ENV_H
+
+#include <stddef.h>
+
+#include "parser.h"
+
+/**
+ * Imports the environment of the shell into its table of variables.
+ *
+ * The variables are kept in a hash table, and the exported ones in a block of "NAME=value" entries that
+ * environ points to, so children inherit it without any copy. The inherited entries are shared, only the
+ * assigned ones are allocated. Assigning an exported variable replaces its entry in the block in place.
+ *
+ * @return 0 on success, -1 on error
+ */
+int env_init(void);
+
+/**
+ * Frees the variables and restores the environment the shell started with.
+ */
+void env_free(void);
+
+/**
+ * Finds the value of a variable, exported or not.
+ *
+ * @param name the name of the variable, which does not need to end with a null character
+ * @param length the length of the name
+ * @return the value or NULL if the variable is not set
+ */
+const char *env_get(const char *name, size_t length);
+
+/**
+ * Sets a variable from an assignment word.
+ *
+ * @param assignment a "NAME=value" word
+ * @param export 1 to export the variable, 0 to keep it exported only if it already is
+ * @return 0 on success, -1 on error
+ */
+int env_assign(const char *assignment, int export);
+
+/**
+ * Removes a variable.
+ *
+ * @param name the name of the variable
+ * @param length the length of the name
+ */
+void env_unset(const char *name, size_t length);
+
+/**
+ * @return the length of the name that starts a "NAME=value" word, 0 if the word is not an assignment
+ */
+size_t env_assignment_name(const char *word);
+
+/**
+ * @param args the arguments of a command, the last element is NULL
+ * @return the number of assignments that prefix the command, e.g. 1 for "VAR=x cmd"
+ */
+size_t env_assignment_count(char *const *args);
+
+/**
+ * @return the environment of the commands, the last element is NULL, which the shell owns
+ */
+char **env_block(void);
+
+/**
+ * Builds the environment of a command that has assignments as prefixes. The new block shares the entries
+ * of the environment of the shell and points to the assignment words for the overridden variables.
+ *
+ * @param assignments the "NAME=value" words, which must outlive the block
+ * @param count the number of assignments
+ * @return the block, to free, or NULL on error
+ */
+char **env_block_with(char *const *assignments, size_t count);
+
+// Values of the variables before env_override
+struct env_saved;
+
+/**
+ * Applies the assignments that prefix a builtin, which are exported, until env_restore is called.
+ *
+ * @param assignments the "NAME=value" words
+ * @param count the number of assignments
+ * @return the previous state of the variables, to give to env_restore, or NULL on error
+ */
+struct env_saved *env_override(char *const *assignments, size_t count);
+
+/**
+ * Restores the variables changed by env_override.
+ *
+ * @param saved the previous state of the variables, freed by this function
+ */
+void env_restore(struct env_saved *saved);
+
+/**
+ * export [NAME[=value]]...: exports variables to the commands, or lists the exported variables.
+ *
+ * @param args the arguments of the command, the last element is NULL
+ * @param block unused
+ * @return execution_success, or execution_failed if a name is not valid
+ */
+int builtin_export(char **args, struct command *block);
+
+#endif
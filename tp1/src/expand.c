@@ -0,0 +1,436 @@
+#define _GNU_SOURCE // memfd_create, pipe2
+
+#include "expand.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "builtins.h"
+#include "env.h"
+#include "functions.h"
+#include "output.h"
+#include "parse_cache.h"
+#include "pathname.h"
+#include "script.h"
+#include "shell.h"
+
+// Free space guaranteed before each read of the output of a child, so that large outputs take few reads
+#define CAPTURE_READ_SIZE 65536
+
+struct string_buffer {
+    char *data;
+    size_t length;
+    size_t capacity;
+};
+
+struct word_list {
+    char **words; // The last element is NULL
+    size_t count;
+    size_t capacity;
+};
+
+/**
+ * Makes room for at least extra more bytes and a null terminator.
+ * @return 0 on success, -1 if the allocation failed
+ */
+static int buffer_reserve(struct string_buffer *buffer, size_t extra) {
+    if (buffer->length + extra < buffer->capacity) return 0;
+
+    size_t capacity = buffer->capacity ? buffer->capacity : 64;
+    while (buffer->length + extra >= capacity) capacity *= 2;
+
+    char *data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return -1;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+static int buffer_append(struct string_buffer *buffer, const char *string, size_t length) {
+    if (buffer_reserve(buffer, length) == -1) return -1;
+    memcpy(buffer->data + buffer->length, string, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+    return 0;
+}
+
+/**
+ * Adds a word at the end of the list, which owns it from now on.
+ * @return 0 on success, -1 if the allocation failed, the word is then freed
+ */
+static int words_push(struct word_list *list, char *word) {
+    if (list->count + 1 >= list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 8;
+        char **words = realloc(list->words, capacity * sizeof(char *));
+        if (words == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            free(word);
+            return -1;
+        }
+        list->words = words;
+        list->capacity = capacity;
+    }
+
+    list->words[list->count++] = word;
+    list->words[list->count] = NULL;
+    return 0;
+}
+
+/**
+ * Adds a copy of a word at the end of the list.
+ * @return 0 on success, -1 if the allocation failed
+ */
+static int words_add(struct word_list *list, const char *word, size_t length) {
+    char *copy = strndup(word, length);
+    if (copy == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return -1;
+    }
+    return words_push(list, copy);
+}
+
+static void words_free(char **words) {
+    if (words == NULL) return;
+    for (size_t i = 0; words[i]; i++) free(words[i]);
+    free(words);
+}
+
+/**
+ * Runs a builtin with its standard output redirected to an in-memory file, then appends what it wrote.
+ * @return 0 on success, -1 on error
+ */
+static int capture_builtin(struct command *tree, struct string_buffer *output) {
+    int memory_fd = memfd_create("substitution", MFD_CLOEXEC);
+    if (memory_fd == -1) {
+        perror("memfd_create");
+        return -1;
+    }
+
+    output_flush();
+    int saved_fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+    dup2(memory_fd, STDOUT_FILENO);
+    output_reset();
+
+    sh_run(tree);
+
+    output_flush();
+    dup2(saved_fd, STDOUT_FILENO);
+    close(saved_fd);
+    output_reset();
+
+    int result = 0;
+    struct stat st;
+    if (fstat(memory_fd, &st) == -1 || buffer_reserve(output, st.st_size) == -1) {
+        result = -1;
+    } else {
+        ssize_t length = pread(memory_fd, output->data + output->length, st.st_size, 0);
+        if (length > 0) output->length += length;
+        output->data[output->length] = '\0';
+    }
+
+    close(memory_fd);
+    return result;
+}
+
+/**
+ * Runs a tree in a child with its standard output connected to a pipe, then appends what it wrote.
+ * @return 0 on success, -1 on error
+ */
+static int capture_child(struct command *tree, struct string_buffer *output) {
+    int pipe_fd[2];
+    if (pipe2(pipe_fd, O_CLOEXEC) == -1) {
+        fprintf(stderr, "Error creating a pipe\n");
+        return -1;
+    }
+
+    pid_t pid = spawn_command(tree, -1, pipe_fd[1], pipe_fd[0]);
+    close(pipe_fd[1]);
+    if (pid < 0) {
+        close(pipe_fd[0]);
+        return -1;
+    }
+
+    // Read until every writer closed the pipe, the child is only waited for afterwards
+    int result = 0;
+    for (;;) {
+        if (buffer_reserve(output, CAPTURE_READ_SIZE) == -1) {
+            result = -1;
+            break;
+        }
+
+        ssize_t length = read(pipe_fd[0], output->data + output->length, output->capacity - output->length - 1);
+        if (length <= 0) break;
+        output->length += length;
+    }
+    if (output->data) output->data[output->length] = '\0';
+    close(pipe_fd[0]);
+
+    wait_command(pid, tree);
+    return result;
+}
+
+/**
+ * Runs the commands of a substitution and appends their output, without its trailing newlines.
+ * @return 0 on success, -1 on error
+ */
+static int substitute(const char *body, size_t length, struct string_buffer *output) {
+    size_t start = output->length;
+    int result = 0;
+
+    // The whole body is parsed before it runs, the builtins it runs may expand substitutions themselves
+    struct script script;
+    if (script_load_buffer(&script, body, length) == -1) return -1;
+
+    for (size_t i = 0; i < script.count && result == 0; i++) {
+        struct command *tree = script.lines[i]->commands;
+
+        // A builtin that does not change the state of the shell needs no child, its output is captured in the
+        // shell. The others run in a child, so that e.g. "$(export A=1)" does not export A.
+        if (tree->type == CMD_SIMPLE && (tree->word_flags == NULL || tree->word_flags[0] == 0) &&
+            builtin_is_pure(tree->args[0]) && builtin_find(tree->args) != NULL) {
+            result = capture_builtin(tree, output);
+        } else {
+            result = capture_child(tree, output);
+        }
+    }
+    script_free(&script);
+
+    while (output->length > start && output->data[output->length - 1] == '\n') output->length--;
+    if (output->data) output->data[output->length] = '\0';
+    return result;
+}
+
+/**
+ * Finds the ")" that closes a substitution, quotes and nested parentheses are skipped.
+ * @param body the first character after the "$("
+ * @return the ")" or NULL if there is none
+ */
+static const char *find_closing_paren(const char *body) {
+    int depth = 1;
+    char quote = 0;
+
+    for (const char *c = body; *c; c++) {
+        if (quote) {
+            if (*c == quote) quote = 0;
+        } else if (*c == '\'' || *c == '\"') {
+            quote = *c;
+        } else if (*c == '(') {
+            depth++;
+        } else if (*c == ')' && --depth == 0) {
+            return c;
+        }
+    }
+
+    return NULL;
+}
+
+static int is_name_char(char c) {
+    return isalnum((unsigned char) c) || c == '_';
+}
+
+/**
+ * Appends the value of a variable, or of a positional argument if the name is a number. An unset variable
+ * expands to nothing.
+ */
+static int append_variable(struct string_buffer *output, const char *name, size_t length) {
+    size_t index = 0;
+    size_t digits = 0;
+    while (digits < length && isdigit((unsigned char) name[digits])) index = index * 10 + (name[digits++] - '0');
+
+    const char *value = length > 0 && digits == length ? function_argument(index) : env_get(name, length);
+    return value ? buffer_append(output, value, strlen(value)) : 0;
+}
+
+/**
+ * Appends the positional arguments, separated by spaces.
+ */
+static int append_arguments(struct string_buffer *output) {
+    for (size_t i = 1; i <= function_argument_count(); i++) {
+        const char *argument = function_argument(i);
+        if (i > 1 && buffer_append(output, " ", 1) == -1) return -1;
+        if (buffer_append(output, argument, strlen(argument)) == -1) return -1;
+    }
+    return 0;
+}
+
+/**
+ * Expands the "$" of a word.
+ * @return 0 on success, -1 on error
+ */
+static int expand_word(const char *word, struct string_buffer *output) {
+    const char *c = word;
+
+    while (*c) {
+        const char *dollar = strchr(c, '$');
+        size_t literal = dollar ? (size_t) (dollar - c) : strlen(c);
+        if (buffer_append(output, c, literal) == -1) return -1;
+        if (dollar == NULL) break;
+
+        c = dollar + 1;
+        if (*c == '(') {
+            const char *end = find_closing_paren(c + 1);
+            if (end == NULL) {
+                fprintf(stderr, "Expansion error: missing )\n");
+                return -1;
+            }
+            if (substitute(c + 1, end - c - 1, output) == -1) return -1;
+            c = end + 1;
+        } else if (*c == '{') {
+            const char *end = strchr(c, '}');
+            if (end == NULL) {
+                fprintf(stderr, "Expansion error: missing }\n");
+                return -1;
+            }
+            if (append_variable(output, c + 1, end - c - 1) == -1) return -1;
+            c = end + 1;
+        } else if (*c == '?') {
+            char status[4];
+            int length = snprintf(status, sizeof(status), "%d", sh_last_status());
+            if (buffer_append(output, status, length) == -1) return -1;
+            c++;
+        } else if (*c == '#') {
+            char count[24];
+            int length = snprintf(count, sizeof(count), "%zu", function_argument_count());
+            if (buffer_append(output, count, length) == -1) return -1;
+            c++;
+        } else if (*c == '@' || *c == '*') {
+            if (append_arguments(output) == -1) return -1;
+            c++;
+        } else if (isdigit((unsigned char) *c)) {
+            // Only one digit, "${10}" is needed past "$9"
+            if (append_variable(output, c, 1) == -1) return -1;
+            c++;
+        } else if (is_name_char(*c)) {
+            const char *end = c;
+            while (is_name_char(*end)) end++;
+            if (append_variable(output, c, end - c) == -1) return -1;
+            c = end;
+        } else {
+            // A "$" that is not followed by a name is kept as is
+            if (buffer_append(output, "$", 1) == -1) return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Splits an expanded word at blanks, empty fields are dropped.
+ */
+static int split_word(struct word_list *list, const char *word) {
+    while (*word) {
+        while (*word == ' ' || *word == '\t' || *word == '\n') word++;
+        if (*word == '\0') break;
+
+        size_t length = strcspn(word, " \t\n");
+        if (words_add(list, word, length) == -1) return -1;
+        word += length;
+    }
+    return 0;
+}
+
+/**
+ * Replaces the words of the list from first on that are patterns by the paths they match. Patterns that
+ * match nothing are kept as is.
+ * @return 0 on success, -1 if the allocation failed
+ */
+static int glob_words(struct word_list *list, size_t first) {
+    size_t count = list->count - first;
+    if (count == 0) return 0;
+
+    char **fields = malloc(count * sizeof(char *));
+    if (fields == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return -1;
+    }
+    memcpy(fields, list->words + first, count * sizeof(char *));
+    list->count = first;
+    list->words[first] = NULL;
+
+    int result = 0;
+    for (size_t i = 0; i < count; i++) {
+        char **paths = result == 0 && pathname_is_pattern(fields[i]) ? pathname_expand(fields[i]) : NULL;
+        if (paths == NULL) {
+            if (result == 0) result = words_push(list, fields[i]);
+            else free(fields[i]);
+            continue;
+        }
+
+        free(fields[i]);
+        for (size_t j = 0; paths[j]; j++) {
+            if (result == 0) result = words_push(list, paths[j]);
+            else free(paths[j]);
+        }
+        free(paths);
+    }
+
+    free(fields);
+    return result;
+}
+
+int expand_command(const struct command *cmd, struct command *expanded) {
+    struct word_list list = {NULL, 0, 0};
+    struct string_buffer buffer = {NULL, 0, 0};
+    int result = 0;
+
+    for (size_t i = 0; cmd->args[i] && result == 0; i++) {
+        unsigned char flags = cmd->word_flags[i];
+        size_t first = list.count;
+
+        if (!(flags & WORD_EXPAND)) {
+            result = words_add(&list, cmd->args[i], strlen(cmd->args[i]));
+        } else {
+            buffer.length = 0;
+            if (buffer_reserve(&buffer, 0) == -1) {
+                result = -1;
+                continue;
+            }
+            buffer.data[0] = '\0';
+
+            if (expand_word(cmd->args[i], &buffer) == -1) {
+                result = -1;
+            } else if (flags & WORD_SPLIT) {
+                result = split_word(&list, buffer.data);
+            } else {
+                result = words_add(&list, buffer.data, buffer.length);
+            }
+        }
+
+        // Unquoted words are patterns, whether the special characters were written or expanded
+        if (result == 0 && (flags & (WORD_GLOB | WORD_SPLIT))) result = glob_words(&list, first);
+    }
+    free(buffer.data);
+
+    // Every word may expand to nothing
+    if (result == 0 && list.words == NULL) {
+        list.words = calloc(1, sizeof(char *));
+        if (list.words == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            result = -1;
+        }
+    }
+
+    if (result == -1) {
+        words_free(list.words);
+        return -1;
+    }
+
+    *expanded = *cmd;
+    expanded->args = list.words;
+    expanded->word_flags = NULL;
+    return 0;
+}
+
+void expand_free(struct command *expanded) {
+    words_free(expanded->args);
+    expanded->args = NULL;
+}
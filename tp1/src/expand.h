@@ -0,0 +1,28 @@
+#ifndef TP1_EXPAND_H
+#define TP1_EXPAND_H
+
+#include "parser.h"
+
+/**
+ * Expands the words of a simple command just before it runs: "$(...)" is replaced by the output of the
+ * commands, trailing newlines removed, "$NAME" and "${NAME}" by the value of the variable, and "$?" by
+ * the exit status of the last command. Unquoted words are then split at blanks, and the ones that are
+ * patterns are replaced by the paths they match.
+ *
+ * The output of a builtin is captured in memory without forking, other commands write to a pipe.
+ *
+ * @param cmd the simple command, its word_flags must not be NULL
+ * @param expanded receives a copy of the command with the expanded arguments and no word_flags, its
+ *                 first argument is NULL if every word expanded to nothing
+ * @return 0 on success, -1 on error
+ */
+int expand_command(const struct command *cmd, struct command *expanded);
+
+/**
+ * Frees the arguments of a command filled by expand_command.
+ *
+ * @param expanded the expanded command
+ */
+void expand_free(struct command *expanded);
+
+#endif
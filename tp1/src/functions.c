@@ -0,0 +1,125 @@
+#include "functions.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shell.h"
+
+// Maximum number of nested calls, a function that calls itself forever stops there instead of crashing
+#define FUNCTION_DEPTH_LIMIT 1000
+
+struct function {
+    char *name;
+    struct command *body; // Copy of the tree of the definition
+    size_t references; // The table, while the function is defined, and each call that is running it
+    struct function *next; // Next function of the bucket
+};
+
+static struct function *buckets[FUNCTION_BUCKETS];
+static size_t function_count = 0;
+
+// Positional arguments of the function that is running, arguments[0] is its name
+static char **arguments = NULL;
+static size_t argument_count = 0;
+static size_t depth = 0;
+
+static size_t bucket_of(const char *name) {
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+    for (const char *c = name; *c; c++) {
+        hash ^= (unsigned char) *c;
+        hash *= 1099511628211ULL;
+    }
+    return hash % FUNCTION_BUCKETS;
+}
+
+/**
+ * Drops a reference to a function, the last one frees it.
+ */
+static void function_release(struct function *function) {
+    if (--function->references > 0) return;
+
+    cmd_free(function->body);
+    free(function->name);
+    free(function);
+}
+
+int function_define(const struct command *definition) {
+    struct function *function = calloc(1, sizeof(struct function));
+    char *name = strdup(definition->args[0]);
+    struct command *body = cmd_copy(definition->left);
+    if (function == NULL || name == NULL || body == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(function);
+        free(name);
+        cmd_free(body);
+        return -1;
+    }
+
+    function->name = name;
+    function->body = body;
+    function->references = 1;
+
+    struct function **slot = &buckets[bucket_of(name)];
+    while (*slot != NULL && strcmp((*slot)->name, name) != 0) slot = &(*slot)->next;
+
+    if (*slot != NULL) {
+        function->next = (*slot)->next;
+        function_release(*slot);
+    } else {
+        function_count++;
+    }
+    *slot = function;
+    return 0;
+}
+
+struct function *function_find(const char *name) {
+    if (function_count == 0) return NULL;
+
+    struct function *function = buckets[bucket_of(name)];
+    while (function != NULL && strcmp(function->name, name) != 0) function = function->next;
+    return function;
+}
+
+int function_call(struct function *function, char **args) {
+    if (depth == FUNCTION_DEPTH_LIMIT) {
+        fprintf(stderr, "%s: maximum function depth exceeded\n", args[0]);
+        return EXECUTION_FAILED;
+    }
+
+    char **saved_arguments = arguments;
+    size_t saved_count = argument_count;
+    arguments = args;
+    for (argument_count = 0; args[argument_count + 1] != NULL; argument_count++);
+
+    // The body stays valid even if the function is replaced while it runs
+    function->references++;
+    depth++;
+    int result = sh_run(function->body);
+    depth--;
+    function_release(function);
+
+    arguments = saved_arguments;
+    argument_count = saved_count;
+    return result;
+}
+
+const char *function_argument(size_t index) {
+    return index >= 1 && index <= argument_count ? arguments[index] : NULL;
+}
+
+size_t function_argument_count(void) {
+    return argument_count;
+}
+
+void function_clear(void) {
+    for (size_t i = 0; i < FUNCTION_BUCKETS; i++) {
+        while (buckets[i] != NULL) {
+            struct function *function = buckets[i];
+            buckets[i] = function->next;
+            function_release(function);
+        }
+    }
+    function_count = 0;
+}
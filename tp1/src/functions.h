@@ -0,0 +1,59 @@
+#ifndef TP1_FUNCTIONS_H
+#define TP1_FUNCTIONS_H
+
+#include <stddef.h>
+
+#include "parser.h"
+
+// Number of buckets of the table of functions
+#define FUNCTION_BUCKETS 64
+
+// Body of a function, shared by the table and the calls that are running it
+struct function;
+
+/**
+ * Defines a function, or replaces the function with the same name. The body is copied, so that it stays
+ * valid once the line that defines it is released, and is never tokenized or parsed again.
+ *
+ * @param definition a CMD_FUNCTION node
+ * @return 0 on success, -1 on error
+ */
+int function_define(const struct command *definition);
+
+/**
+ * Finds a function.
+ *
+ * @param name the name of the command
+ * @return the function or NULL if there is none with that name
+ */
+struct function *function_find(const char *name);
+
+/**
+ * Runs the body of a function with its positional arguments bound to "$1", "$2", ... A function that
+ * is replaced while it runs stays valid until it returns.
+ *
+ * @param function the function
+ * @param args the name of the function followed by its arguments, the last element is NULL
+ * @return the execution status of the body
+ */
+int function_call(struct function *function, char **args);
+
+/**
+ * Finds a positional argument of the function that is running.
+ *
+ * @param index the number of the argument, from 1
+ * @return the argument or NULL if there is none
+ */
+const char *function_argument(size_t index);
+
+/**
+ * @return the number of positional arguments of the function that is running, "$#"
+ */
+size_t function_argument_count(void);
+
+/**
+ * Removes all the functions.
+ */
+void function_clear(void);
+
+#endif
@@ -0,0 +1,444 @@
+#define _GNU_SOURCE // asprintf, memmem, memrchr
+
+#include "history.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "env.h"
+#include "output.h"
+#include "shell.h"
+
+#define HISTORY_MAGIC "TP1HIST1"
+
+// Below this number of suffixes, the radix sort switches to an insertion sort
+#define SUFFIX_SORT_CUTOFF 32
+
+struct history_index {
+    char magic[8]; // HISTORY_MAGIC
+    uint64_t indexed_length; // Number of bytes of the log covered by the suffix array
+    uint64_t count; // Number of suffixes
+    uint32_t suffixes[]; // Offsets of the suffixes in the log, sorted by their text up to the end of their line
+};
+
+struct match_list {
+    uint32_t *offsets; // Offsets of the lines that match
+    size_t count;
+    size_t capacity;
+};
+
+static char *log_path = NULL;
+static char *index_path = NULL;
+static int log_fd = -1;
+static const char *log_map = NULL; // NULL if the log is empty
+static size_t log_size = 0; // Size of the mapping of the log
+static const struct history_index *index_map = NULL; // NULL if there is no valid index
+static size_t index_size = 0;
+
+/**
+ * Maps the log again if it grew since it was last mapped, e.g. because lines were appended.
+ * @return 0 on success, -1 on error
+ */
+static int log_refresh(void) {
+    struct stat st;
+    if (fstat(log_fd, &st) == -1) return -1;
+    if ((size_t) st.st_size == log_size) return 0;
+
+    if (log_map) munmap((void *) log_map, log_size);
+    log_map = NULL;
+    log_size = 0;
+    if (st.st_size == 0) return 0;
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, log_fd, 0);
+    if (map == MAP_FAILED) {
+        perror(log_path);
+        return -1;
+    }
+    log_map = map;
+    log_size = st.st_size;
+    return 0;
+}
+
+/**
+ * Maps the index, it is ignored if it does not match the log.
+ */
+static void index_load(void) {
+    if (index_map) munmap((void *) index_map, index_size);
+    index_map = NULL;
+    index_size = 0;
+
+    int fd = open(index_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(struct history_index)) {
+        close(fd);
+        return;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return;
+
+    const struct history_index *index = map;
+    if (memcmp(index->magic, HISTORY_MAGIC, sizeof(index->magic)) != 0 ||
+        sizeof(struct history_index) + index->count * sizeof(uint32_t) != (size_t) st.st_size ||
+        index->indexed_length > log_size) {
+        munmap(map, st.st_size);
+        return;
+    }
+
+    index_map = index;
+    index_size = st.st_size;
+}
+
+static size_t indexed_length(void) {
+    return index_map ? index_map->indexed_length : 0;
+}
+
+/**
+ * Orders the bytes of suffixes, the end of a line comes before any other byte.
+ */
+static int byte_rank(unsigned char c) {
+    return c == '\n' ? 0 : c + 1;
+}
+
+static int suffix_compare(uint32_t a, uint32_t b) {
+    const unsigned char *x = (const unsigned char *) log_map + a;
+    const unsigned char *y = (const unsigned char *) log_map + b;
+    while (*x == *y && *x != '\n') {
+        x++;
+        y++;
+    }
+    return byte_rank(*x) - byte_rank(*y);
+}
+
+/**
+ * Sorts suffixes that share their first depth bytes, with a most significant digit radix sort. Suffixes
+ * of lines that repeat share long prefixes, comparison sorts would compare them over and over.
+ * @param scratch an array of at least count suffixes
+ */
+static void suffix_sort(uint32_t *suffixes, uint32_t *scratch, size_t count, size_t depth) {
+    while (count >= SUFFIX_SORT_CUTOFF) {
+        uint32_t counts[257] = {0};
+        for (size_t i = 0; i < count; i++) counts[byte_rank(log_map[suffixes[i] + depth])]++;
+
+        // Skip the bytes shared by every suffix without recursing
+        int first = byte_rank(log_map[suffixes[0] + depth]);
+        if (counts[first] == count) {
+            if (first == 0) return; // Every suffix ends here, they are equal
+            depth++;
+            continue;
+        }
+
+        uint32_t starts[257];
+        uint32_t start = 0;
+        for (int rank = 0; rank < 257; rank++) {
+            starts[rank] = start;
+            start += counts[rank];
+        }
+
+        for (size_t i = 0; i < count; i++) scratch[starts[byte_rank(log_map[suffixes[i] + depth])]++] = suffixes[i];
+        memcpy(suffixes, scratch, count * sizeof(uint32_t));
+
+        // The suffixes that end at this depth are equal, the other buckets are sorted on the next byte
+        for (int rank = 1; rank < 257; rank++) {
+            if (counts[rank] > 1) suffix_sort(suffixes + starts[rank] - counts[rank], scratch, counts[rank], depth + 1);
+        }
+        return;
+    }
+
+    for (size_t i = 1; i < count; i++) {
+        uint32_t suffix = suffixes[i];
+        size_t j = i;
+        for (; j > 0 && suffix_compare(suffixes[j - 1] + depth, suffix + depth) > 0; j--) suffixes[j] = suffixes[j - 1];
+        suffixes[j] = suffix;
+    }
+}
+
+/**
+ * Compares the start of a suffix with a pattern, which contains no newline.
+ * @return 0 if the suffix starts with the pattern, the order of the suffix and the pattern otherwise
+ */
+static int suffix_compare_pattern(uint32_t offset, const char *pattern, size_t length) {
+    const unsigned char *suffix = (const unsigned char *) log_map + offset;
+    for (size_t i = 0; i < length; i++) {
+        if (suffix[i] != (unsigned char) pattern[i]) return byte_rank(suffix[i]) - byte_rank(pattern[i]);
+    }
+    return 0;
+}
+
+/**
+ * Merges the suffixes of the lines appended since the last update into a new index, which replaces the
+ * old one atomically. Only the new suffixes are sorted, the old ones are already in order.
+ */
+static void history_reindex(void) {
+    if (log_refresh() == -1) return;
+
+    // Only complete lines are indexed, and the offsets must fit in 32 bits
+    size_t start = indexed_length();
+    size_t end = log_size;
+    while (end > start && log_map[end - 1] != '\n') end--;
+    if (end <= start || end > UINT32_MAX) return;
+
+    uint32_t *suffixes = malloc((end - start) * sizeof(uint32_t));
+    uint32_t *scratch = malloc((end - start) * sizeof(uint32_t));
+    char *temporary_path = NULL;
+    if (suffixes == NULL || scratch == NULL || asprintf(&temporary_path, "%s.%d", index_path, getpid()) == -1) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(suffixes);
+        free(scratch);
+        return;
+    }
+
+    size_t count = 0;
+    for (size_t offset = start; offset < end; offset++) {
+        if (log_map[offset] != '\n') suffixes[count++] = (uint32_t) offset;
+    }
+    suffix_sort(suffixes, scratch, count, 0);
+    free(scratch);
+
+    size_t old_count = index_map ? index_map->count : 0;
+    size_t size = sizeof(struct history_index) + (old_count + count) * sizeof(uint32_t);
+
+    int fd = open(temporary_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    void *map = MAP_FAILED;
+    if (fd != -1 && ftruncate(fd, (off_t) size) == 0) {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        perror(temporary_path);
+        if (fd != -1) {
+            close(fd);
+            unlink(temporary_path);
+        }
+        free(temporary_path);
+        free(suffixes);
+        return;
+    }
+
+    struct history_index *index = map;
+    memcpy(index->magic, HISTORY_MAGIC, sizeof(index->magic));
+    index->indexed_length = end;
+    index->count = old_count + count;
+
+    size_t i = 0, j = 0, k = 0;
+    while (i < old_count && j < count) {
+        if (suffix_compare(index_map->suffixes[i], suffixes[j]) <= 0) index->suffixes[k++] = index_map->suffixes[i++];
+        else index->suffixes[k++] = suffixes[j++];
+    }
+    while (i < old_count) index->suffixes[k++] = index_map->suffixes[i++];
+    while (j < count) index->suffixes[k++] = suffixes[j++];
+
+    munmap(map, size);
+    close(fd);
+    if (rename(temporary_path, index_path) == -1) {
+        perror(index_path);
+        unlink(temporary_path);
+    }
+
+    free(temporary_path);
+    free(suffixes);
+    index_load();
+}
+
+void history_open(void) {
+    const char *path = env_get("SHELL_HISTORY", strlen("SHELL_HISTORY"));
+    int allocated;
+
+    if (path != NULL && path[0] != '\0') {
+        allocated = (log_path = strdup(path)) != NULL;
+    } else {
+        const char *home = env_get("HOME", strlen("HOME"));
+        if (!isatty(STDIN_FILENO) || home == NULL) return;
+        allocated = asprintf(&log_path, "%s/.tp1_history", home) != -1;
+    }
+
+    if (!allocated || asprintf(&index_path, "%s.index", log_path) == -1) {
+        fprintf(stderr, "Memory allocation error\n");
+        history_close();
+        return;
+    }
+
+    log_fd = open(log_path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (log_fd == -1) {
+        perror(log_path);
+        history_close();
+        return;
+    }
+
+    if (log_refresh() == -1) {
+        history_close();
+        return;
+    }
+    index_load();
+}
+
+int history_enabled(void) {
+    return log_fd != -1;
+}
+
+void history_add(const char *line, size_t length) {
+    if (log_fd == -1) return;
+
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) length--;
+
+    size_t i = 0;
+    while (i < length && (line[i] == ' ' || line[i] == '\t')) i++;
+    if (i == length) return; // Blank line
+
+    // One line of the log per entry, the whole entry is appended by a single write
+    char *entry = malloc(length + 1);
+    if (entry == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return;
+    }
+    for (i = 0; i < length; i++) entry[i] = line[i] == '\n' ? ' ' : line[i];
+    entry[length] = '\n';
+
+    ssize_t written = write(log_fd, entry, length + 1);
+    free(entry);
+    if (written == -1) {
+        perror(log_path);
+        return;
+    }
+
+    off_t end = lseek(log_fd, 0, SEEK_CUR);
+    if (end != -1 && (size_t) end - indexed_length() > HISTORY_TAIL_LIMIT) history_reindex();
+}
+
+void history_close(void) {
+    if (log_map) munmap((void *) log_map, log_size);
+    if (index_map) munmap((void *) index_map, index_size);
+    if (log_fd != -1) close(log_fd);
+    free(log_path);
+    free(index_path);
+
+    log_map = NULL;
+    log_size = 0;
+    index_map = NULL;
+    index_size = 0;
+    log_fd = -1;
+    log_path = NULL;
+    index_path = NULL;
+}
+
+static int match_add(struct match_list *matches, uint32_t offset) {
+    if (matches->count == matches->capacity) {
+        size_t capacity = matches->capacity ? matches->capacity * 2 : 64;
+        uint32_t *offsets = realloc(matches->offsets, capacity * sizeof(uint32_t));
+        if (offsets == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            return -1;
+        }
+        matches->offsets = offsets;
+        matches->capacity = capacity;
+    }
+    matches->offsets[matches->count++] = offset;
+    return 0;
+}
+
+static int offset_compare(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Finds the lines that start with a pattern, or contain it, with a binary search in the suffix array.
+ * The lines that are not indexed yet are searched linearly.
+ */
+static int history_search(const char *pattern, int prefix_only, struct match_list *matches) {
+    size_t length = strlen(pattern);
+
+    if (index_map) {
+        size_t low = 0;
+        size_t high = index_map->count;
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            if (suffix_compare_pattern(index_map->suffixes[middle], pattern, length) < 0) low = middle + 1;
+            else high = middle;
+        }
+
+        for (size_t i = low; i < index_map->count; i++) {
+            uint32_t offset = index_map->suffixes[i];
+            if (suffix_compare_pattern(offset, pattern, length) != 0) break;
+
+            // A prefix is a suffix that starts a line, a substring is reported as the line that contains it
+            if (prefix_only) {
+                if (offset != 0 && log_map[offset - 1] != '\n') continue;
+            } else {
+                const char *newline = memrchr(log_map, '\n', offset);
+                offset = newline ? (uint32_t) (newline - log_map + 1) : 0;
+            }
+            if (match_add(matches, offset) == -1) return -1;
+        }
+    }
+
+    for (size_t start = indexed_length(); start < log_size;) {
+        const char *newline = memchr(log_map + start, '\n', log_size - start);
+        size_t end = newline ? (size_t) (newline - log_map) : log_size;
+
+        int match = prefix_only ? end - start >= length && memcmp(log_map + start, pattern, length) == 0
+                                : memmem(log_map + start, end - start, pattern, length) != NULL;
+        if (match && match_add(matches, (uint32_t) start) == -1) return -1;
+        start = end + 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Writes the line of the log that starts at an offset.
+ */
+static void line_print(size_t offset) {
+    const char *newline = memchr(log_map + offset, '\n', log_size - offset);
+    size_t length = newline ? (size_t) (newline - log_map) - offset : log_size - offset;
+    output_write(STDOUT_FILENO, log_map + offset, length);
+    output_write(STDOUT_FILENO, "\n", 1);
+}
+
+int builtin_history(char **args, struct command *block) {
+    (void) block;
+
+    int prefix_only = args[1] != NULL && strcmp(args[1], "-p") == 0;
+    if (args[1] != NULL && (!(prefix_only || strcmp(args[1], "-s") == 0) || args[2] == NULL || args[3] != NULL ||
+                            strchr(args[2], '\n') != NULL)) {
+        fprintf(stderr, "Usage: history [-p prefix | -s text]\n");
+        return EXECUTION_FAILED;
+    }
+
+    if (log_fd == -1 || log_refresh() == -1 || log_map == NULL) return EXECUTION_SUCCESS;
+
+    if (args[1] == NULL) {
+        size_t number = 1;
+        for (size_t offset = 0; offset < log_size; number++) {
+            output_printf(STDOUT_FILENO, "%5zu  ", number);
+            line_print(offset);
+            const char *newline = memchr(log_map + offset, '\n', log_size - offset);
+            offset = newline ? (size_t) (newline - log_map) + 1 : log_size;
+        }
+        return EXECUTION_SUCCESS;
+    }
+
+    struct match_list matches = {NULL, 0, 0};
+    if (history_search(args[2], prefix_only, &matches) == -1) {
+        free(matches.offsets);
+        return EXECUTION_FAILED;
+    }
+
+    // A line that contains the text several times is printed once
+    qsort(matches.offsets, matches.count, sizeof(uint32_t), offset_compare);
+    for (size_t i = 0; i < matches.count; i++) {
+        if (i == 0 || matches.offsets[i] != matches.offsets[i - 1]) line_print(matches.offsets[i]);
+    }
+
+    free(matches.offsets);
+    return EXECUTION_SUCCESS;
+}
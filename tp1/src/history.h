@@ -0,0 +1,50 @@
+#ifndef TP1_HISTORY_H
+#define TP1_HISTORY_H
+
+#include <stddef.h>
+
+#include "parser.h"
+
+// Number of bytes appended to the log after which the new lines are merged into the index
+#define HISTORY_TAIL_LIMIT 65536
+
+/**
+ * Opens the history of the interactive shell: the file named by the SHELL_HISTORY environment variable,
+ * or ~/.tp1_history when the standard input is a terminal.
+ *
+ * The history is an append-only log of lines, and an index next to it, in the same file with the
+ * ".index" suffix, which is a suffix array of the log. Both are memory-mapped, nothing is read at
+ * startup. The lines appended since the last index update are searched linearly, and are merged into
+ * the index once they exceed HISTORY_TAIL_LIMIT bytes.
+ */
+void history_open(void);
+
+/**
+ * @return 1 if the lines are recorded, i.e. a history file is open, 0 otherwise
+ */
+int history_enabled(void);
+
+/**
+ * Appends a line to the history, unless it is blank.
+ *
+ * @param line the text of the line, its final newline is not stored
+ * @param length the length of the text
+ */
+void history_add(const char *line, size_t length);
+
+/**
+ * Unmaps and closes the history.
+ */
+void history_close(void);
+
+/**
+ * history [-p prefix | -s text]: lists the lines of the history, with their numbers, or only the ones
+ * that start with a prefix or contain a text, from the oldest to the most recent.
+ *
+ * @param args the arguments of the command, the last element is NULL
+ * @param block unused
+ * @return execution_success, or execution_failed if the arguments are not valid
+ */
+int builtin_history(char **args, struct command *block);
+
+#endif
@@ -0,0 +1,307 @@
+#include "jobs.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "output.h"
+#include "stats.h"
+#include "supervise.h"
+#include "trace.h"
+
+static struct job *jobs = NULL;
+static size_t job_count = 0;
+static size_t job_capacity = 0;
+
+static int is_interactive = 0;
+static int self_pipe[2] = {-1, -1};
+static int unwatched = 0; // Whether a child could not be watched with a pidfd, the children are then reaped with wait4(-1)
+
+/**
+ * Wakes up the shell when a child changes state, for the children that are not watched with a pidfd.
+ * Only async-signal-safe calls are allowed here, the job table is updated by jobs_reap.
+ */
+static void sigchld_handler(int signal, siginfo_t *info, void *context) {
+    (void) signal;
+    (void) context;
+    int saved_errno = errno;
+    trace_instant("exit", info->si_pid, NULL); // Signals may be merged, some exits are not traced
+    ssize_t written = write(self_pipe[1], "", 1); // The pipe is non-blocking, a full pipe is already a wake-up
+    (void) written;
+    errno = saved_errno;
+}
+
+/**
+ * Creates the self-pipe used by the SIGCHLD handler.
+ */
+static void self_pipe_open(void) {
+    if (pipe(self_pipe) == -1) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        fcntl(self_pipe[i], F_SETFD, FD_CLOEXEC);
+        fcntl(self_pipe[i], F_SETFL, O_NONBLOCK);
+    }
+}
+
+/**
+ * Empties the self-pipe, so that the next poll only returns on a new SIGCHLD.
+ */
+static void self_pipe_drain(void) {
+    char buffer[64];
+    while (read(self_pipe[0], buffer, sizeof(buffer)) > 0);
+}
+
+void jobs_init(int interactive) {
+    is_interactive = interactive;
+    self_pipe_open();
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = sigchld_handler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART | SA_NOCLDSTOP; // Do not interrupt the foreground waitpid and reads
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGCHLD, &action, NULL);
+}
+
+void jobs_reset(void) {
+    jobs_free();
+    unwatched = 0;
+    close(self_pipe[0]);
+    close(self_pipe[1]);
+    self_pipe_open();
+}
+
+/**
+ * Builds the command line of a job, e.g. "sleep 1 && echo done".
+ */
+static char *job_command_string(const struct command *list) {
+    char *command = NULL;
+    size_t length = 0;
+
+    FILE *stream = open_memstream(&command, &length);
+    if (stream == NULL) return NULL;
+    cmd_write(stream, list);
+    fclose(stream);
+
+    return command;
+}
+
+int jobs_add(pid_t pid, const struct command *list) {
+    if (job_count == job_capacity) {
+        size_t capacity = job_capacity ? job_capacity * 2 : 16;
+        struct job *table = realloc(jobs, capacity * sizeof(struct job));
+        if (table == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            return -1;
+        }
+        jobs = table;
+        job_capacity = capacity;
+    }
+
+    // Job numbers are reused once the highest ones are forgotten, like in bash
+    struct job *job = &jobs[job_count];
+    job->id = job_count ? jobs[job_count - 1].id + 1 : 1;
+    job->pid = pid;
+    job->status = 0;
+    job->state = JOB_RUNNING;
+    job->command = job_command_string(list);
+    job_count++;
+    jobs_watch(pid);
+
+    if (is_interactive) fprintf(stderr, "[%d] %d\n", job->id, pid);
+
+    return job->id;
+}
+
+/**
+ * Finds the index of the job run by a process.
+ *
+ * @return the index or -1 if the process is not a job
+ */
+static long job_index_pid(pid_t pid) {
+    for (size_t i = 0; i < job_count; i++) {
+        if (jobs[i].pid == pid) return (long) i;
+    }
+    return -1;
+}
+
+void jobs_watch(pid_t pid) {
+    if (supervise_watch(pid) == -1) unwatched = 1;
+}
+
+/**
+ * Records the status of a child that has finished, if it is a job.
+ * @return 0 if the child is a job, -1 otherwise
+ */
+static int job_finish(pid_t pid, int status, const struct rusage *usage) {
+    long index = job_index_pid(pid);
+    if (index < 0) return -1;
+
+    struct job *job = &jobs[index];
+    stats_record(job->command ? job->command : "background", usage, 0);
+    job->status = status;
+    job->state = JOB_DONE;
+    return 0;
+}
+
+pid_t jobs_reap_child(int *status, struct rusage *usage) {
+    // The epoll set of the pidfds only returns the children that have finished
+    pid_t pid;
+    while ((pid = supervise_next(0)) > 0) {
+        int reaped;
+        while ((reaped = wait4(pid, status, 0, usage)) == -1 && errno == EINTR);
+        if (reaped != pid) continue; // Already reaped by wait4(-1) below
+
+        if (job_finish(pid, *status, usage) == -1) return pid;
+    }
+
+    // Without pidfds, each call to wait4 returns a child that has finished, the jobs are not polled one by one
+    while (unwatched && (pid = wait4(-1, status, WNOHANG, usage)) > 0) {
+        if (job_finish(pid, *status, usage) == -1) return pid;
+    }
+    return 0;
+}
+
+void jobs_reap(void) {
+    self_pipe_drain();
+
+    // The other children are waited for synchronously, none of them is left when the jobs are reaped
+    int status;
+    struct rusage usage;
+    while (jobs_reap_child(&status, &usage) > 0);
+}
+
+/**
+ * Prints one line of the job table.
+ */
+static void job_print(const struct job *job) {
+    const char *state = "Running";
+    char exit_state[32];
+
+    if (job->state == JOB_DONE) {
+        if (WIFEXITED(job->status) && WEXITSTATUS(job->status) != 0) {
+            snprintf(exit_state, sizeof(exit_state), "Exit %d", WEXITSTATUS(job->status));
+            state = exit_state;
+        } else if (WIFSIGNALED(job->status)) {
+            snprintf(exit_state, sizeof(exit_state), "Killed %d", WTERMSIG(job->status));
+            state = exit_state;
+        } else {
+            state = "Done";
+        }
+    }
+
+    output_printf(STDOUT_FILENO, "[%d]  %-12s %s\n", job->id, state, job->command ? job->command : "");
+}
+
+/**
+ * Removes the job at the given index from the table.
+ */
+static void job_remove(size_t index) {
+    free(jobs[index].command);
+    memmove(&jobs[index], &jobs[index + 1], (job_count - index - 1) * sizeof(struct job));
+    job_count--;
+}
+
+/**
+ * Removes every finished job from the table.
+ */
+static void jobs_forget_done(void) {
+    size_t i = 0;
+    while (i < job_count) {
+        if (jobs[i].state == JOB_DONE) job_remove(i);
+        else i++;
+    }
+}
+
+void jobs_notify(void) {
+    if (!is_interactive) return;
+
+    for (size_t i = 0; i < job_count; i++) {
+        if (jobs[i].state == JOB_DONE) job_print(&jobs[i]);
+    }
+    output_flush();
+    jobs_forget_done();
+}
+
+void jobs_print(void) {
+    jobs_reap();
+    for (size_t i = 0; i < job_count; i++) {
+        job_print(&jobs[i]);
+    }
+    jobs_forget_done();
+}
+
+/**
+ * Finds the index of a job in the table.
+ *
+ * @return the index or -1 if the job does not exist
+ */
+static long job_index(int id) {
+    for (size_t i = 0; i < job_count; i++) {
+        if (jobs[i].id == id) return (long) i;
+    }
+    return -1;
+}
+
+int jobs_wait(int id) {
+    for (;;) {
+        jobs_reap();
+
+        if (id == 0) {
+            int running = 0;
+            for (size_t i = 0; i < job_count; i++) running |= jobs[i].state == JOB_RUNNING;
+            if (!running) {
+                jobs_forget_done();
+                return 0;
+            }
+        } else {
+            long index = job_index(id);
+            if (index < 0) return -1;
+            if (jobs[index].state == JOB_DONE) {
+                int status = jobs[index].status;
+                job_remove(index);
+                return status;
+            }
+        }
+
+        jobs_wait_child();
+    }
+}
+
+void jobs_wait_child(void) {
+    // The output of the shell is shown before it blocks, not when the child finishes
+    output_flush();
+
+    // The self-pipe is only needed for the children without a pidfd, it is written on every SIGCHLD
+    struct pollfd pfds[2] = {{supervise_fd(), POLLIN, 0}, {self_pipe[0], POLLIN, 0}};
+    if (poll(pfds, unwatched ? 2 : 1, -1) == -1 && errno != EINTR) {
+        perror("poll");
+    }
+    self_pipe_drain();
+}
+
+int jobs_find_pid(pid_t pid) {
+    long index = job_index_pid(pid);
+    return index < 0 ? -1 : jobs[index].id;
+}
+
+void jobs_free(void) {
+    supervise_close();
+    for (size_t i = 0; i < job_count; i++) {
+        free(jobs[i].command);
+    }
+    free(jobs);
+    jobs = NULL;
+    job_count = 0;
+    job_capacity = 0;
+}
@@ -0,0 +1,108 @@
+#ifndef TP1_JOBS_H
+#define TP1_JOBS_H
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include "parser.h"
+
+enum job_state {
+    JOB_RUNNING = 0,
+    JOB_DONE,
+};
+
+struct job {
+    int id; // Job number, as shown by the jobs builtin
+    pid_t pid; // Process running the job
+    int status; // Wait status of the process, valid once the job is done
+    enum job_state state; // State of the job
+    char *command; // Command line of the job
+};
+
+/**
+ * Initializes the job table and installs the SIGCHLD handler.
+ * Children are reaped asynchronously: each job is watched with a pidfd in the epoll set of supervise.h,
+ * the table is updated by jobs_reap when the pidfds are readable. Without pidfd support, the SIGCHLD
+ * handler only writes a byte to a self-pipe and jobs_reap collects the children with wait4(-1).
+ *
+ * @param interactive whether job start and completion should be reported on stderr
+ */
+void jobs_init(int interactive);
+
+/**
+ * Forgets the jobs inherited from the parent shell, closes their pidfds and creates a new self-pipe.
+ * Used by forked subshells, whose parent's jobs are not their children.
+ */
+void jobs_reset(void);
+
+/**
+ * Adds a background job to the job table.
+ *
+ * @param pid the process running the job
+ * @param list the commands run by the job
+ * @return the job number
+ */
+int jobs_add(pid_t pid, const struct command *list);
+
+/**
+ * Watches a child that runs while the shell goes on, so that jobs_reap_child and jobs_wait_child see it
+ * finish. The jobs are watched by jobs_add.
+ *
+ * @param pid the child
+ */
+void jobs_watch(pid_t pid);
+
+/**
+ * Collects the status of the background jobs that have finished, without blocking.
+ */
+void jobs_reap(void);
+
+/**
+ * Collects the finished children of the shell, without blocking, until one of them is not a job.
+ * The jobs are recorded in the job table, the first other child is returned to the caller.
+ *
+ * @param status where the wait status of the returned child is stored
+ * @param usage where the resources used by the returned child are stored
+ * @return the finished child that is not a job, or 0 if there is none
+ */
+pid_t jobs_reap_child(int *status, struct rusage *usage);
+
+/**
+ * Reports and forgets the finished jobs, if the shell is interactive.
+ */
+void jobs_notify(void);
+
+/**
+ * Prints the job table, then forgets the finished jobs.
+ */
+void jobs_print(void);
+
+/**
+ * Blocks until a job has finished and forgets it.
+ *
+ * @param id the job number, or 0 to wait for every job
+ * @return the wait status of the job, 0 when waiting for every job, -1 if the job does not exist
+ */
+int jobs_wait(int id);
+
+/**
+ * Blocks until a watched child has finished, the caller collects it with jobs_reap_child. Without pidfd
+ * support, a SIGCHLD received since the self-pipe was last drained returns immediately, so no child
+ * is missed.
+ */
+void jobs_wait_child(void);
+
+/**
+ * Finds the job number of a process.
+ *
+ * @param pid the process
+ * @return the job number or -1 if the process is not a job
+ */
+int jobs_find_pid(pid_t pid);
+
+/**
+ * Releases the memory used by the job table and stops watching the children.
+ */
+void jobs_free(void);
+
+#endif
@@ -0,0 +1,172 @@
+#define _GNU_SOURCE // vasprintf
+
+#include "output.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "trace.h"
+
+struct output_buffer {
+    int fd;
+    int terminal; // 1 if the file descriptor is a terminal, 0 if not, -1 if it is not known yet
+    size_t length;
+    char data[OUTPUT_BUFFER_SIZE];
+};
+
+static struct output_buffer buffers[2] = {
+        {STDOUT_FILENO, -1, 0, {0}},
+        {STDERR_FILENO, -1, 0, {0}},
+};
+
+static pid_t shell_pid;
+static size_t write_count = 0; // Writes requested by the shell
+static size_t syscall_count = 0; // write and writev system calls made for them
+
+/**
+ * Writes every byte of the vectors, the vectors are modified.
+ * @return 0 on success, -1 if the data could not be written, it is then dropped
+ */
+static int write_vectors(int fd, struct iovec *vectors, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, vectors, count);
+        syscall_count++;
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        while (count > 0 && (size_t) written >= vectors->iov_len) {
+            written -= (ssize_t) vectors->iov_len;
+            vectors++;
+            count--;
+        }
+        if (count > 0) {
+            vectors->iov_base = (char *) vectors->iov_base + written;
+            vectors->iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Writes the content of a buffer, followed by extra data if there is some, in a single writev.
+ * @return 0 on success, -1 if the data could not be written
+ */
+static int buffer_flush(struct output_buffer *buffer, const void *extra, size_t extra_length) {
+    struct iovec vectors[2] = {{buffer->data, buffer->length}, {(void *) extra, extra_length}};
+    int first = buffer->length ? 0 : 1;
+    int count = extra_length ? 2 : 1;
+
+    int result = first < count ? write_vectors(buffer->fd, vectors + first, count - first) : 0;
+    buffer->length = 0;
+    return result;
+}
+
+static struct output_buffer *buffer_find(int fd) {
+    if (fd == STDOUT_FILENO) return &buffers[0];
+    if (fd == STDERR_FILENO) return &buffers[1];
+    return NULL;
+}
+
+/**
+ * Flushes a buffer that was just written to if its file descriptor is a terminal, where the output is
+ * expected right away.
+ */
+static int buffer_check_terminal(struct output_buffer *buffer) {
+    if (buffer->terminal == -1) buffer->terminal = isatty(buffer->fd);
+    return buffer->terminal ? buffer_flush(buffer, NULL, 0) : 0;
+}
+
+int output_write(int fd, const void *data, size_t length) {
+    write_count++;
+
+    struct output_buffer *buffer = buffer_find(fd);
+    if (buffer == NULL) {
+        struct iovec vector = {(void *) data, length};
+        return write_vectors(fd, &vector, 1);
+    }
+
+    // The stdio buffer of the same stream holds older output
+    fflush(fd == STDOUT_FILENO ? stdout : stderr);
+
+    if (buffer->length + length > OUTPUT_BUFFER_SIZE) return buffer_flush(buffer, data, length);
+
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+    return buffer_check_terminal(buffer);
+}
+
+int output_printf(int fd, const char *format, ...) {
+    struct output_buffer *buffer = buffer_find(fd);
+    va_list args;
+
+    // Format in place when the string fits in the buffer
+    if (buffer != NULL) {
+        fflush(fd == STDOUT_FILENO ? stdout : stderr);
+
+        va_start(args, format);
+        size_t available = OUTPUT_BUFFER_SIZE - buffer->length;
+        int length = vsnprintf(buffer->data + buffer->length, available, format, args);
+        va_end(args);
+
+        if (length >= 0 && (size_t) length < available) {
+            write_count++;
+            buffer->length += length;
+            return buffer_check_terminal(buffer);
+        }
+    }
+
+    char *string;
+    va_start(args, format);
+    int length = vasprintf(&string, format, args);
+    va_end(args);
+    if (length < 0) return -1;
+
+    int result = output_write(fd, string, length);
+    free(string);
+    return result;
+}
+
+int output_flush(void) {
+    fflush(stdout);
+    fflush(stderr);
+
+    // Every buffer is written even if one fails, errno is the one of the first failure
+    int result = 0;
+    int error = 0;
+    for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++) {
+        if (buffer_flush(&buffers[i], NULL, 0) == -1 && result == 0) {
+            result = -1;
+            error = errno;
+        }
+    }
+    if (result == -1) errno = error;
+    return result;
+}
+
+void output_reset(void) {
+    output_flush();
+    for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++) buffers[i].terminal = -1;
+}
+
+/**
+ * Flushes the buffers when the process exits, the shell also reports its counts if it is traced.
+ */
+static void output_finish(void) {
+    output_flush();
+
+    if (getpid() == shell_pid && trace_enabled()) {
+        fprintf(stderr, "\noutput: %zu writes in %zu system calls\n", write_count, syscall_count);
+    }
+}
+
+void output_init(void) {
+    shell_pid = getpid();
+    atexit(output_finish);
+}
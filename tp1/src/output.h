@@ -0,0 +1,54 @@
+#ifndef TP1_OUTPUT_H
+#define TP1_OUTPUT_H
+
+#include <stddef.h>
+
+// Size of the buffer of each standard output, a write that does not fit is sent with the buffer by writev
+#define OUTPUT_BUFFER_SIZE 65536
+
+/**
+ * Flushes the output buffers when the process exits, and reports how many writes they saved on stderr
+ * when the shell exits if tracing is enabled.
+ */
+void output_init(void);
+
+/**
+ * Writes data to the standard output or the standard error of the shell through its buffer, other
+ * file descriptors are written to directly.
+ *
+ * The buffers are flushed when they are full, before the shell forks or changes its standard file
+ * descriptors, before it blocks waiting for a child or for the next line, and after each write if the
+ * file descriptor is a terminal. The data that could not be written is dropped.
+ *
+ * @param fd the file descriptor
+ * @param data the data to write
+ * @param length the length of the data
+ * @return 0 on success, -1 if a write failed, errno is set. Buffered data may still fail when it is
+ * flushed, see output_flush
+ */
+int output_write(int fd, const void *data, size_t length);
+
+/**
+ * Formats and writes a string through the buffer of a file descriptor, see output_write.
+ *
+ * @param fd the file descriptor
+ * @param format the format, as for printf
+ * @return 0 on success, -1 on error
+ */
+int output_printf(int fd, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * Writes the content of the buffers, and of the stdio buffers of stdout and stderr, to their file
+ * descriptors.
+ *
+ * @return 0 on success, -1 if the content of a buffer could not be written, errno is set
+ */
+int output_flush(void);
+
+/**
+ * Flushes the buffers and checks again whether the standard output and error are terminals at their next
+ * write. To call each time the shell changes its standard file descriptors.
+ */
+void output_reset(void);
+
+#endif
@@ -0,0 +1,195 @@
+#define _GNU_SOURCE // memfd_create
+
+#include "parallel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "jobs.h"
+#include "output.h"
+#include "shell.h"
+#include "stats.h"
+
+enum parallel_state {
+    PARALLEL_PENDING = 0,
+    PARALLEL_RUNNING,
+    PARALLEL_DONE,
+};
+
+struct parallel_job {
+    struct command *list; // And-or list run by the job
+    pid_t pid; // Subshell running the list
+    int output_fd; // Buffer receiving the standard output of the list
+    int error_fd; // Buffer receiving the standard error of the list
+    int status; // Wait status of the subshell
+    enum parallel_state state;
+};
+
+/**
+ * Parses the "-j N" option.
+ * @return the maximum number of lists running at once, or -1 if the arguments are not valid
+ */
+static long parse_max_jobs(char **args) {
+    long max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_jobs < 1) max_jobs = 1;
+
+    for (int i = 1; args[i]; i++) {
+        const char *value;
+        if (strcmp(args[i], "-j") == 0) value = args[++i];
+        else if (strncmp(args[i], "-j", 2) == 0) value = args[i] + 2;
+        else return -1;
+
+        if (value == NULL) return -1;
+
+        char *end;
+        max_jobs = strtol(value, &end, 10);
+        if (*end != '\0' || max_jobs < 1) return -1;
+    }
+
+    return max_jobs;
+}
+
+/**
+ * Writes the whole content of a buffer to a file descriptor.
+ */
+static void buffer_flush(int fd, int target_fd) {
+    char chunk[16384];
+    ssize_t length;
+
+    lseek(fd, 0, SEEK_SET);
+    while ((length = read(fd, chunk, sizeof(chunk))) > 0) {
+        for (ssize_t written = 0, n; written < length; written += n) {
+            n = write(target_fd, chunk + written, length - written);
+            if (n <= 0) return;
+        }
+    }
+}
+
+/**
+ * Starts the subshell of a job, with its outputs redirected to in-memory buffers.
+ * @return 0 on success, -1 on error
+ */
+static int job_start(struct parallel_job *job) {
+    job->output_fd = memfd_create("parallel-output", MFD_CLOEXEC);
+    job->error_fd = memfd_create("parallel-error", MFD_CLOEXEC);
+    if (job->output_fd == -1 || job->error_fd == -1) {
+        perror("memfd_create");
+        return -1;
+    }
+
+    job->pid = fork_list(job->list, job->output_fd, job->error_fd);
+    if (job->pid < 0) {
+        fprintf(stderr, "Fork failed\n");
+        return -1;
+    }
+
+    jobs_watch(job->pid);
+    job->state = PARALLEL_RUNNING;
+    return 0;
+}
+
+/**
+ * Collects the status of the running jobs that have finished, without blocking. The background jobs
+ * of the shell that finish meanwhile are recorded in the job table.
+ * @return the number of jobs that have finished
+ */
+static int jobs_collect(struct parallel_job *jobs, size_t count) {
+    int finished = 0;
+    int status;
+    struct rusage usage;
+    pid_t pid;
+
+    while ((pid = jobs_reap_child(&status, &usage)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            if (jobs[i].state != PARALLEL_RUNNING || jobs[i].pid != pid) continue;
+
+            stats_record("parallel", &usage, 0);
+            jobs[i].status = status;
+            jobs[i].state = PARALLEL_DONE;
+            finished++;
+            break;
+        }
+    }
+
+    return finished;
+}
+
+int builtin_parallel(char **args, struct command *block) {
+    long max_jobs = parse_max_jobs(args);
+    if (max_jobs == -1 || block == NULL) {
+        fprintf(stderr, "Usage: parallel [-j N] { command; ... }\n");
+        return EXECUTION_FAILED;
+    }
+
+    // Split the block into and-or lists, the sequence leans to the right
+    size_t count = 0;
+    for (struct command *cmd = block; cmd; cmd = cmd->type == CMD_SEQUENCE ? cmd->right : NULL) count++;
+
+    struct parallel_job *jobs = calloc(count, sizeof(struct parallel_job));
+    if (jobs == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return EXECUTION_FAILED;
+    }
+
+    size_t index = 0;
+    for (struct command *cmd = block; cmd; cmd = cmd->type == CMD_SEQUENCE ? cmd->right : NULL, index++) {
+        jobs[index].list = cmd->type == CMD_SEQUENCE ? cmd->left : cmd;
+        jobs[index].output_fd = -1;
+        jobs[index].error_fd = -1;
+    }
+
+    // The buffered outputs are written directly to the file descriptors
+    output_flush();
+
+    int result = EXECUTION_SUCCESS;
+    size_t started = 0;
+    size_t flushed = 0;
+    long running = 0;
+
+    while (flushed < count) {
+        // Keep at most max_jobs lists running
+        while (started < count && running < max_jobs) {
+            if (job_start(&jobs[started]) == -1) {
+                jobs[started].state = PARALLEL_DONE;
+                jobs[started].status = -1;
+            } else {
+                running++;
+            }
+            started++;
+        }
+
+        // Write the outputs in the order of the lists, as soon as every previous list is done
+        while (flushed < count && jobs[flushed].state == PARALLEL_DONE) {
+            struct parallel_job *job = &jobs[flushed++];
+
+            if (job->output_fd != -1) {
+                buffer_flush(job->output_fd, STDOUT_FILENO);
+                close(job->output_fd);
+            }
+            if (job->error_fd != -1) {
+                buffer_flush(job->error_fd, STDERR_FILENO);
+                close(job->error_fd);
+            }
+
+            if (!(WIFEXITED(job->status) && WEXITSTATUS(job->status) == 0)) result = EXECUTION_FAILED;
+        }
+
+        if (flushed == count) break;
+
+        // Sleep until a list finishes
+        int finished = jobs_collect(jobs, started);
+        if (finished == 0) {
+            jobs_wait_child();
+            finished = jobs_collect(jobs, started);
+        }
+        running -= finished;
+    }
+
+    free(jobs);
+    return result;
+}
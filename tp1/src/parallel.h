@@ -0,0 +1,19 @@
+#ifndef TP1_PARALLEL_H
+#define TP1_PARALLEL_H
+
+#include "parser.h"
+
+/**
+ * parallel [-j N] { list }: runs the and-or lists of the block concurrently, with at most N of them
+ * running at once (by default, one per online CPU).
+ *
+ * Each list runs in its own subshell and its output is buffered, then written in the order of the
+ * lists once it has finished, so that the outputs of the lists never interleave.
+ *
+ * @param args the arguments of the command, the last element is NULL
+ * @param block the and-or lists to run
+ * @return execution_success if every list succeeded, execution_failed otherwise
+ */
+int builtin_parallel(char **args, struct command *block);
+
+#endif
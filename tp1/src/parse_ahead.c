@@ -0,0 +1,216 @@
+#include "parse_ahead.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "output.h"
+#include "tokenizer.h"
+#include "trace.h"
+
+struct queued_line {
+    struct parsed_line *line; // NULL marks the end of the input
+    char *text; // NULL if the text is not kept
+    size_t length;
+};
+
+struct line_queue {
+    struct queued_line lines[PARSE_AHEAD_CAPACITY];
+    size_t head; // Next slot read, only used by the shell
+    size_t tail; // Next slot written, only used by the parser thread
+    sem_t ready; // Number of lines in the queue, the semaphores also order the accesses to the slots
+    sem_t free_slots; // Number of free slots
+};
+
+static struct line_queue queue;
+static pthread_t parser_thread;
+static int started = 0;
+static int keep_line_text = 0;
+static int ended = 0; // The shell took the end of the input
+static int stop_fd = -1; // Eventfd written when the shell stops the thread, it interrupts a read of the input
+static atomic_int stopping = 0; // The shell does not take lines anymore
+
+static void semaphore_wait(sem_t *semaphore) {
+    while (sem_wait(semaphore) == -1 && errno == EINTR);
+}
+
+/**
+ * Waits on a semaphore for at most a delay.
+ * @return 0 on success, -1 if the delay expired
+ */
+static int semaphore_timed_wait(sem_t *semaphore, long delay_ns) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += delay_ns;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    int result;
+    while ((result = sem_timedwait(semaphore, &deadline)) == -1 && errno == EINTR);
+    return result;
+}
+
+/**
+ * Hands a line over to the shell, waits while the queue is full.
+ * @return 0 on success, -1 if the shell stopped taking lines
+ */
+static int queue_push(struct queued_line entry) {
+    semaphore_wait(&queue.free_slots);
+    if (atomic_load(&stopping)) return -1;
+
+    queue.lines[queue.tail++ % PARSE_AHEAD_CAPACITY] = entry;
+    sem_post(&queue.ready);
+    return 0;
+}
+
+static void *parser_main(void *arg) {
+    (void) arg;
+
+    for (;;) {
+        if (atomic_load(&stopping)) break;
+
+        // A read interrupted by parse_ahead_stop returns no tokens, the loop then stops
+        uint64_t tokenize_start = trace_now();
+        struct token *tokens = tok_next_line();
+        trace_span("tokenize", tokenize_start, NULL);
+
+        if (!tokens) {
+            if (tok_eof()) break;
+            continue;
+        }
+
+        uint64_t parse_start = trace_now();
+        struct parsed_line *line = parse_cache_acquire(tokens);
+        trace_span("parse", parse_start, NULL);
+        if (!line) continue;
+
+        // Empty lines are not handed over, lines with an error are so that the shell reports it in order
+        if (!line->commands && !line->error) {
+            parse_cache_release(line);
+            continue;
+        }
+
+        struct queued_line entry = {line, NULL, 0};
+        if (keep_line_text) {
+            // The text is in the buffer of the tokenizer of this thread, which the next line overwrites
+            const char *text = tok_line_text(&entry.length);
+            entry.text = strndup(text, entry.length);
+        }
+
+        if (queue_push(entry) == -1) {
+            parse_cache_release(line);
+            free(entry.text);
+            break;
+        }
+    }
+
+    tok_release();
+    queue_push((struct queued_line) {NULL, NULL, 0});
+    return NULL;
+}
+
+int parse_ahead_start(int keep_text) {
+    if (sem_init(&queue.ready, 0, 0) == -1 || sem_init(&queue.free_slots, 0, PARSE_AHEAD_CAPACITY) == -1) {
+        perror("sem_init");
+        return -1;
+    }
+    queue.head = 0;
+    queue.tail = 0;
+    keep_line_text = keep_text;
+
+    stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (stop_fd == -1) {
+        perror("eventfd");
+        sem_destroy(&queue.ready);
+        sem_destroy(&queue.free_slots);
+        return -1;
+    }
+    tok_set_interrupt_fd(stop_fd);
+
+    // The signals of the children are handled by the shell, the thread inherits a mask without SIGCHLD
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+    int error = pthread_create(&parser_thread, NULL, parser_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (error != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(error));
+        tok_set_interrupt_fd(-1);
+        close(stop_fd);
+        sem_destroy(&queue.ready);
+        sem_destroy(&queue.free_slots);
+        return -1;
+    }
+
+    started = 1;
+    return 0;
+}
+
+struct parsed_line *parse_ahead_next(char **text, size_t *length) {
+    *text = NULL;
+    *length = 0;
+    if (ended) return NULL;
+
+    // The output of the previous lines is shown when the next one is not ready soon, e.g. while the parser
+    // thread waits for the input, a parser that keeps up does not break the batches
+    if (semaphore_timed_wait(&queue.ready, PARSE_AHEAD_FLUSH_DELAY_NS) == -1) {
+        output_flush();
+        semaphore_wait(&queue.ready);
+    }
+    struct queued_line entry = queue.lines[queue.head++ % PARSE_AHEAD_CAPACITY];
+    sem_post(&queue.free_slots);
+
+    if (entry.line == NULL) ended = 1;
+    *text = entry.text;
+    *length = entry.length;
+    return entry.line;
+}
+
+/**
+ * Releases the lines left in the queue, and frees their slots for the pushes of a thread that stops.
+ */
+static void queue_drain(void) {
+    while (sem_trywait(&queue.ready) == 0) {
+        struct queued_line entry = queue.lines[queue.head++ % PARSE_AHEAD_CAPACITY];
+        sem_post(&queue.free_slots);
+        if (entry.line) parse_cache_release(entry.line);
+        free(entry.text);
+    }
+}
+
+void parse_ahead_stop(void) {
+    if (!started) return;
+
+    // Wake the thread up if it waits for a free slot or for the input, it then sees that it must stop
+    atomic_store(&stopping, 1);
+    sem_post(&queue.free_slots);
+    uint64_t stop = 1;
+    ssize_t written = write(stop_fd, &stop, sizeof(stop));
+    (void) written;
+
+    // The thread releases its tokenizer before it returns, the lines it handed over are released here.
+    // A full queue is drained before the join, the thread may wait for a slot to push the end of the input
+    queue_drain();
+    pthread_join(parser_thread, NULL);
+    queue_drain();
+
+    tok_set_interrupt_fd(-1);
+    close(stop_fd);
+    stop_fd = -1;
+    sem_destroy(&queue.ready);
+    sem_destroy(&queue.free_slots);
+    started = 0;
+}
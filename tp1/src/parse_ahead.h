@@ -0,0 +1,36 @@
+#ifndef TP1_PARSE_AHEAD_H
+#define TP1_PARSE_AHEAD_H
+
+#include "parse_cache.h"
+
+// Maximum number of parsed lines waiting to run, the parser thread sleeps when the queue is full
+#define PARSE_AHEAD_CAPACITY 64
+
+// Time the shell waits for the next line before it flushes its buffered output, in nanoseconds
+#define PARSE_AHEAD_FLUSH_DELAY_NS 1000000
+
+/**
+ * Starts a thread that tokenizes and parses the lines of the standard input ahead of their execution.
+ * The lines are handed over in order through a bounded single-producer/single-consumer queue.
+ *
+ * @param keep_text whether the text of each line is handed over with it, e.g. for the history
+ * @return 0 on success, -1 if the thread could not be started
+ */
+int parse_ahead_start(int keep_text);
+
+/**
+ * Takes the next parsed line, and waits for it if the parser thread has not finished it yet.
+ *
+ * @param text set to the text of the line, to free, or to NULL if it was not kept
+ * @param length set to the length of the text
+ * @return the line, to release with parse_cache_release, or NULL at the end of the input
+ */
+struct parsed_line *parse_ahead_next(char **text, size_t *length);
+
+/**
+ * Stops the parser thread and releases the lines that did not run. A thread that waits for the standard
+ * input is interrupted, the thread is always joined.
+ */
+void parse_ahead_stop(void);
+
+#endif
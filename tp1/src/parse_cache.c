@@ -0,0 +1,157 @@
+#include "parse_cache.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The parse-ahead thread acquires lines while the shell releases the ones it ran
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t fork_handlers_once = PTHREAD_ONCE_INIT;
+
+static struct parsed_line *buckets[PARSE_CACHE_BUCKETS];
+static struct parsed_line *newest = NULL; // Most recently used line
+static struct parsed_line *oldest = NULL; // Least recently used line
+static size_t line_count = 0;
+
+/**
+ * Hashes the categories and values of a list of tokens with FNV-1a.
+ */
+static uint64_t tokens_hash(const struct token *tokens) {
+    uint64_t hash = 0xcbf29ce484222325;
+
+    for (const struct token *token = tokens; token; token = token->next) {
+        hash = (hash ^ (uint64_t) token->category) * 0x100000001b3;
+        hash = (hash ^ (unsigned char) token->quote) * 0x100000001b3;
+        if (token->value == NULL) continue;
+        for (const char *c = token->value; *c; c++) hash = (hash ^ (unsigned char) *c) * 0x100000001b3;
+        hash = (hash ^ 0xff) * 0x100000001b3; // End of the value, "ab" "c" and "a" "bc" differ
+    }
+
+    return hash;
+}
+
+/**
+ * Determines whether two lists of tokens are the same.
+ */
+static int tokens_equal(const struct token *a, const struct token *b) {
+    for (; a && b; a = a->next, b = b->next) {
+        if (a->category != b->category || a->quote != b->quote) return 0;
+        if ((a->value == NULL) != (b->value == NULL)) return 0;
+        if (a->value && strcmp(a->value, b->value) != 0) return 0;
+    }
+    return a == NULL && b == NULL;
+}
+
+static void lru_unlink(struct parsed_line *line) {
+    if (line->newer) line->newer->older = line->older;
+    else newest = line->older;
+    if (line->older) line->older->newer = line->newer;
+    else oldest = line->newer;
+    line->newer = NULL;
+    line->older = NULL;
+}
+
+static void lru_push(struct parsed_line *line) {
+    line->older = newest;
+    if (newest) newest->newer = line;
+    newest = line;
+    if (oldest == NULL) oldest = line;
+}
+
+/**
+ * Removes a line from the cache and deallocates it.
+ */
+static void line_evict(struct parsed_line *line) {
+    struct parsed_line **link = &buckets[line->hash & (PARSE_CACHE_BUCKETS - 1)];
+    while (*link != line) link = &(*link)->bucket_next;
+    *link = line->bucket_next;
+
+    lru_unlink(line);
+    line_count--;
+
+    cmd_free(line->commands);
+    tok_free(line->tokens);
+    free(line);
+}
+
+static void cache_lock_for_fork(void) {
+    pthread_mutex_lock(&cache_mutex);
+}
+
+static void cache_unlock_after_fork(void) {
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+static void register_fork_handlers(void) {
+    pthread_atfork(cache_lock_for_fork, cache_unlock_after_fork, cache_unlock_after_fork);
+}
+
+/**
+ * Locks the cache. A child forked while another thread holds the lock would never see it released, the
+ * lock is taken around each fork so that the children get it free.
+ */
+static void cache_lock(void) {
+    pthread_once(&fork_handlers_once, register_fork_handlers);
+    pthread_mutex_lock(&cache_mutex);
+}
+
+struct parsed_line *parse_cache_acquire(struct token *tokens) {
+    uint64_t hash = tokens_hash(tokens);
+    struct parsed_line **bucket = &buckets[hash & (PARSE_CACHE_BUCKETS - 1)];
+
+    cache_lock();
+    for (struct parsed_line *line = *bucket; line; line = line->bucket_next) {
+        if (line->hash != hash || !tokens_equal(line->tokens, tokens)) continue;
+
+        lru_unlink(line);
+        lru_push(line);
+        line->references++;
+        pthread_mutex_unlock(&cache_mutex);
+
+        tok_free(tokens);
+        return line;
+    }
+
+    struct parsed_line *line = calloc(1, sizeof(struct parsed_line));
+    if (line == NULL) {
+        pthread_mutex_unlock(&cache_mutex);
+        fprintf(stderr, "Memory allocation error\n");
+        tok_free(tokens);
+        return NULL;
+    }
+
+    line->tokens = tokens;
+    line->commands = cmd_parse(tokens, &line->error);
+    line->hash = hash;
+    line->references = 1;
+
+    // Make room for the line, the lines in use stay in the cache
+    for (struct parsed_line *old = oldest, *newer; old && line_count >= PARSE_CACHE_CAPACITY; old = newer) {
+        newer = old->newer;
+        if (old->references == 0) line_evict(old);
+    }
+
+    line->bucket_next = *bucket;
+    *bucket = line;
+    lru_push(line);
+    line_count++;
+    pthread_mutex_unlock(&cache_mutex);
+
+    return line;
+}
+
+void parse_cache_release(struct parsed_line *line) {
+    cache_lock();
+    line->references--;
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void parse_cache_clear(void) {
+    cache_lock();
+    for (struct parsed_line *line = oldest, *newer; line; line = newer) {
+        newer = line->newer;
+        if (line->references == 0) line_evict(line);
+    }
+    pthread_mutex_unlock(&cache_mutex);
+}
@@ -0,0 +1,47 @@
+#ifndef TP1_PARSE_CACHE_H
+#define TP1_PARSE_CACHE_H
+
+#include <stdint.h>
+
+#include "parser.h"
+#include "tokenizer.h"
+
+// Maximum number of lines kept in the cache, the least recently used unused line is evicted beyond it
+#define PARSE_CACHE_CAPACITY 256
+
+// Number of buckets of the hash table, a power of 2
+#define PARSE_CACHE_BUCKETS 512
+
+struct parsed_line {
+    struct token *tokens; // Tokens of the line, the arguments of the tree point to their values
+    struct command *commands; // Tree of the line, NULL if the line is empty or not valid
+    const char *error; // Parsing error of the line, NULL if there is none
+    uint64_t hash; // Hash of the tokens
+    int references; // Number of users of the line, it is not evicted while it is used
+    struct parsed_line *bucket_next; // Next line in the same bucket
+    struct parsed_line *newer; // Line used more recently
+    struct parsed_line *older; // Line used less recently
+};
+
+/**
+ * Returns the parsed form of a line of tokens. Lines already parsed are found by their tokens, so that
+ * lines that are repeated are only parsed once.
+ *
+ * @param tokens the tokens of the line, owned by the cache from now on
+ * @return the parsed line, to release with parse_cache_release, or NULL if the allocation failed
+ */
+struct parsed_line *parse_cache_acquire(struct token *tokens);
+
+/**
+ * Releases a line returned by parse_cache_acquire. Its tree must not be used anymore.
+ *
+ * @param line the parsed line
+ */
+void parse_cache_release(struct parsed_line *line);
+
+/**
+ * Releases the memory used by the lines of the cache that are not used anymore.
+ */
+void parse_cache_clear(void);
+
+#endif
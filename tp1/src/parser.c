@@ -1,207 +1,822 @@
-#include "parser.h"
-#include "tokenizer.h"
-
-#include <stdlib.h>
-#include <stdio.h>
-#include <memory.h>
-
-/**
- * Determines whether a token is an argument.
- * @param category the category of the token
- * @return true if the token parsed is an argument for a command. False otherwise.
- */
-int is_arg(enum token_category category) {
-    if (category == TOK_SYMBOL || category == TOK_STRING_LITERAL)
-        return 1;
-    else return 0;
-}
-
-/**
- * Determines whether a token is a separator that is invalid as the first token of a command.
- * @param category the category of the token
- * @return true if the token parsed is an argument for a command. False otherwise.
- */
-int is_invalid_first_sep(enum token_category category) {
-    if (category == TOK_PIPE || category == TOK_LOGICAL_AND || category == TOK_LOGICAL_OR)
-        return 1;
-    else return 0;
-}
-
-/**
- *
- * Counts the number of arguments in a command to determine how much memory to allocate.
- * @param tokens points to a token that is the first argument of a command
- * @return the number of arguments in a command
- */
-int count_arguments(struct token *tokens) {
-    struct token *current = tokens;
-
-    int counter = 0;
-    while (current != NULL && is_arg(current->category)) {
-        counter++;
-        current = current->next;
-    }
-
-    return counter;
-}
-
-/**
- * Finds the operator corresponding to the token category.
- * @return the op corresponding to the token category or -1 if error
- */
-enum op find_op(enum token_category category) {
-    switch (category) {
-        case TOK_SEMICOLON:
-            return OP_SEPARATOR;
-        case TOK_PIPE:
-            return OP_PIPE;
-        case TOK_LOGICAL_AND:
-            return OP_AND;
-        case TOK_LOGICAL_OR:
-            return OP_OR;
-        case TOK_NEWLINE:
-            return OP_TERMINATOR;
-        default: // Handles tok invalid, tok symbol, tok string literal
-            fprintf(stderr, "Invalid operator token category\n");
-            return EXIT_FAILURE;
-    }
-}
-
-/**
- * Parses a linked list of tokens into a linked list of commands.
- * @param tokens points to the first token in the linked list of tokens
- * @return A linked list of commands
- */
-struct command *cmd_parse(struct token *tokens) {
-    struct command sentinel = {NULL, NULL, OP_TERMINATOR}; // Head of linked list
-    struct command *current_command_in_list = &sentinel;
-
-    if (is_invalid_first_sep(tokens->category)) {
-        fprintf(stderr, "Parsing error: first token is not valid\n");
-        return NULL;
-    }
-
-    if (tokens->category == TOK_NEWLINE) {
-        return NULL;
-    }
-
-    while (tokens != NULL) {
-        if (tokens->category == TOK_INVALID) {
-            cmd_free(sentinel.next);
-            return NULL;
-        }
-
-        // Allocate new_command
-        struct command *new_command = malloc(sizeof(struct command));
-
-        // Check that memory allocation was successful
-        if (new_command == NULL) {
-            fprintf(stderr, "Memory allocation error\n");
-            return NULL;
-        }
-
-        // Initialize new_command
-        new_command->next = NULL;
-        new_command->args = NULL;
-        new_command->op = OP_TERMINATOR;
-
-        // Get number of tokens
-        int arguments_count = count_arguments(tokens);
-
-        // Check if there are no arguments
-        if (arguments_count == 0) {
-            if (is_invalid_first_sep(tokens->category)) {
-                fprintf(stderr, "Parsing error: no arguments\n");
-                cmd_free(sentinel.next);
-                return NULL;
-            } else {
-                free(new_command);
-                tokens = tokens->next;
-                continue;
-            }
-        }
-
-        // Allocate memory for command args
-        new_command->args = malloc(sizeof(new_command->args) * (arguments_count + 1));
-
-        // Check that memory allocation was successful
-        if (new_command->args == NULL) {
-            fprintf(stderr, "Memory allocation error\n");
-            cmd_free(sentinel.next);
-            return NULL;
-        }
-
-        // Store arguments
-        for (int i = 0; i < arguments_count; i++) {
-            new_command->args[i] = tokens->value;
-            tokens = tokens->next;
-        }
-        new_command->args[arguments_count] = NULL; // Last element of args array is NULL
-
-        // Get operator
-        new_command->op = find_op(tokens->category);
-        tokens = tokens->next;
-
-        // Add the new command to the linked list of commands
-        current_command_in_list->next = new_command;
-        current_command_in_list = new_command;
-    }
-
-    return sentinel.next;
-}
-
-
-/**
- * Iterates on the linked list of commands.
- * For each command, deallocates the memory for the arguments. Then, deallocates the memory for the command.
- * @param command the sentinel of the linked list of commands
- */
-void cmd_free(struct command *command) {
-    struct command *current = command;
-
-    while (current != NULL) {
-        // Deallocate memory of args array
-        // The args themselves are deallocated by the tokenizer
-        free(current->args);
-
-        // Deallocate command
-        struct command *temp = current; // Keep reference of old command to deallocate it
-        current = current->next;
-        free(temp);
-    }
-}
-
-void cmd_debug_print(const struct command *commands) {
-    for (const struct command *cmd = commands; cmd; cmd = cmd->next) {
-        for (int i = 0; cmd->args[i]; i++) {
-            printf("%s ", cmd->args[i]);
-        }
-
-        switch (cmd->op) {
-            case OP_TERMINATOR:
-                printf("OP_TERMINATOR");
-                break;
-            case OP_SEPARATOR:
-                printf("OP_SEPARATOR");
-                break;
-            case OP_AND:
-                printf("OP_AND");
-                break;
-            case OP_OR:
-                printf("OP_OR");
-                break;
-            case OP_PIPE:
-                printf("OP_PIPE");
-                break;
-            default:
-                printf("OP_INVALID");
-                break;
-        }
-
-        printf("\n");
-    }
-}
-
-
-
-
+#include "parser.h"
+#include "env.h"
+#include "tokenizer.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <memory.h>
+
+/**
+ * Determines whether a token is an argument.
+ * @param category the category of the token
+ * @return true if the token parsed is an argument for a command. False otherwise.
+ */
+int is_arg(enum token_category category) {
+    if (category == TOK_SYMBOL || category == TOK_STRING_LITERAL)
+        return 1;
+    else return 0;
+}
+
+/**
+ * Determines whether a token is a separator that is invalid as the first token of a command.
+ * @param category the category of the token
+ * @return true if the token parsed is an argument for a command. False otherwise.
+ */
+int is_invalid_first_sep(enum token_category category) {
+    if (category == TOK_PIPE || category == TOK_LOGICAL_AND || category == TOK_LOGICAL_OR ||
+        category == TOK_BACKGROUND || category == TOK_CLOSE_PAREN)
+        return 1;
+    else return 0;
+}
+
+/**
+ * Determines whether a token is a redirection, which is followed by the name of a file.
+ * @param category the category of the token
+ * @return true if the token is a redirection. False otherwise.
+ */
+int is_redirection(enum token_category category) {
+    return category == TOK_REDIRECT_INPUT || category == TOK_REDIRECT_OUTPUT || category == TOK_REDIRECT_APPEND ||
+           category == TOK_REDIRECT_ERROR;
+}
+
+/**
+ * Finds how an argument is expanded before the command runs. Strings in single quotes are never expanded,
+ * the expansions of symbols are split into several arguments and symbols may be patterns.
+ * @param token the token of the argument
+ * @return the word_flag of the argument, 0 if it is used as is
+ */
+int word_flags(const struct token *token) {
+    int flags = 0;
+    if (token->quote != '\'' && strchr(token->value, '$') != NULL) {
+        flags = token->quote == 0 ? WORD_EXPAND | WORD_SPLIT : WORD_EXPAND;
+    }
+    if (token->quote == 0 && strpbrk(token->value, "*?[") != NULL) flags |= WORD_GLOB;
+    return flags;
+}
+
+/**
+ * Determines whether a token opens a block, i.e., a "{" word.
+ * @param token the token
+ * @return true if the token opens a block. False otherwise.
+ */
+int is_block_start(const struct token *token) {
+    return token != NULL && token->category == TOK_SYMBOL && strcmp(token->value, "{") == 0;
+}
+
+/**
+ * Determines whether a token closes a block, i.e., a "}" word.
+ * @param token the token
+ * @return true if the token closes a block. False otherwise.
+ */
+int is_block_end(const struct token *token) {
+    return token != NULL && token->category == TOK_SYMBOL && strcmp(token->value, "}") == 0;
+}
+
+/**
+ * Determines whether a token is a reserved word, which is only recognized unquoted.
+ * @param token the token
+ * @param keyword the reserved word
+ * @return true if the token is the reserved word. False otherwise.
+ */
+int is_keyword(const struct token *token, const char *keyword) {
+    return token != NULL && token->category == TOK_SYMBOL && token->quote == 0 && strcmp(token->value, keyword) == 0;
+}
+
+/**
+ * Determines whether a word is a valid variable name.
+ * @param word the word
+ * @return true if the word is a name. False otherwise.
+ */
+int is_name(const char *word) {
+    if (!isalpha((unsigned char) word[0]) && word[0] != '_') return 0;
+    for (const char *c = word + 1; *c; c++) {
+        if (!isalnum((unsigned char) *c) && *c != '_') return 0;
+    }
+    return 1;
+}
+
+/**
+ * Determines whether a token is part of the words of a command, i.e., an argument or a redirection.
+ * @param token the token
+ * @param in_block whether the command is inside a block, where "}" ends the words
+ * @return true if the token is part of the words of a command. False otherwise.
+ */
+int is_command_word(const struct token *token, int in_block) {
+    if (token == NULL) return 0;
+    if (is_redirection(token->category)) return 1;
+    return is_arg(token->category) && !is_block_start(token) && !(in_block && is_block_end(token));
+}
+
+/**
+ *
+ * Counts the number of arguments in a command to determine how much memory to allocate.
+ * @param tokens points to a token that is the first argument of a command
+ * @param in_block whether the command is inside a block, where "}" ends the arguments
+ * @return the number of arguments in a command, the redirections and their files are not counted
+ */
+int count_arguments(struct token *tokens, int in_block) {
+    struct token *current = tokens;
+
+    int counter = 0;
+    while (is_command_word(current, in_block)) {
+        if (is_redirection(current->category)) {
+            current = current->next;
+            if (current == NULL || !is_arg(current->category)) break; // Reported by parse_simple
+        } else {
+            counter++;
+        }
+        current = current->next;
+    }
+
+    return counter;
+}
+
+/**
+ * Parses a redirection and the name of the file that follows it into a command.
+ * @param command the command the redirection applies to
+ * @param cursor points to the redirection token, it is moved after the name of the file
+ * @return 0 on success, -1 if the redirection is not followed by the name of a file
+ */
+int parse_redirection(struct command *command, struct token **cursor) {
+    struct token *redirection = *cursor;
+    struct token *file = redirection->next;
+
+    if (file == NULL || !is_arg(file->category)) return -1;
+
+    switch (redirection->category) {
+        case TOK_REDIRECT_INPUT:
+            command->input_file = file->value;
+            break;
+        case TOK_REDIRECT_OUTPUT: // Fallthrough
+        case TOK_REDIRECT_APPEND:
+            command->output_file = file->value;
+            command->output_append = redirection->category == TOK_REDIRECT_APPEND;
+            break;
+        default:
+            command->error_file = file->value;
+            break;
+    }
+
+    *cursor = file->next;
+    return 0;
+}
+
+struct parser {
+    struct token *token; // Next token to parse
+    const char *error; // Message of the first error, NULL if there is none
+};
+
+static struct command *parse_list(struct parser *parser, int in_block);
+
+/**
+ * Records a parsing error, only the first one is kept.
+ * @return NULL, so that the callers can return it directly
+ */
+static struct command *parse_fail(struct parser *parser, const char *message) {
+    if (parser->error == NULL) parser->error = message;
+    return NULL;
+}
+
+/**
+ * Determines whether the next token has the given category.
+ */
+static int at_category(const struct parser *parser, enum token_category category) {
+    return parser->token != NULL && parser->token->category == category;
+}
+
+/**
+ * Determines whether the next token ends the current list: the end of the line, a ")", the "do" or
+ * "done" of a loop or, inside a block, a "}".
+ */
+static int at_list_end(const struct parser *parser, int in_block) {
+    return parser->token == NULL || parser->token->category == TOK_CLOSE_PAREN ||
+           is_keyword(parser->token, "do") || is_keyword(parser->token, "done") ||
+           (in_block && is_block_end(parser->token));
+}
+
+/**
+ * Allocates a node of the tree. On error, the operands are deallocated.
+ * @return the node or NULL if the allocation failed
+ */
+static struct command *new_node(struct parser *parser, enum command_type type, struct command *left,
+                                struct command *right) {
+    struct command *node = calloc(1, sizeof(struct command));
+
+    // Check that memory allocation was successful
+    if (node == NULL) {
+        cmd_free(left);
+        cmd_free(right);
+        return parse_fail(parser, "Memory allocation error");
+    }
+
+    node->type = type;
+    node->left = left;
+    node->right = right;
+    return node;
+}
+
+/**
+ * Parses the redirections that follow a group, a subshell or a block.
+ * @return 0 on success, -1 on error
+ */
+static int parse_redirections(struct parser *parser, struct command *node) {
+    while (parser->token != NULL && is_redirection(parser->token->category)) {
+        if (parse_redirection(node, &parser->token) == -1) {
+            parse_fail(parser, "Parsing error: missing file after redirection");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Parses the list of a block or a group, up to the "}" that closes it. The "{" has been parsed.
+ * @return the list or NULL on error
+ */
+static struct command *parse_block(struct parser *parser) {
+    struct command *list = parse_list(parser, 1);
+    if (parser->error) return NULL;
+
+    if (!is_block_end(parser->token)) {
+        cmd_free(list);
+        return parse_fail(parser, "Parsing error: missing }");
+    }
+    parser->token = parser->token->next;
+
+    if (list == NULL) return parse_fail(parser, "Parsing error: empty block");
+    return list;
+}
+
+/**
+ * Parses the list of a subshell, up to the ")" that closes it. The "(" has been parsed.
+ * @return the list or NULL on error
+ */
+static struct command *parse_subshell(struct parser *parser) {
+    struct command *list = parse_list(parser, 0);
+    if (parser->error) return NULL;
+
+    if (!at_category(parser, TOK_CLOSE_PAREN)) {
+        cmd_free(list);
+        return parse_fail(parser, "Parsing error: missing )");
+    }
+    parser->token = parser->token->next;
+
+    if (list == NULL) return parse_fail(parser, "Parsing error: empty subshell");
+    return list;
+}
+
+/**
+ * Parses a simple command: its arguments and redirections, then the block that may follow them.
+ * @return the command or NULL on error
+ */
+static struct command *parse_simple(struct parser *parser, int in_block) {
+    // Get number of tokens
+    int arguments_count = count_arguments(parser->token, in_block);
+    if (arguments_count == 0) return parse_fail(parser, "Parsing error: no arguments");
+
+    struct command *node = new_node(parser, CMD_SIMPLE, NULL, NULL);
+    if (node == NULL) return NULL;
+
+    // Allocate memory for command args
+    node->args = malloc(sizeof(node->args) * (arguments_count + 1));
+    if (node->args == NULL) {
+        cmd_free(node);
+        return parse_fail(parser, "Memory allocation error");
+    }
+
+    // Store arguments and redirections
+    int assignments = 0; // Number of "VAR=x" words that start the command
+    int exporting = 0; // The command is export, whose arguments are assignments too
+    for (int i = 0; is_command_word(parser->token, in_block);) {
+        if (is_redirection(parser->token->category)) {
+            if (parse_redirection(node, &parser->token) == -1) {
+                cmd_free(node);
+                return parse_fail(parser, "Parsing error: missing file after redirection");
+            }
+        } else {
+            // The value of an assignment is neither split nor used as a pattern
+            int flags = word_flags(parser->token);
+            if ((i == assignments || exporting) && env_assignment_name(parser->token->value) > 0) {
+                flags &= WORD_EXPAND;
+                if (i == assignments) assignments++;
+            } else if (i == assignments) {
+                exporting = strcmp(parser->token->value, "export") == 0;
+            }
+
+            if (flags && node->word_flags == NULL) {
+                node->word_flags = calloc(arguments_count, sizeof(unsigned char));
+                if (node->word_flags == NULL) {
+                    cmd_free(node);
+                    return parse_fail(parser, "Memory allocation error");
+                }
+            }
+            if (flags) node->word_flags[i] = (unsigned char) flags;
+
+            node->args[i++] = parser->token->value;
+            parser->token = parser->token->next;
+        }
+    }
+    node->args[arguments_count] = NULL; // Last element of args array is NULL
+
+    // Parse the block that follows the arguments, then its redirections
+    if (is_block_start(parser->token)) {
+        parser->token = parser->token->next;
+        node->block = parse_block(parser);
+
+        if (node->block == NULL || parse_redirections(parser, node) == -1) {
+            cmd_free(node);
+            return NULL;
+        }
+    }
+
+    return node;
+}
+
+/**
+ * Determines whether the next tokens start a function definition, i.e., a word followed by "()".
+ */
+static int at_function_definition(const struct parser *parser) {
+    const struct token *name = parser->token;
+    return name != NULL && name->category == TOK_SYMBOL && name->next != NULL &&
+           name->next->category == TOK_OPEN_PAREN && name->next->next != NULL &&
+           name->next->next->category == TOK_CLOSE_PAREN;
+}
+
+/**
+ * Parses a function definition "name() { ... }". The body is a block, it is parsed once and run by each
+ * call of the function.
+ * @return the definition or NULL on error
+ */
+static struct command *parse_function(struct parser *parser) {
+    char *name = parser->token->value;
+    parser->token = parser->token->next->next->next;
+
+    if (!is_block_start(parser->token)) return parse_fail(parser, "Parsing error: missing { after ()");
+    parser->token = parser->token->next;
+
+    struct command *body = parse_block(parser);
+    if (body == NULL) return NULL;
+
+    struct command *node = new_node(parser, CMD_FUNCTION, body, NULL);
+    if (node == NULL) return NULL;
+
+    node->args = malloc(2 * sizeof(char *));
+    if (node->args == NULL) {
+        cmd_free(node);
+        return parse_fail(parser, "Memory allocation error");
+    }
+    node->args[0] = name;
+    node->args[1] = NULL;
+    return node;
+}
+
+/**
+ * Parses the body of a loop, "do ... done".
+ * @return the list of the body or NULL on error
+ */
+static struct command *parse_loop_body(struct parser *parser) {
+    if (!is_keyword(parser->token, "do")) return parse_fail(parser, "Parsing error: missing do");
+    parser->token = parser->token->next;
+
+    struct command *list = parse_list(parser, 0);
+    if (parser->error) return NULL;
+
+    if (!is_keyword(parser->token, "done")) {
+        cmd_free(list);
+        return parse_fail(parser, "Parsing error: missing done");
+    }
+    parser->token = parser->token->next;
+
+    if (list == NULL) return parse_fail(parser, "Parsing error: empty loop");
+    return list;
+}
+
+/**
+ * Parses a loop "for name in words...; do ... done". The words are stored as the arguments that follow
+ * the name, with their word_flags, they are expanded once when the loop starts.
+ * @return the loop or NULL on error
+ */
+static struct command *parse_for(struct parser *parser) {
+    struct token *name = parser->token->next;
+    if (name == NULL || name->category != TOK_SYMBOL || !is_name(name->value)) {
+        return parse_fail(parser, "Parsing error: for needs a variable name");
+    }
+    if (!is_keyword(name->next, "in")) return parse_fail(parser, "Parsing error: missing in");
+    parser->token = name->next->next;
+
+    int words_count = 0;
+    for (struct token *word = parser->token; word != NULL && is_arg(word->category); word = word->next) {
+        words_count++;
+    }
+
+    struct command *node = new_node(parser, CMD_FOR, NULL, NULL);
+    if (node == NULL) return NULL;
+
+    node->args = malloc(sizeof(node->args) * (words_count + 2));
+    if (node->args == NULL) {
+        cmd_free(node);
+        return parse_fail(parser, "Memory allocation error");
+    }
+    node->args[0] = name->value;
+
+    for (int i = 1; i <= words_count; i++) {
+        int flags = word_flags(parser->token);
+        if (flags && node->word_flags == NULL) {
+            node->word_flags = calloc(words_count + 1, sizeof(unsigned char));
+            if (node->word_flags == NULL) {
+                cmd_free(node);
+                return parse_fail(parser, "Memory allocation error");
+            }
+        }
+        if (flags) node->word_flags[i] = (unsigned char) flags;
+
+        node->args[i] = parser->token->value;
+        parser->token = parser->token->next;
+    }
+    node->args[words_count + 1] = NULL;
+
+    // The words end with a separator, then the body follows
+    if (!at_category(parser, TOK_SEMICOLON) && !at_category(parser, TOK_NEWLINE)) {
+        cmd_free(node);
+        return parse_fail(parser, "Parsing error: missing ; before do");
+    }
+    while (at_category(parser, TOK_SEMICOLON) || at_category(parser, TOK_NEWLINE)) {
+        parser->token = parser->token->next;
+    }
+
+    node->left = parse_loop_body(parser);
+    if (node->left == NULL) {
+        cmd_free(node);
+        return NULL;
+    }
+    return node;
+}
+
+/**
+ * Parses a loop "while ...; do ... done", the body runs as long as the last command of the condition
+ * succeeds.
+ * @return the loop or NULL on error
+ */
+static struct command *parse_while(struct parser *parser) {
+    parser->token = parser->token->next;
+
+    struct command *condition = parse_list(parser, 0);
+    if (parser->error) return NULL;
+    if (condition == NULL) return parse_fail(parser, "Parsing error: missing condition");
+
+    struct command *body = parse_loop_body(parser);
+    if (body == NULL) {
+        cmd_free(condition);
+        return NULL;
+    }
+
+    return new_node(parser, CMD_WHILE, condition, body);
+}
+
+/**
+ * Parses a command: a group "{ ... }", a subshell "( ... )", a function definition, a loop or a simple
+ * command.
+ * @return the command or NULL on error
+ */
+static struct command *parse_command(struct parser *parser, int in_block) {
+    enum command_type type;
+    struct command *list;
+
+    if (at_function_definition(parser)) {
+        return parse_function(parser);
+    } else if (is_keyword(parser->token, "for") || is_keyword(parser->token, "while")) {
+        struct command *loop = is_keyword(parser->token, "for") ? parse_for(parser) : parse_while(parser);
+        if (loop != NULL && parse_redirections(parser, loop) == -1) {
+            cmd_free(loop);
+            return NULL;
+        }
+        return loop;
+    } else if (is_block_start(parser->token)) {
+        parser->token = parser->token->next;
+        type = CMD_GROUP;
+        list = parse_block(parser);
+    } else if (at_category(parser, TOK_OPEN_PAREN)) {
+        parser->token = parser->token->next;
+        type = CMD_SUBSHELL;
+        list = parse_subshell(parser);
+    } else if (is_command_word(parser->token, in_block)) {
+        return parse_simple(parser, in_block);
+    } else {
+        return parse_fail(parser, "Parsing error: no arguments");
+    }
+
+    if (list == NULL) return NULL;
+
+    struct command *node = new_node(parser, type, list, NULL);
+    if (node == NULL || parse_redirections(parser, node) == -1) {
+        cmd_free(node);
+        return NULL;
+    }
+
+    return node;
+}
+
+/**
+ * Parses a pipeline, "a | b | c" is stored as "a | (b | c)".
+ * @return the pipeline or NULL on error
+ */
+static struct command *parse_pipeline(struct parser *parser, int in_block) {
+    struct command *left = parse_command(parser, in_block);
+    if (left == NULL || !at_category(parser, TOK_PIPE)) return left;
+    parser->token = parser->token->next;
+
+    struct command *right = parse_pipeline(parser, in_block);
+    if (right == NULL) {
+        cmd_free(left);
+        return NULL;
+    }
+
+    return new_node(parser, CMD_PIPE, left, right);
+}
+
+/**
+ * Parses an and-or list. "&&" and "||" have the same precedence and group from the left, "a && b || c"
+ * is stored as "(a && b) || c".
+ * @return the and-or list or NULL on error
+ */
+static struct command *parse_and_or(struct parser *parser, int in_block) {
+    struct command *node = parse_pipeline(parser, in_block);
+
+    while (node != NULL && (at_category(parser, TOK_LOGICAL_AND) || at_category(parser, TOK_LOGICAL_OR))) {
+        enum command_type type = parser->token->category == TOK_LOGICAL_AND ? CMD_AND : CMD_OR;
+        parser->token = parser->token->next;
+
+        struct command *right = parse_pipeline(parser, in_block);
+        if (right == NULL) {
+            cmd_free(node);
+            return NULL;
+        }
+
+        node = new_node(parser, type, node, right);
+    }
+
+    return node;
+}
+
+/**
+ * Parses a list of and-or lists separated by ";", "&" or a newline, until the end of the tokens, a ")"
+ * or, inside a block, the "}" that closes the block. "a; b; c" is stored as "a; (b; c)".
+ * @return the list, NULL if it is empty or on error
+ */
+static struct command *parse_list(struct parser *parser, int in_block) {
+    struct command *list = NULL;
+    struct command **last = &list; // Where the last and-or list of the sequence is stored
+
+    for (;;) {
+        // Skip the separators of empty commands
+        while (at_category(parser, TOK_SEMICOLON) || at_category(parser, TOK_NEWLINE)) {
+            parser->token = parser->token->next;
+        }
+        if (at_list_end(parser, in_block)) return list;
+
+        struct command *item = parse_and_or(parser, in_block);
+
+        if (item != NULL) {
+            if (at_category(parser, TOK_BACKGROUND)) {
+                parser->token = parser->token->next;
+                item = new_node(parser, CMD_BACKGROUND, item, NULL);
+            } else if (at_category(parser, TOK_SEMICOLON) || at_category(parser, TOK_NEWLINE)) {
+                parser->token = parser->token->next;
+            } else if (!at_list_end(parser, in_block)) {
+                cmd_free(item);
+                item = parse_fail(parser, is_arg(parser->token->category)
+                                          ? "Parsing error: unexpected word after block"
+                                          : "Parsing error: unexpected token");
+            }
+        }
+
+        if (item == NULL) {
+            cmd_free(list);
+            return NULL;
+        }
+
+        // Add the and-or list to the sequence
+        if (*last == NULL) {
+            *last = item;
+        } else {
+            struct command *sequence = new_node(parser, CMD_SEQUENCE, *last, item);
+            if (sequence == NULL) {
+                *last = NULL; // Deallocated by new_node
+                cmd_free(list);
+                return NULL;
+            }
+            *last = sequence;
+            last = &sequence->right;
+        }
+    }
+}
+
+/**
+ * Parses a linked list of tokens into a tree of commands.
+ * @param tokens points to the first token in the linked list of tokens
+ * @param error receives the message of the first error, NULL if there is none
+ * @return A tree of commands
+ */
+struct command *cmd_parse(struct token *tokens, const char **error) {
+    *error = NULL;
+
+    if (tokens != NULL && is_invalid_first_sep(tokens->category)) {
+        *error = "Parsing error: first token is not valid";
+        return NULL;
+    }
+
+    struct parser parser = {tokens, NULL};
+    struct command *commands = parse_list(&parser, 0);
+
+    // Only a ")" without a matching "(", or a "do" or "done" outside of a loop, stops the list before the
+    // end of the tokens
+    if (parser.error == NULL && parser.token != NULL) {
+        cmd_free(commands);
+        commands = parse_fail(&parser, parser.token->category == TOK_CLOSE_PAREN
+                                       ? "Parsing error: unexpected )"
+                                       : "Parsing error: unexpected do or done");
+    }
+
+    *error = parser.error;
+    return commands;
+}
+
+
+/**
+ * Copies a string into the words of a copied node.
+ * @return the copy, or NULL if the string is NULL
+ */
+static char *copy_word(char **cursor, const char *word) {
+    if (word == NULL) return NULL;
+
+    char *copy = *cursor;
+    size_t length = strlen(word) + 1;
+    memcpy(copy, word, length);
+    *cursor += length;
+    return copy;
+}
+
+struct command *cmd_copy(const struct command *command) {
+    if (command == NULL) return NULL;
+
+    struct command *copy = calloc(1, sizeof(struct command));
+    if (copy == NULL) return NULL;
+    copy->type = command->type;
+    copy->output_append = command->output_append;
+
+    // The strings of the node are stored together
+    size_t count = 0;
+    size_t size = 0;
+    for (; command->args && command->args[count]; count++) size += strlen(command->args[count]) + 1;
+    if (command->input_file) size += strlen(command->input_file) + 1;
+    if (command->output_file) size += strlen(command->output_file) + 1;
+    if (command->error_file) size += strlen(command->error_file) + 1;
+
+    copy->words = malloc(size > 0 ? size : 1);
+    if (copy->words == NULL) {
+        cmd_free(copy);
+        return NULL;
+    }
+    char *cursor = copy->words;
+
+    if (command->args) {
+        copy->args = malloc((count + 1) * sizeof(char *));
+        if (copy->args == NULL) {
+            cmd_free(copy);
+            return NULL;
+        }
+        for (size_t i = 0; i < count; i++) copy->args[i] = copy_word(&cursor, command->args[i]);
+        copy->args[count] = NULL;
+    }
+
+    if (command->word_flags) {
+        copy->word_flags = malloc(count);
+        if (copy->word_flags == NULL) {
+            cmd_free(copy);
+            return NULL;
+        }
+        memcpy(copy->word_flags, command->word_flags, count);
+    }
+
+    copy->input_file = copy_word(&cursor, command->input_file);
+    copy->output_file = copy_word(&cursor, command->output_file);
+    copy->error_file = copy_word(&cursor, command->error_file);
+
+    copy->block = cmd_copy(command->block);
+    copy->left = cmd_copy(command->left);
+    copy->right = cmd_copy(command->right);
+    if ((command->block && !copy->block) || (command->left && !copy->left) || (command->right && !copy->right)) {
+        cmd_free(copy);
+        return NULL;
+    }
+
+    return copy;
+}
+
+/**
+ * Deallocates a tree of commands.
+ * For each node, deallocates the memory for the arguments and the children. Then, deallocates the node.
+ * @param command the root of the tree
+ */
+void cmd_free(struct command *command) {
+    if (command == NULL) return;
+
+    // Deallocate memory of args array
+    // The args themselves are deallocated by the tokenizer, or with the words of a copy
+    free(command->args);
+    free(command->words);
+    free(command->word_flags);
+    cmd_free(command->block);
+    cmd_free(command->left);
+    cmd_free(command->right);
+
+    // Deallocate command
+    free(command);
+}
+
+void cmd_write(FILE *file, const struct command *command) {
+    switch (command->type) {
+        case CMD_SIMPLE:
+            for (int i = 0; command->args[i]; i++) fprintf(file, i ? " %s" : "%s", command->args[i]);
+            if (command->block) {
+                fputs(" { ", file);
+                cmd_write(file, command->block);
+                fputs(" }", file);
+            }
+            break;
+        case CMD_PIPE:
+        case CMD_AND:
+        case CMD_OR:
+            cmd_write(file, command->left);
+            fputs(command->type == CMD_PIPE ? " | " : command->type == CMD_AND ? " && " : " || ", file);
+            cmd_write(file, command->right);
+            break;
+        case CMD_SEQUENCE:
+            cmd_write(file, command->left);
+            fputs(command->left->type == CMD_BACKGROUND ? " " : "; ", file);
+            cmd_write(file, command->right);
+            break;
+        case CMD_BACKGROUND:
+            cmd_write(file, command->left);
+            fputs(" &", file);
+            break;
+        case CMD_GROUP:
+            fputs("{ ", file);
+            cmd_write(file, command->left);
+            fputs(" }", file);
+            break;
+        case CMD_SUBSHELL:
+            fputs("(", file);
+            cmd_write(file, command->left);
+            fputs(")", file);
+            break;
+        case CMD_FUNCTION:
+            fprintf(file, "%s() { ", command->args[0]);
+            cmd_write(file, command->left);
+            fputs("; }", file);
+            break;
+        case CMD_FOR:
+            fprintf(file, "for %s in", command->args[0]);
+            for (int i = 1; command->args[i]; i++) fprintf(file, " %s", command->args[i]);
+            fputs("; do ", file);
+            cmd_write(file, command->left);
+            fputs("; done", file);
+            break;
+        case CMD_WHILE:
+            fputs("while ", file);
+            cmd_write(file, command->left);
+            fputs("; do ", file);
+            cmd_write(file, command->right);
+            fputs("; done", file);
+            break;
+    }
+
+    if (command->input_file) fprintf(file, " < %s", command->input_file);
+    if (command->output_file) fprintf(file, " %s %s", command->output_append ? ">>" : ">", command->output_file);
+    if (command->error_file) fprintf(file, " 2> %s", command->error_file);
+}
+
+/**
+ * Prints a node of the tree and its children, indented by their depth.
+ */
+static void debug_print_node(const struct command *node, int depth) {
+    static const char *types[] = {"CMD_SIMPLE", "CMD_PIPE", "CMD_AND", "CMD_OR",
+                                  "CMD_SEQUENCE", "CMD_BACKGROUND", "CMD_GROUP", "CMD_SUBSHELL",
+                                  "CMD_FUNCTION", "CMD_FOR", "CMD_WHILE"};
+
+    printf("%*s%s", depth * 2, "", types[node->type]);
+    if (node->type == CMD_SIMPLE) {
+        printf(" ");
+        cmd_write(stdout, node);
+    }
+    printf("\n");
+
+    if (node->block) debug_print_node(node->block, depth + 1);
+    if (node->left) debug_print_node(node->left, depth + 1);
+    if (node->right) debug_print_node(node->right, depth + 1);
+}
+
+void cmd_debug_print(const struct command *commands) {
+    if (commands) debug_print_node(commands, 0);
+}
@@ -1,45 +1,86 @@
-
-#ifndef TP1_PARSER_H
-#define TP1_PARSER_H
-
-#include "tokenizer.h"
-
-enum op {
-    OP_TERMINATOR = 0,
-    OP_SEPARATOR,
-    OP_AND,
-    OP_OR,
-    OP_PIPE,
-};
-
-struct command {
-    struct command *next; // Commande suivante
-    char **args; // Tableau de chaînes de caractères, le dernier élément est NULL
-    enum op op; // Opérateur
-};
-
-/**
- * Cette fonction prend une liste de tokens et retourne une liste de commandes.
- *
- * @param tokens list chainée de tokens
- * @return list chainée de commandes
- */
-struct command *cmd_parse(struct token *tokens);
-
-/**
- * Cette fonction libère la mémoire allouée pour une liste de commandes.
- *
- * @param command list chainée de commandes
- */
-void cmd_free(struct command *command);
-
-/**
- * Cette fonction affiche une liste de commandes.
- * Utilisé pour le débogage.
- *
- * @param commands list chainée de commandes
- */
-void cmd_debug_print(const struct command *commands);
-
-
-#endif
+
+#ifndef TP1_PARSER_H
+#define TP1_PARSER_H
+
+#include <stdio.h>
+
+#include "tokenizer.h"
+
+enum command_type {
+    CMD_SIMPLE = 0, // Commande simple: arguments, bloc et redirections
+    CMD_PIPE, // left | right
+    CMD_AND, // left && right
+    CMD_OR, // left || right
+    CMD_SEQUENCE, // left ; right
+    CMD_BACKGROUND, // left &
+    CMD_GROUP, // { left }
+    CMD_SUBSHELL, // ( left )
+    CMD_FUNCTION, // Définition d'une fonction "nom() { left }", args contient le nom
+    CMD_FOR, // for args[0] in args[1]...; do left; done
+    CMD_WHILE, // while left; do right; done
+};
+
+enum word_flag {
+    WORD_EXPAND = 1, // L'argument contient des "$VAR" ou "$(...)" à remplacer avant l'exécution
+    WORD_SPLIT = 2, // Le résultat du remplacement est découpé aux espaces, l'argument n'est pas entre guillemets
+    WORD_GLOB = 4, // L'argument contient "*", "?" ou "[" et est remplacé par les chemins qui correspondent
+};
+
+struct command {
+    enum command_type type; // Type du noeud de l'arbre
+    struct command *left; // Opérande de gauche, ou contenu d'un groupe ou d'un sous-shell
+    struct command *right; // Opérande de droite, NULL pour les noeuds qui n'en ont qu'un
+    char **args; // Tableau de chaînes de caractères, le dernier élément est NULL, NULL si ce n'est pas une commande simple
+    unsigned char *word_flags; // Pour chaque argument, ses word_flag, NULL si aucun argument n'est remplacé
+    struct command *block; // Commandes du bloc "{ ... }" qui suit les arguments, NULL s'il n'y en a pas
+    char *input_file; // Fichier lu par l'entrée standard "<", NULL s'il n'y en a pas
+    char *output_file; // Fichier écrit par la sortie standard ">" ou ">>", NULL s'il n'y en a pas
+    int output_append; // 1 si la sortie standard est ajoutée à la fin du fichier ">>", 0 sinon
+    char *error_file; // Fichier écrit par la sortie d'erreur "2>", NULL s'il n'y en a pas
+    char *words; // Chaînes du noeud, possédées par un arbre copié par cmd_copy, NULL sinon
+};
+
+/**
+ * Cette fonction prend une liste de tokens et retourne l'arbre syntaxique de la ligne.
+ * Les arguments de l'arbre pointent vers les valeurs des tokens, qui doivent rester valides.
+ *
+ * @param tokens list chainée de tokens
+ * @param error reçoit le message d'erreur si les tokens ne sont pas valides, NULL sinon
+ * @return l'arbre syntaxique ou NULL si la ligne est vide ou n'est pas valide
+ */
+struct command *cmd_parse(struct token *tokens, const char **error);
+
+/**
+ * Cette fonction copie un arbre de commandes. La copie possède ses chaînes de caractères et reste valide
+ * après la libération des tokens de l'arbre d'origine.
+ *
+ * @param command racine de l'arbre
+ * @return la copie, à libérer avec cmd_free, ou NULL si l'allocation a échoué
+ */
+struct command *cmd_copy(const struct command *command);
+
+/**
+ * Cette fonction libère la mémoire allouée pour un arbre de commandes.
+ *
+ * @param command racine de l'arbre
+ */
+void cmd_free(struct command *command);
+
+/**
+ * Cette fonction écrit un arbre de commandes sous la forme d'une ligne de commande.
+ *
+ * @param file fichier dans lequel écrire
+ * @param command racine de l'arbre
+ */
+void cmd_write(FILE *file, const struct command *command);
+
+/**
+ * Cette fonction affiche un arbre de commandes.
+ * Utilisé pour le débogage.
+ *
+ * @param commands racine de l'arbre
+ */
+void cmd_debug_print(const struct command *commands);
+
+
+#endif
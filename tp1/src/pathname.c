@@ -0,0 +1,368 @@
+#define _GNU_SOURCE // syscall
+
+#include "pathname.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+// Size of the buffer filled by each getdents64 call
+#define DIRENT_BUFFER_SIZE 65536
+
+// Below this number of strings, the radix sort switches to an insertion sort
+#define RADIX_SORT_CUTOFF 32
+
+// Entry written by getdents64, glibc does not declare it
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+struct directory_listing {
+    dev_t device;
+    ino_t inode;
+    struct timespec modified; // Modification time of the directory when it was read
+    char *names; // Names of the entries, each one ends with a null character
+    size_t names_length;
+    size_t *offsets; // Offset of the name of each entry in names
+    unsigned char *types; // d_type of each entry, DT_UNKNOWN if the file system does not report it
+    size_t count;
+    unsigned long last_use; // Value of use_clock when the listing was last used, 0 if the slot is empty
+};
+
+struct path_list {
+    char **paths; // The last element is NULL
+    size_t count;
+    size_t capacity;
+};
+
+static struct directory_listing cache[PATHNAME_CACHE_CAPACITY];
+static unsigned long use_clock = 0;
+
+int pathname_is_pattern(const char *word) {
+    return strpbrk(word, "*?[") != NULL;
+}
+
+static void listing_free(struct directory_listing *listing) {
+    free(listing->names);
+    free(listing->offsets);
+    free(listing->types);
+    memset(listing, 0, sizeof(struct directory_listing));
+}
+
+/**
+ * Adds an entry to a listing.
+ * @return 0 on success, -1 if the allocation failed
+ */
+static int listing_add(struct directory_listing *listing, size_t *capacity, size_t *names_capacity,
+                       const char *name, unsigned char type) {
+    size_t length = strlen(name) + 1;
+
+    if (listing->count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        size_t *offsets = realloc(listing->offsets, *capacity * sizeof(size_t));
+        if (offsets == NULL) return -1;
+        listing->offsets = offsets;
+
+        unsigned char *types = realloc(listing->types, *capacity);
+        if (types == NULL) return -1;
+        listing->types = types;
+    }
+
+    if (listing->names_length + length > *names_capacity) {
+        while (listing->names_length + length > *names_capacity) {
+            *names_capacity = *names_capacity ? *names_capacity * 2 : 1024;
+        }
+        char *names = realloc(listing->names, *names_capacity);
+        if (names == NULL) return -1;
+        listing->names = names;
+    }
+
+    memcpy(listing->names + listing->names_length, name, length);
+    listing->offsets[listing->count] = listing->names_length;
+    listing->types[listing->count] = type;
+    listing->names_length += length;
+    listing->count++;
+    return 0;
+}
+
+/**
+ * Reads the entries of an open directory with getdents64, without "." and "..".
+ * @return 0 on success, -1 on error
+ */
+static int listing_read(int fd, struct directory_listing *listing) {
+    char *buffer = malloc(DIRENT_BUFFER_SIZE);
+    if (buffer == NULL) return -1;
+
+    size_t capacity = 0;
+    size_t names_capacity = 0;
+    long length;
+
+    while ((length = syscall(SYS_getdents64, fd, buffer, DIRENT_BUFFER_SIZE)) > 0) {
+        for (long offset = 0; offset < length;) {
+            struct linux_dirent64 *entry = (struct linux_dirent64 *) (buffer + offset);
+            offset += entry->d_reclen;
+
+            const char *name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+            if (listing_add(listing, &capacity, &names_capacity, name, entry->d_type) == -1) {
+                free(buffer);
+                return -1;
+            }
+        }
+    }
+
+    free(buffer);
+    return length == 0 ? 0 : -1;
+}
+
+/**
+ * Returns the listing of a directory, which is only read if it is not cached or if it changed since.
+ * The listing stays valid until the next call.
+ * @return the listing or NULL if the directory could not be read
+ */
+static struct directory_listing *listing_get(const char *path) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return NULL;
+    }
+
+    // Find the directory, or the least recently used slot to replace
+    struct directory_listing *listing = &cache[0];
+    for (size_t i = 0; i < PATHNAME_CACHE_CAPACITY; i++) {
+        struct directory_listing *slot = &cache[i];
+        if (slot->last_use != 0 && slot->device == st.st_dev && slot->inode == st.st_ino) {
+            listing = slot;
+            break;
+        }
+        if (slot->last_use < listing->last_use) listing = slot;
+    }
+
+    int unchanged = listing->last_use != 0 && listing->device == st.st_dev && listing->inode == st.st_ino &&
+                    listing->modified.tv_sec == st.st_mtim.tv_sec &&
+                    listing->modified.tv_nsec == st.st_mtim.tv_nsec;
+
+    if (!unchanged) {
+        listing_free(listing);
+        if (listing_read(fd, listing) == -1) {
+            perror(path);
+            listing_free(listing);
+            close(fd);
+            return NULL;
+        }
+        listing->device = st.st_dev;
+        listing->inode = st.st_ino;
+        listing->modified = st.st_mtim;
+    }
+
+    close(fd);
+    listing->last_use = ++use_clock;
+    return listing;
+}
+
+/**
+ * Adds a copy of a path at the end of the list.
+ * @return 0 on success, -1 if the allocation failed
+ */
+static int paths_add(struct path_list *list, const char *path) {
+    if (list->count + 1 >= list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 16;
+        char **paths = realloc(list->paths, capacity * sizeof(char *));
+        if (paths == NULL) return -1;
+        list->paths = paths;
+        list->capacity = capacity;
+    }
+
+    char *copy = strdup(path);
+    if (copy == NULL) return -1;
+    list->paths[list->count++] = copy;
+    list->paths[list->count] = NULL;
+    return 0;
+}
+
+/**
+ * Appends a string to the path being built.
+ * @return the new length of the path, or -1 if it is too long
+ */
+static long path_append(char *path, size_t length, const char *string, size_t string_length) {
+    if (length + string_length >= PATH_MAX) return -1;
+    memcpy(path + length, string, string_length);
+    path[length + string_length] = '\0';
+    return (long) (length + string_length);
+}
+
+static int is_directory(const char *path, unsigned char type) {
+    if (type == DT_DIR) return 1;
+    if (type != DT_UNKNOWN && type != DT_LNK) return 0;
+
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/**
+ * Matches the components of a pattern one by one, starting in the directory already in path.
+ * @param path the directory matched so far, followed by a "/" unless it is empty
+ * @param length the length of path
+ * @param pattern the components left to match
+ * @return 0 on success, -1 if the allocation failed
+ */
+static int pathname_walk(struct path_list *matches, char *path, size_t length, const char *pattern) {
+    const char *slash = strchr(pattern, '/');
+    size_t component_length = slash ? (size_t) (slash - pattern) : strlen(pattern);
+    const char *rest = NULL;
+    if (slash) {
+        rest = slash;
+        while (*rest == '/') rest++;
+    }
+
+    char component[NAME_MAX + 1];
+    if (component_length > NAME_MAX) return 0;
+    memcpy(component, pattern, component_length);
+    component[component_length] = '\0';
+
+    // A component without special characters names a single file, the directory is not read
+    if (!pathname_is_pattern(component)) {
+        long new_length = path_append(path, length, component, component_length);
+        if (new_length == -1) return 0;
+
+        struct stat st;
+        if (rest == NULL) return lstat(path, &st) == 0 ? paths_add(matches, path) : 0;
+        if (stat(path, &st) == -1 || !S_ISDIR(st.st_mode)) return 0;
+
+        new_length = path_append(path, new_length, "/", 1);
+        if (new_length == -1) return 0;
+        if (*rest == '\0') return paths_add(matches, path);
+        return pathname_walk(matches, path, new_length, rest);
+    }
+
+    struct directory_listing *listing = listing_get(length ? path : ".");
+    if (listing == NULL) return 0;
+
+    // The listing may be replaced by the recursive calls, the directories to enter are copied first
+    struct path_list directories = {NULL, 0, 0};
+    int result = 0;
+
+    for (size_t i = 0; i < listing->count && result == 0; i++) {
+        const char *name = listing->names + listing->offsets[i];
+        if (fnmatch(component, name, FNM_PERIOD) != 0) continue;
+
+        long new_length = path_append(path, length, name, strlen(name));
+        if (new_length == -1) continue;
+
+        if (rest == NULL) result = paths_add(matches, path);
+        else if (is_directory(path, listing->types[i])) result = paths_add(&directories, name);
+    }
+
+    for (size_t i = 0; i < directories.count && result == 0; i++) {
+        const char *name = directories.paths[i];
+        long new_length = path_append(path, length, name, strlen(name));
+        if (new_length != -1) new_length = path_append(path, new_length, "/", 1);
+        if (new_length == -1) continue;
+
+        if (*rest == '\0') result = paths_add(matches, path);
+        else result = pathname_walk(matches, path, new_length, rest);
+    }
+
+    path[length] = '\0';
+    pathname_free(directories.paths);
+    return result;
+}
+
+/**
+ * Sorts strings that share their first depth bytes, with a most significant digit radix sort.
+ * @param scratch an array of at least count strings
+ */
+static void radix_sort(char **strings, char **scratch, size_t count, size_t depth) {
+    while (count >= RADIX_SORT_CUTOFF) {
+        size_t counts[256] = {0};
+        for (size_t i = 0; i < count; i++) counts[(unsigned char) strings[i][depth]]++;
+
+        // Skip the bytes shared by every string without recursing
+        unsigned char first = (unsigned char) strings[0][depth];
+        if (counts[first] == count) {
+            if (first == '\0') return; // The strings are equal
+            depth++;
+            continue;
+        }
+
+        size_t starts[256];
+        size_t start = 0;
+        for (int byte = 0; byte < 256; byte++) {
+            starts[byte] = start;
+            start += counts[byte];
+        }
+
+        for (size_t i = 0; i < count; i++) scratch[starts[(unsigned char) strings[i][depth]]++] = strings[i];
+        memcpy(strings, scratch, count * sizeof(char *));
+
+        // The strings that end at this depth are equal, the other buckets are sorted on the next byte
+        for (int byte = 1; byte < 256; byte++) {
+            if (counts[byte] > 1) radix_sort(strings + starts[byte] - counts[byte], scratch, counts[byte], depth + 1);
+        }
+        return;
+    }
+
+    for (size_t i = 1; i < count; i++) {
+        char *string = strings[i];
+        size_t j = i;
+        for (; j > 0 && strcmp(strings[j - 1] + depth, string + depth) > 0; j--) strings[j] = strings[j - 1];
+        strings[j] = string;
+    }
+}
+
+char **pathname_expand(const char *pattern) {
+    struct path_list matches = {NULL, 0, 0};
+    char path[PATH_MAX];
+    size_t length = 0;
+
+    path[0] = '\0';
+    if (pattern[0] == '/') {
+        path[length++] = '/';
+        path[length] = '\0';
+        while (*pattern == '/') pattern++;
+    }
+
+    if (pathname_walk(&matches, path, length, pattern) == -1) {
+        fprintf(stderr, "Memory allocation error\n");
+        pathname_free(matches.paths);
+        return NULL;
+    }
+    if (matches.count == 0) return NULL;
+
+    char **scratch = malloc(matches.count * sizeof(char *));
+    if (scratch == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        pathname_free(matches.paths);
+        return NULL;
+    }
+    radix_sort(matches.paths, scratch, matches.count, 0);
+    free(scratch);
+
+    return matches.paths;
+}
+
+void pathname_free(char **paths) {
+    if (paths == NULL) return;
+    for (size_t i = 0; paths[i]; i++) free(paths[i]);
+    free(paths);
+}
+
+void pathname_cache_clear(void) {
+    for (size_t i = 0; i < PATHNAME_CACHE_CAPACITY; i++) listing_free(&cache[i]);
+}
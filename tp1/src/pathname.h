@@ -0,0 +1,39 @@
+#ifndef TP1_PATHNAME_H
+#define TP1_PATHNAME_H
+
+// Maximum number of directory listings kept in the cache, the least recently used one is replaced beyond it
+#define PATHNAME_CACHE_CAPACITY 32
+
+/**
+ * Determines whether a word contains "*", "?" or "[", i.e., whether it may be a pattern.
+ *
+ * @param word the word
+ * @return 1 if the word is a pattern, 0 otherwise
+ */
+int pathname_is_pattern(const char *word);
+
+/**
+ * Finds the paths that match a pattern, each component of the pattern is matched with fnmatch. Hidden
+ * files only match a component that starts with ".".
+ *
+ * The listings of the directories are cached with the inode and the modification time of the
+ * directory, so that a directory that did not change is only read once.
+ *
+ * @param pattern the pattern
+ * @return the matching paths sorted in byte order, the last element is NULL, or NULL if no path matches
+ */
+char **pathname_expand(const char *pattern);
+
+/**
+ * Frees the paths returned by pathname_expand.
+ *
+ * @param paths the paths
+ */
+void pathname_free(char **paths);
+
+/**
+ * Releases the memory used by the cached directory listings.
+ */
+void pathname_cache_clear(void);
+
+#endif
@@ -0,0 +1,139 @@
+#include "resource_limits.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "output.h"
+#include "shell.h"
+
+struct limit {
+    char option;
+    int resource;
+    rlim_t unit; // Bytes per unit of the values, 1 for counts and seconds
+    const char *description;
+    int set; // The limit is applied to the commands
+    rlim_t value; // In bytes, or RLIM_INFINITY
+};
+
+static struct limit limits[] = {
+        {'c', RLIMIT_CORE, 1024, "core file size (KiB, -c)", 0, 0},
+        {'d', RLIMIT_DATA, 1024, "data seg size (KiB, -d)", 0, 0},
+        {'f', RLIMIT_FSIZE, 1024, "file size (KiB, -f)", 0, 0},
+        {'n', RLIMIT_NOFILE, 1, "open files (-n)", 0, 0},
+        {'s', RLIMIT_STACK, 1024, "stack size (KiB, -s)", 0, 0},
+        {'t', RLIMIT_CPU, 1, "cpu time (seconds, -t)", 0, 0},
+        {'u', RLIMIT_NPROC, 1, "max user processes (-u)", 0, 0},
+        {'v', RLIMIT_AS, 1024, "virtual memory (KiB, -v)", 0, 0},
+};
+
+static int active = 0;
+
+#define LIMIT_COUNT (sizeof(limits) / sizeof(limits[0]))
+
+static struct limit *limit_find(char option) {
+    for (size_t i = 0; i < LIMIT_COUNT; i++) {
+        if (limits[i].option == option) return &limits[i];
+    }
+    return NULL;
+}
+
+int limits_active(void) {
+    return active;
+}
+
+int limits_apply(void) {
+    for (size_t i = 0; active && i < LIMIT_COUNT; i++) {
+        if (!limits[i].set) continue;
+
+        struct rlimit rlimit = {limits[i].value, limits[i].value};
+        if (setrlimit(limits[i].resource, &rlimit) == -1) {
+            perror("setrlimit");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Prints the limit the commands get: the one set by ulimit, or the one the shell inherited.
+ */
+static void limit_print(const struct limit *limit, int with_description) {
+    rlim_t value = limit->value;
+    if (!limit->set) {
+        struct rlimit rlimit;
+        getrlimit(limit->resource, &rlimit);
+        value = rlimit.rlim_cur;
+    }
+
+    if (with_description) output_printf(STDOUT_FILENO, "%-32s ", limit->description);
+    if (value == RLIM_INFINITY) output_printf(STDOUT_FILENO, "unlimited\n");
+    else output_printf(STDOUT_FILENO, "%llu\n", (unsigned long long) (value / limit->unit));
+}
+
+/**
+ * Sets a limit for the commands. It may not be above the hard limit of the shell, which the commands
+ * could not raise either.
+ * @return 0 on success, -1 on error
+ */
+static int limit_set(struct limit *limit, const char *text) {
+    rlim_t value = RLIM_INFINITY;
+
+    if (strcmp(text, "unlimited") != 0) {
+        char *end;
+        errno = 0;
+        unsigned long long units = strtoull(text, &end, 10);
+        if (errno != 0 || end == text || *end != '\0' || text[0] == '-' || units > RLIM_INFINITY / limit->unit) {
+            fprintf(stderr, "ulimit: %s: invalid number\n", text);
+            return -1;
+        }
+        value = (rlim_t) units * limit->unit;
+    }
+
+    struct rlimit hard;
+    if (getrlimit(limit->resource, &hard) == 0 && hard.rlim_max != RLIM_INFINITY &&
+        (value == RLIM_INFINITY || value > hard.rlim_max)) {
+        fprintf(stderr, "ulimit: %s: above the hard limit\n", text);
+        return -1;
+    }
+
+    limit->set = 1;
+    limit->value = value;
+    active = 1;
+    return 0;
+}
+
+int builtin_ulimit(char **args, struct command *block) {
+    (void) block;
+
+    if (args[1] == NULL) {
+        limit_print(limit_find('f'), 0);
+        return EXECUTION_SUCCESS;
+    }
+
+    for (int i = 1; args[i] != NULL; i++) {
+        if (strcmp(args[i], "-a") == 0) {
+            for (size_t j = 0; j < LIMIT_COUNT; j++) limit_print(&limits[j], 1);
+            continue;
+        }
+
+        struct limit *limit = args[i][0] == '-' && args[i][1] != '\0' && args[i][2] == '\0'
+                              ? limit_find(args[i][1])
+                              : NULL;
+        if (limit == NULL) {
+            fprintf(stderr, "ulimit: %s: invalid option\n", args[i]);
+            return EXECUTION_FAILED;
+        }
+
+        // The value is optional, the limit is printed without one
+        if (args[i + 1] == NULL || args[i + 1][0] == '-') {
+            limit_print(limit, 0);
+        } else if (limit_set(limit, args[++i]) == -1) {
+            return EXECUTION_FAILED;
+        }
+    }
+    return EXECUTION_SUCCESS;
+}
@@ -0,0 +1,32 @@
+#ifndef TP1_RESOURCE_LIMITS_H
+#define TP1_RESOURCE_LIMITS_H
+
+#include "parser.h"
+
+/**
+ * Determines whether ulimit set a limit for the commands.
+ *
+ * @return 1 if a limit is set, 0 otherwise
+ */
+int limits_active(void);
+
+/**
+ * Applies the limits set by ulimit to the current process. It is called in the child, after the fork
+ * and before the exec, the shell itself is never limited.
+ *
+ * @return 0 on success, -1 on error
+ */
+int limits_apply(void);
+
+/**
+ * ulimit [-a] [-cdfnstuv [value | unlimited]]...: sets the limits of the resources of the commands the
+ * shell starts from now on, or prints them. Sizes are in KiB, the CPU time in seconds. Without options,
+ * prints the limit of the file size.
+ *
+ * @param args the arguments of the command, the last element is NULL
+ * @param block unused
+ * @return execution_success, or execution_failed if an option or a value is not valid
+ */
+int builtin_ulimit(char **args, struct command *block);
+
+#endif
@@ -0,0 +1,120 @@
+#include "script.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shell.h"
+#include "trace.h"
+
+/**
+ * Tokenizes and parses every line of a buffer into the script.
+ */
+static int script_parse(struct script *script, const char *buffer, size_t length) {
+    size_t capacity = 0;
+
+    script->lines = NULL;
+    script->count = 0;
+
+    tok_set_input(buffer, length);
+
+    while (!tok_eof()) {
+        uint64_t tokenize_start = trace_now();
+        struct token *tokens = tok_next_line();
+        trace_span("tokenize", tokenize_start, NULL);
+        if (!tokens) continue;
+
+        uint64_t parse_start = trace_now();
+        struct parsed_line *line = parse_cache_acquire(tokens);
+        trace_span("parse", parse_start, NULL);
+        if (!line) continue;
+        if (line->error) fprintf(stderr, "%s\n", line->error);
+        if (!line->commands) {
+            parse_cache_release(line);
+            continue;
+        }
+
+        if (script->count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            struct parsed_line **lines = realloc(script->lines, capacity * sizeof(struct parsed_line *));
+            if (lines == NULL) {
+                fprintf(stderr, "Memory allocation error\n");
+                parse_cache_release(line);
+                tok_set_input(NULL, 0);
+                script_free(script);
+                return -1;
+            }
+            script->lines = lines;
+        }
+
+        script->lines[script->count++] = line;
+    }
+
+    tok_set_input(NULL, 0);
+    return 0;
+}
+
+int script_load_file(struct script *script, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror(path);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    // An empty file cannot be mapped
+    if (st.st_size == 0) {
+        close(fd);
+        return script_parse(script, "", 0);
+    }
+
+    char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    // The tokens own copies of their values, the mapping is not needed after parsing
+    int result = script_parse(script, map, st.st_size);
+    munmap(map, st.st_size);
+
+    return result;
+}
+
+int script_load_string(struct script *script, const char *source) {
+    return script_parse(script, source, strlen(source));
+}
+
+int script_load_buffer(struct script *script, const char *buffer, size_t length) {
+    return script_parse(script, buffer, length);
+}
+
+int script_run(const struct script *script) {
+    int status = EXECUTION_SUCCESS;
+
+    for (size_t i = 0; i < script->count; i++) {
+        status = sh_run(script->lines[i]->commands);
+        if (status == EXECUTION_REQUEST_EXIT) break;
+    }
+
+    return status;
+}
+
+void script_free(struct script *script) {
+    for (size_t i = 0; i < script->count; i++) parse_cache_release(script->lines[i]);
+    free(script->lines);
+    script->lines = NULL;
+    script->count = 0;
+}
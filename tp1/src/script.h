@@ -0,0 +1,59 @@
+#ifndef TP1_SCRIPT_H
+#define TP1_SCRIPT_H
+
+#include <stddef.h>
+
+#include "parse_cache.h"
+
+/**
+ * A script tokenized and parsed ahead of its execution.
+ */
+struct script {
+    struct parsed_line **lines; // Lines that contain at least one command, repeated lines are shared
+    size_t count; // Number of lines
+};
+
+/**
+ * Tokenizes and parses a whole script file. The file is mapped in memory and read only once.
+ *
+ * @param script the script to fill
+ * @param path the path of the script file
+ * @return 0 on success, -1 if the file could not be read
+ */
+int script_load_file(struct script *script, const char *path);
+
+/**
+ * Tokenizes and parses a whole script held in a string, e.g. the argument of "-c".
+ *
+ * @param script the script to fill
+ * @param source the commands
+ * @return 0 on success, -1 on error
+ */
+int script_load_string(struct script *script, const char *source);
+
+/**
+ * Tokenizes and parses a whole script held in a buffer, e.g. the body of a command substitution.
+ *
+ * @param script the script to fill
+ * @param buffer the commands, not necessarily terminated by a null character
+ * @param length the length of the commands
+ * @return 0 on success, -1 on error
+ */
+int script_load_buffer(struct script *script, const char *buffer, size_t length);
+
+/**
+ * Runs the lines of a script in order, until the end or until a line requests to exit.
+ *
+ * @param script the script
+ * @return the execution status of the last line, see shell.h
+ */
+int script_run(const struct script *script);
+
+/**
+ * Releases the memory used by a script.
+ *
+ * @param script the script
+ */
+void script_free(struct script *script);
+
+#endif
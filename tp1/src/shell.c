@@ -1,152 +1,788 @@
+#define _GNU_SOURCE // pipe2
+
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <memory.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 
+#include "shell.h"
+#include "builtins.h"
+#include "env.h"
+#include "expand.h"
+#include "functions.h"
+#include "history.h"
+#include "jobs.h"
+#include "output.h"
+#include "parallel.h"
+#include "parse_ahead.h"
+#include "parse_cache.h"
+#include "pathname.h"
+#include "resource_limits.h"
+#include "script.h"
+#include "stats.h"
+#include "supervise.h"
+#include "timeout.h"
+#include "trace.h"
 #include "tokenizer.h"
+#include "zygote.h"
 #include "parser.h"
 
-#define EXECUTION_FAILED (-1)
-#define EXECUTION_SUCCESS 1
-#define EXECUTION_REQUEST_EXIT 0
+static int last_status = 0; // Exit status of the last command, "$?"
+
+int sh_last_status(void) {
+    return last_status;
+}
+
+/**
+ * Leaves a forked subshell with the exit code corresponding to an execution status.
+ */
+_Noreturn void exit_subshell(int result) {
+    if (output_flush() == -1) {
+        fprintf(stderr, "write error: %s\n", strerror(errno));
+        result = EXECUTION_FAILED;
+    }
+    exit(result == EXECUTION_FAILED ? EXIT_FAILURE : EXIT_SUCCESS);
+}
 
-int is_skipped_op(enum op op) {
-    return !(op == OP_AND || op == OP_OR || op == OP_SEPARATOR);
+/**
+ * Determines whether a command redirects one of its standard file descriptors.
+ */
+int has_redirections(const struct command *cmd) {
+    return cmd->input_file != NULL || cmd->output_file != NULL || cmd->error_file != NULL;
 }
 
 /**
- * Creates a new process
- * @return the execution status of the command, i.e., execution_failed or execution_success
+ * Opens the file that a command redirects a standard file descriptor to.
+ * @param target_fd the standard file descriptor
+ * @return the file descriptor of the file, -1 if it could not be opened, -2 if there is no redirection
  */
-int execute_command(const struct command *cmd, enum op previous_op, int previous_result, int *is_skipping,
-                    int *previous_pipe_output) {
-    // If the previous command failed and the operator is "AND", skip the current command
-    // If the previous command succeeded and the operator is "OR", skip the current command
-    // If we are skipping and the current operator is "skipped operator", skip the current command
-    // Otherwise, reset the skipping flag
-    if ((previous_op == OP_AND && previous_result == EXECUTION_FAILED) ||
-        (previous_op == OP_OR && previous_result == EXECUTION_SUCCESS)) {
-        *is_skipping = 1;
-        return previous_result;
-    } else if (*is_skipping == 1 && is_skipped_op(previous_op)) {
-        return previous_result;
+int open_redirection(const struct command *cmd, int target_fd) {
+    const char *path;
+    int flags;
+
+    if (target_fd == STDIN_FILENO) {
+        path = cmd->input_file;
+        flags = O_RDONLY;
+    } else if (target_fd == STDOUT_FILENO) {
+        path = cmd->output_file;
+        flags = O_WRONLY | O_CREAT | (cmd->output_append ? O_APPEND : O_TRUNC);
     } else {
-        *is_skipping = 0;
+        path = cmd->error_file;
+        flags = O_WRONLY | O_CREAT | O_TRUNC;
     }
 
-    // Check for exit command
-    if (strcmp(cmd->args[0], "exit") == 0) return EXECUTION_REQUEST_EXIT;
+    if (path == NULL) return -2;
 
-    // Create a pipe
-    int pipe_fd[2];
-    if (pipe(pipe_fd) == -1) {
-        fprintf(stderr, "Error creating a pipe\n");
-        exit(EXECUTION_FAILED);
+    int fd = open(path, flags | O_CLOEXEC, 0666);
+    if (fd == -1) perror(path);
+    return fd;
+}
+
+/**
+ * Applies the redirections of a command to the standard file descriptors of the current process.
+ * @return 0 on success, -1 if a file could not be opened
+ */
+int apply_redirections(const struct command *cmd) {
+    for (int target_fd = 0; target_fd < 3; target_fd++) {
+        int fd = open_redirection(cmd, target_fd);
+        if (fd == -2) continue;
+        if (fd == -1) return -1;
+
+        dup2(fd, target_fd);
+        close(fd);
     }
+    output_reset();
+    return 0;
+}
 
-    // Fork and execute the command
-    int status = 0;
+/**
+ * Finds the builtin run by a simple command and checks its block, only the parallel builtin takes one.
+ * @param builtin receives the builtin, NULL if the command is not a builtin
+ * @return 0 if the command is valid, -1 otherwise
+ */
+int find_builtin(const struct command *cmd, builtin_fn *builtin) {
+    char **args = cmd->args + env_assignment_count(cmd->args);
+    *builtin = builtin_find(args);
+    if (cmd->block != NULL && *builtin != builtin_parallel) {
+        fprintf(stderr, "%s: unexpected block\n", args[0]);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Names a command in the trace.
+ */
+const char *command_name(const struct command *cmd) {
+    if (cmd->type == CMD_SIMPLE) return cmd->args[0];
+    if (cmd->type == CMD_FOR || cmd->type == CMD_WHILE) return "loop";
+    return cmd->type == CMD_GROUP ? "group" : "subshell";
+}
+
+int run_loop(struct command *cmd);
+
+/**
+ * Runs a builtin or a function, or a group or a loop if both are NULL, in the shell itself. Its
+ * redirections only last for the command, the standard file descriptors of the shell are saved and
+ * restored around it.
+ * @return the execution status of the command
+ */
+int run_in_shell(struct command *cmd, builtin_fn builtin, struct function *function) {
+    int saved_fds[3] = {-1, -1, -1};
+    int redirected = has_redirections(cmd);
+
+    if (redirected) {
+        output_flush();
+        for (int fd = 0; fd < 3; fd++) saved_fds[fd] = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+    }
+
+    int result;
+    if (redirected && apply_redirections(cmd) == -1) result = EXECUTION_FAILED;
+    else if (builtin != NULL) result = builtin(cmd->args + env_assignment_count(cmd->args), cmd->block);
+    else if (function != NULL) result = function_call(function, cmd->args + env_assignment_count(cmd->args));
+    else if (cmd->type == CMD_GROUP) result = sh_run(cmd->left);
+    else result = run_loop(cmd);
+
+    // The buffered output is written while the redirections apply, a write error fails the command
+    int write_failed = 0;
+    if (redirected && output_flush() == -1) {
+        fprintf(stderr, "write error: %s\n", strerror(errno));
+        write_failed = 1;
+        if (result != EXECUTION_REQUEST_EXIT) result = EXECUTION_FAILED;
+    }
+
+    // The timeout builtin reports the status of its command, exit keeps the status of the previous one
+    if (builtin != NULL && builtin != builtin_timeout && result != EXECUTION_REQUEST_EXIT) {
+        last_status = result == EXECUTION_FAILED ? 1 : 0;
+    }
+    // A function reports the status of its body, unless it failed before running it
+    if (function != NULL && result == EXECUTION_FAILED && last_status == 0) last_status = 1;
+    if (write_failed && last_status == 0) last_status = 1;
+
+    if (redirected) {
+        for (int fd = 0; fd < 3; fd++) {
+            if (saved_fds[fd] == -1) continue;
+            dup2(saved_fds[fd], fd);
+            close(saved_fds[fd]);
+        }
+        output_reset();
+    }
+
+    return result;
+}
+
+/**
+ * Runs a command in a forked child, whose standard input and output are already set up. External
+ * commands are executed, builtins, groups and subshells run in the child itself.
+ */
+_Noreturn void run_child(struct command *cmd) {
+    if (limits_apply() == -1 || apply_redirections(cmd) == -1) exit(EXIT_FAILURE);
+
+    builtin_fn builtin = NULL;
+    struct function *function = NULL;
+    char **args = cmd->args;
+    if (cmd->type == CMD_SIMPLE) {
+        // The expanded copy is freed when the child exits
+        struct command expanded;
+        if (cmd->word_flags != NULL) {
+            if (expand_command(cmd, &expanded) == -1) exit(EXIT_FAILURE);
+            cmd = &expanded;
+        }
+
+        // The assignments that prefix the command only apply to it, the child is discarded anyway
+        size_t assignments = env_assignment_count(cmd->args);
+        args = cmd->args + assignments;
+        if (args[0] == NULL) exit(EXIT_SUCCESS); // Only assignments, or the words expanded to nothing
+        if (find_builtin(cmd, &builtin) == -1) exit(EXIT_FAILURE);
+
+        // Functions come before builtins
+        function = function_find(args[0]);
+        if (function != NULL) builtin = NULL;
+
+        if (builtin == NULL && function == NULL) {
+            // The environment of the shell is shared, only the prefixed commands get a block of their own
+            if (assignments > 0 && (environ = env_block_with(cmd->args, assignments)) == NULL) exit(EXIT_FAILURE);
+
+            // Execute the command
+            trace_instant("exec", getpid(), args[0]);
+            execvp(args[0], args);
+
+            // If execvp returns, it must have failed
+            fprintf(stderr, "%s: command not found\n", args[0]);
+            exit(EXECUTION_FAILED);
+        }
+
+        for (size_t i = 0; i < assignments; i++) {
+            if (env_assign(cmd->args[i], 1) == -1) exit(EXIT_FAILURE);
+        }
+    }
+
+    // The jobs of the parent shell are not children of the subshell
+    jobs_reset();
+
+    if (builtin != NULL) exit_subshell(builtin(args, cmd->block));
+    if (function != NULL) exit_subshell(function_call(function, args));
+    if (cmd->type == CMD_GROUP || cmd->type == CMD_SUBSHELL) exit_subshell(sh_run(cmd->left));
+    if (cmd->type == CMD_FOR || cmd->type == CMD_WHILE) exit_subshell(run_loop(cmd));
+    exit_subshell(sh_run(cmd));
+}
+
+/**
+ * Launches an external command through the zygote. The redirections are opened by the shell and sent
+ * to the zygote with the pipes.
+ * @return the pid of the command, -1 on error, or ZYGOTE_UNAVAILABLE if the shell must fork it
+ */
+pid_t spawn_with_zygote(struct command *cmd, int input_fd, int output_fd) {
+    int fds[3] = {input_fd != -1 ? input_fd : STDIN_FILENO, output_fd != -1 ? output_fd : STDOUT_FILENO,
+                  STDERR_FILENO};
+    int opened[3] = {-2, -2, -2};
+    pid_t pid = -1;
+
+    int target_fd = 0;
+    for (; target_fd < 3; target_fd++) {
+        opened[target_fd] = open_redirection(cmd, target_fd);
+        if (opened[target_fd] == -1) break;
+        if (opened[target_fd] >= 0) fds[target_fd] = opened[target_fd];
+    }
+
+    // The zygote gets the environment of the command, with the assignments that prefix it
+    size_t assignments = env_assignment_count(cmd->args);
+    char **envp = assignments > 0 ? env_block_with(cmd->args, assignments) : env_block();
+    char **args = cmd->args + assignments;
+
+    if (target_fd == 3 && envp != NULL) {
+        output_flush();
+        uint64_t fork_start = trace_now();
+        pid = zygote_spawn(args, envp, fds);
+        if (pid > 0) trace_span("fork", fork_start, args[0]);
+    }
+    if (assignments > 0) free(envp);
+
+    for (int fd = 0; fd < 3; fd++) {
+        if (opened[fd] >= 0) close(opened[fd]);
+    }
+    return pid;
+}
+
+pid_t spawn_command(struct command *cmd, int input_fd, int output_fd, int unused_fd) {
+    // External commands are launched by the zygote when there is one, words to expand need a fork, and so
+    // do the limits set by ulimit, which are applied in the child
+    if (cmd->type == CMD_SIMPLE && cmd->word_flags == NULL && cmd->block == NULL && !limits_active() &&
+        zygote_active()) {
+        char **args = cmd->args + env_assignment_count(cmd->args);
+        if (args[0] != NULL && builtin_find(args) == NULL && function_find(args[0]) == NULL) {
+            pid_t pid = spawn_with_zygote(cmd, input_fd, output_fd);
+            if (pid != ZYGOTE_UNAVAILABLE) return pid;
+        }
+    }
+
+    // The child must not write the output buffered by the shell again
+    output_flush();
+
+    uint64_t fork_start = trace_now();
     pid_t pid = fork();
     if (pid < 0) { // error occurred
         fprintf(stderr, "Fork failed\n");
+        return -1;
+    }
+    if (pid > 0) {
+        trace_span("fork", fork_start, command_name(cmd));
+        return pid;
+    }
+
+    // Set the standard input and output to the pipes
+    if (input_fd != -1) {
+        dup2(input_fd, STDIN_FILENO);
+        close(input_fd);
+    }
+    if (output_fd != -1) {
+        dup2(output_fd, STDOUT_FILENO);
+        close(output_fd);
+    }
+    if (unused_fd != -1) close(unused_fd);
+
+    run_child(cmd);
+}
+
+/**
+ * Records the end of a child: its resources in the trace and its exit status in "$?".
+ * @return the execution status of the child
+ */
+int finish_command(const struct command *cmd, int status, const struct rusage *usage, uint64_t wait_start) {
+    trace_rusage(usage);
+    trace_span("wait", wait_start, command_name(cmd));
+    stats_record(command_name(cmd), usage, 1);
+
+    last_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+    // Check exit status
+    return status == 0 ? EXECUTION_SUCCESS : EXECUTION_FAILED;
+}
+
+/**
+ * Waits for a child to finish, wait4 also reports the resources it used.
+ */
+int wait_command(pid_t pid, const struct command *cmd) {
+    int status = 0;
+    struct rusage usage;
+
+    uint64_t wait_start = trace_now();
+    if (zygote_wait(pid, &status, &usage) == -1) {
+        while (wait4(pid, &status, 0, &usage) == -1) {
+            if (errno != EINTR) return EXECUTION_FAILED;
+        }
+    }
+
+    int result = finish_command(cmd, status, &usage, wait_start);
+    stats_report();
+    return result;
+}
+
+int wait_command_timeout(pid_t pid, const struct command *cmd, int64_t timeout_ns) {
+    struct supervised_child child = {.pid = pid};
+
+    uint64_t wait_start = trace_now();
+    if (supervise_wait(&child, 1, timeout_ns) == -1) return EXECUTION_FAILED;
+
+    int result = finish_command(cmd, child.status, &child.usage, wait_start);
+    if (child.timed_out) last_status = TIMEOUT_STATUS;
+    stats_report();
+    return result;
+}
+
+/**
+ * Sets the variables of a command that only has "VAR=x" words.
+ * @return the execution status of the assignments
+ */
+int run_assignments(char **args) {
+    int result = EXECUTION_SUCCESS;
+    for (int i = 0; args[i] != NULL; i++) {
+        if (env_assign(args[i], 0) == -1) result = EXECUTION_FAILED;
+    }
+
+    last_status = result == EXECUTION_FAILED ? 1 : 0;
+    return result;
+}
+
+/**
+ * Runs a simple command. Builtins run in the shell itself, other commands in a child.
+ * @return the execution status of the command
+ */
+int run_simple(struct command *cmd) {
+    // Run a copy of the command with its words expanded
+    if (cmd->word_flags != NULL) {
+        struct command expanded;
+        if (expand_command(cmd, &expanded) == -1) return EXECUTION_FAILED;
+
+        int result = expanded.args[0] != NULL ? run_simple(&expanded) : EXECUTION_SUCCESS;
+        expand_free(&expanded);
+        return result;
+    }
+
+    size_t assignments = env_assignment_count(cmd->args);
+    if (cmd->args[assignments] == NULL) return run_assignments(cmd->args);
+
+    builtin_fn builtin;
+    if (find_builtin(cmd, &builtin) == -1) return EXECUTION_FAILED;
+
+    // Functions come before builtins, their body runs in the shell without being parsed again
+    struct function *function = function_find(cmd->args[assignments]);
+    if (function != NULL) builtin = NULL;
+    if ((builtin != NULL || function != NULL) && assignments == 0) return run_in_shell(cmd, builtin, function);
+
+    // The assignments that prefix a builtin or a function are undone once it returns
+    if (builtin != NULL || function != NULL) {
+        struct env_saved *saved = env_override(cmd->args, assignments);
+        if (saved == NULL) return EXECUTION_FAILED;
+
+        int result = run_in_shell(cmd, builtin, function);
+        env_restore(saved);
+        return result;
+    }
+
+    pid_t pid = spawn_command(cmd, -1, -1, -1);
+    if (pid < 0) return EXECUTION_FAILED;
+    return wait_command(pid, cmd);
+}
+
+/**
+ * Runs the commands of a pipeline concurrently, each one in a child, then waits for all of them.
+ * @return the execution status of the last command
+ */
+int run_pipeline(struct command *cmd) {
+    size_t count = 1;
+    for (const struct command *stage = cmd; stage->type == CMD_PIPE; stage = stage->right) count++;
+
+    struct pipeline_stage {
+        struct command *command;
+        struct command expanded; // Copy of the command with its words expanded, if it has expansions
+    } *stages = malloc(count * sizeof(struct pipeline_stage));
+    struct supervised_child *children = malloc(count * sizeof(struct supervised_child));
+    if (stages == NULL || children == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(stages);
+        free(children);
         return EXECUTION_FAILED;
     }
 
-    // Run the child process
-    if (pid == 0) {
-        // Set STDIN to the previous pipe output
-        if (previous_op == OP_PIPE) {
-            dup2(*previous_pipe_output, STDIN_FILENO);
+    // Start every command, each one reads the pipe written by the previous one
+    size_t started = 0;
+    int input_fd = -1;
+    for (struct command *stage = cmd; started < count; stage = stage->right) {
+        struct command *command = stage->type == CMD_PIPE ? stage->left : stage;
+        int pipe_fd[2] = {-1, -1};
+
+        if (command->type == CMD_SIMPLE && command->word_flags != NULL) {
+            if (expand_command(command, &stages[started].expanded) == -1) break;
+            command = &stages[started].expanded;
         }
 
-        // Set STDOUT to the write end of the pipe
-        if (cmd->op == OP_PIPE) {
-            dup2(pipe_fd[1], STDOUT_FILENO);
-            close(pipe_fd[1]);
+        // Create a pipe
+        if (stage->type == CMD_PIPE) {
+            uint64_t pipe_start = trace_now();
+            if (pipe2(pipe_fd, O_CLOEXEC) == -1) {
+                fprintf(stderr, "Error creating a pipe\n");
+                if (command == &stages[started].expanded) expand_free(command);
+                break;
+            }
+            trace_span("pipe", pipe_start, command_name(command));
         }
 
-        // Execute the command
-        int return_value = execvp(cmd->args[0], cmd->args);
+        pid_t pid = spawn_command(command, input_fd, pipe_fd[1], pipe_fd[0]);
 
-        // If execvp returns, it must have failed
-        if (return_value != 0) {
-            fprintf(stderr, "%s: command not found\n", cmd->args[0]);
-            exit(EXECUTION_FAILED);
+        // Close the write end of the pipe and keep its read end for the next command
+        if (input_fd != -1) close(input_fd);
+        if (pipe_fd[1] != -1) close(pipe_fd[1]);
+        input_fd = pipe_fd[0];
+
+        if (pid < 0) {
+            if (command == &stages[started].expanded) expand_free(command);
+            break;
         }
-    } else {
-        // Wait for the child process to finish
-        waitpid(pid, &status, 0);
+        stages[started].command = command;
+        children[started].pid = pid;
+        started++;
+    }
+    if (input_fd != -1) close(input_fd);
+
+    // Wait for the commands in the order in which they finish
+    uint64_t wait_start = trace_now();
+    int waited = supervise_wait(children, started, -1);
 
-        // Close the write end of the pipe and update the previous pipe output
-        close(pipe_fd[1]);
-        *previous_pipe_output = pipe_fd[0];
+    // The pipeline fails if one of its commands could not be started
+    int result = EXECUTION_FAILED;
+    for (size_t i = 0; i < started; i++) {
+        int stage_result = finish_command(stages[i].command, children[i].status, &children[i].usage, wait_start);
+        if (started == count && i == count - 1 && waited == 0) result = stage_result;
+        if (stages[i].command == &stages[i].expanded) expand_free(&stages[i].expanded);
     }
+    stats_report();
 
-    // Check exit status
-    if (status == 0) {
-        return EXECUTION_SUCCESS;
-    } else {
+    free(children);
+    free(stages);
+    return result;
+}
+
+pid_t fork_list(struct command *list, int output_fd, int error_fd) {
+    output_flush();
+
+    uint64_t fork_start = trace_now();
+    pid_t pid = fork();
+    if (pid != 0) {
+        trace_span("fork", fork_start, "subshell");
+        return pid;
+    }
+
+    // The jobs of the parent shell are not children of the subshell
+    jobs_reset();
+
+    // Subshells run concurrently with the shell, they must not steal its input
+    int dev_null = open("/dev/null", O_RDONLY);
+    if (dev_null != -1) {
+        dup2(dev_null, STDIN_FILENO);
+        close(dev_null);
+    }
+
+    if (output_fd != -1) dup2(output_fd, STDOUT_FILENO);
+    if (error_fd != -1) dup2(error_fd, STDERR_FILENO);
+    output_reset();
+
+    exit_subshell(sh_run(list));
+}
+
+/**
+ * Runs a list in a subshell without waiting for it, and adds it to the job table.
+ * @param list the commands that precede the "&"
+ * @return the execution status of the launch, i.e., execution_failed or execution_success
+ */
+int run_background(struct command *list) {
+    pid_t pid = fork_list(list, -1, -1);
+    if (pid < 0) {
+        fprintf(stderr, "Fork failed\n");
         return EXECUTION_FAILED;
     }
+
+    jobs_add(pid, list);
+    return EXECUTION_SUCCESS;
 }
 
 /**
- * Cette fonction prend une liste de commandes et l'exécute.
- *
- * @param cmd list chainée de commandes
- *
- * @return le code de retour de la dernière commande exécutée.
+ * Runs a loop in the shell. Its body was parsed once, each iteration runs the same tree: builtins do not
+ * fork and only the words that contain a "$" are expanded again. The words of a for loop are expanded
+ * once, before the first iteration.
+ * @return the execution status of the last iteration, success if there was none
  */
+int run_loop(struct command *cmd) {
+    int result = EXECUTION_SUCCESS;
+    int status = 0; // "$?" of the loop, the one of the last command of the body
+
+    if (cmd->type == CMD_WHILE) {
+        for (;;) {
+            int condition = sh_run(cmd->left);
+            if (condition == EXECUTION_REQUEST_EXIT) return condition;
+            if (condition != EXECUTION_SUCCESS) break;
+
+            result = sh_run(cmd->right);
+            if (result == EXECUTION_REQUEST_EXIT) return result;
+            status = last_status;
+        }
+
+        last_status = status;
+        return result;
+    }
+
+    struct command expanded = *cmd;
+    if (cmd->word_flags != NULL && expand_command(cmd, &expanded) == -1) return EXECUTION_FAILED;
+
+    // The assignment of the variable is rewritten in place for each word
+    char **args = expanded.args;
+    size_t name_length = strlen(args[0]);
+    size_t longest = 0;
+    for (size_t i = 1; args[i] != NULL; i++) {
+        size_t length = strlen(args[i]);
+        if (length > longest) longest = length;
+    }
+
+    char *assignment = malloc(name_length + longest + 2);
+    if (assignment == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        result = EXECUTION_FAILED;
+    } else {
+        memcpy(assignment, args[0], name_length);
+        assignment[name_length] = '=';
+    }
+
+    for (size_t i = 1; assignment != NULL && args[i] != NULL; i++) {
+        strcpy(assignment + name_length + 1, args[i]);
+        if (env_assign(assignment, 0) == -1) {
+            result = EXECUTION_FAILED;
+            status = 1;
+            break;
+        }
+
+        result = sh_run(cmd->left);
+        if (result == EXECUTION_REQUEST_EXIT) break;
+        status = last_status;
+    }
+
+    free(assignment);
+    if (cmd->word_flags != NULL) expand_free(&expanded);
+
+    if (result != EXECUTION_REQUEST_EXIT) last_status = status;
+    return result;
+}
+
 int sh_run(struct command *cmd) {
-    if (!cmd || cmd->args[0] == NULL) return EXECUTION_FAILED; // Empty command
+    if (!cmd) return EXECUTION_FAILED; // Empty command
 
-    // Initialize variables
-    enum op previous_op = (enum op) NULL;
-    int previous_result = EXECUTION_SUCCESS;
-    int is_skipping = 0;
-    int previous_pipe_output = STDIN_FILENO;
+    switch (cmd->type) {
+        case CMD_SIMPLE:
+            return run_simple(cmd);
+        case CMD_PIPE:
+            return run_pipeline(cmd);
+        case CMD_AND: // Fallthrough
+        case CMD_OR: {
+            int result = sh_run(cmd->left);
+            if (result == EXECUTION_REQUEST_EXIT) return result;
 
-    // Execute the commands
-    struct command *current_command = cmd;
-    while (current_command != NULL) {
-        // Execute the command
-        previous_result = execute_command(current_command, previous_op, previous_result, &is_skipping,
-                                          &previous_pipe_output);
+            // The right operand is skipped as a whole when the left one decides the result
+            if ((cmd->type == CMD_AND) != (result == EXECUTION_SUCCESS)) return result;
+            return sh_run(cmd->right);
+        }
+        case CMD_SEQUENCE: {
+            // Sequences lean to the right, they are run iteratively
+            for (; cmd->type == CMD_SEQUENCE; cmd = cmd->right) {
+                if (sh_run(cmd->left) == EXECUTION_REQUEST_EXIT) return EXECUTION_REQUEST_EXIT;
+            }
+            return sh_run(cmd);
+        }
+        case CMD_BACKGROUND:
+            return run_background(cmd->left);
+        case CMD_GROUP:
+            return run_in_shell(cmd, NULL, NULL);
+        case CMD_FOR: // Fallthrough
+        case CMD_WHILE:
+            return has_redirections(cmd) ? run_in_shell(cmd, NULL, NULL) : run_loop(cmd);
+        case CMD_FUNCTION: {
+            int result = function_define(cmd) == 0 ? EXECUTION_SUCCESS : EXECUTION_FAILED;
+            last_status = result == EXECUTION_FAILED ? 1 : 0;
+            return result;
+        }
+        case CMD_SUBSHELL: {
+            pid_t pid = spawn_command(cmd, -1, -1, -1);
+            if (pid < 0) return EXECUTION_FAILED;
+            return wait_command(pid, cmd);
+        }
+    }
+
+    return EXECUTION_FAILED;
+}
 
-        // Check for exit command
-        if (previous_result == EXECUTION_REQUEST_EXIT) return EXECUTION_REQUEST_EXIT;
+/**
+ * Releases the resources of the shell before it exits.
+ */
+static void shell_cleanup(void) {
+    jobs_free();
+    parse_ahead_stop();
+    parse_cache_clear();
+    pathname_cache_clear();
+    history_close();
+    zygote_stop();
+    function_clear();
+    stats_clear();
+    env_free();
+}
 
-        previous_op = current_command->op;
-        current_command = current_command->next;
+/**
+ * Runs a script given as a file or with "-c". The whole script is tokenized and parsed before it runs.
+ * @return the exit code of the shell, the exit status of the last command that ran
+ */
+int run_script(int argc, char **argv) {
+    struct script script;
+    int loaded;
+
+    if (strcmp(argv[1], "-c") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "Usage: %s [-c commands | script]\n", argv[0]);
+            return 2;
+        }
+        loaded = script_load_string(&script, argv[2]);
+    } else {
+        loaded = script_load_file(&script, argv[1]);
     }
 
-    return EXECUTION_SUCCESS;
+    if (loaded == -1) return 127;
+
+    script_run(&script);
+    script_free(&script);
+    shell_cleanup();
+
+    return sh_last_status();
+}
+
+/**
+ * Runs the lines of the standard input as the parser thread hands them over.
+ * @return the exit code of the shell
+ */
+static int run_parsed_ahead(void) {
+    struct parsed_line *line;
+    char *text;
+    size_t text_length;
+    while ((line = parse_ahead_next(&text, &text_length)) != NULL) {
+        // Report the background jobs that finished while the previous line ran
+        jobs_reap();
+        jobs_notify();
+
+        // The errors are reported here rather than by the parser thread, in the order of the lines
+        if (line->error) fprintf(stderr, "%s\n", line->error);
+        if (!line->commands) {
+            parse_cache_release(line);
+            free(text);
+            continue;
+        }
+
+        if (text) history_add(text, text_length);
+        free(text);
+
+        int status = sh_run(line->commands);
+        parse_cache_release(line);
+
+        if (status == EXECUTION_REQUEST_EXIT) break;
+    }
+
+    shell_cleanup();
+    return 0;
 }
 
-int main(void) {
+int main(int argc, char **argv) {
+    trace_init();
+    output_init();
+
+    // The zygote is forked before the shell allocates anything
+    zygote_start();
+    if (env_init() == -1) return EXIT_FAILURE;
+
+    if (argc > 1) {
+        jobs_init(0);
+        return run_script(argc, argv);
+    }
+
+    int interactive = isatty(STDIN_FILENO);
+    jobs_init(interactive);
+    history_open();
+
+    // A piped input is parsed by a thread while the previous lines run
+    if (!interactive && parse_ahead_start(history_enabled()) == 0) return run_parsed_ahead();
+
     while (1) {
+        // Report the background jobs that finished while the previous line ran
+        jobs_reap();
+        jobs_notify();
+
+        // The output of the previous line is shown before the next one is read
+        output_flush();
+
+        uint64_t tokenize_start = trace_now();
         struct token *tokens = tok_next_line();
+        trace_span("tokenize", tokenize_start, NULL);
 
-        if (!tokens) continue;
+        if (!tokens) {
+            if (tok_eof()) break;
+            continue;
+        }
 
 //        tok_debug_print(tokens);
 
-        struct command *commands = cmd_parse(tokens);
+        uint64_t parse_start = trace_now();
+        struct parsed_line *line = parse_cache_acquire(tokens);
+        trace_span("parse", parse_start, NULL);
 
-        if (!commands) {
-            tok_free(tokens);
+        if (!line) continue;
+        if (line->error) fprintf(stderr, "%s\n", line->error);
+        if (!line->commands) {
+            parse_cache_release(line);
             continue;
         }
 
-//        cmd_debug_print(commands);
+//        cmd_debug_print(line->commands);
+
+        size_t text_length;
+        const char *text = tok_line_text(&text_length);
+        history_add(text, text_length);
 
-        int status = sh_run(commands);
-        cmd_free(commands);
-        tok_free(tokens);
+        int status = sh_run(line->commands);
+        parse_cache_release(line);
 
         if (status == EXECUTION_REQUEST_EXIT) {
+            shell_cleanup();
             exit(0);
         }
     }
+
+    shell_cleanup();
+    return 0;
 }
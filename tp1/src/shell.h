@@ -0,0 +1,72 @@
+#ifndef TP1_SHELL_H
+#define TP1_SHELL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "parser.h"
+
+#define EXECUTION_FAILED (-1)
+#define EXECUTION_SUCCESS 1
+#define EXECUTION_REQUEST_EXIT 0
+
+// Exit status of a command killed by the timeout builtin, like the one of coreutils
+#define TIMEOUT_STATUS 124
+
+/**
+ * Cette fonction prend un arbre de commandes et l'exécute.
+ *
+ * @param cmd racine de l'arbre de commandes
+ *
+ * @return le code de retour de la dernière commande exécutée.
+ */
+int sh_run(struct command *cmd);
+
+/**
+ * Returns the exit status of the last command that ran, i.e., the value of "$?".
+ *
+ * @return the exit status, between 0 and 255
+ */
+int sh_last_status(void);
+
+/**
+ * Starts a command in a child, external commands are executed, the others run in a subshell.
+ *
+ * @param cmd the command
+ * @param input_fd the standard input of the child, -1 to keep the one of the shell
+ * @param output_fd the standard output of the child, -1 to keep the one of the shell
+ * @param unused_fd a file descriptor of the shell that the child must close, or -1
+ * @return the pid of the child or -1 if it could not be started
+ */
+pid_t spawn_command(struct command *cmd, int input_fd, int output_fd, int unused_fd);
+
+/**
+ * Waits for a child started by spawn_command to finish.
+ *
+ * @param pid the pid of the child
+ * @param cmd the command run by the child
+ * @return the execution status of the child
+ */
+int wait_command(pid_t pid, const struct command *cmd);
+
+/**
+ * Waits for a child started by spawn_command to finish, and sends it SIGTERM if it runs past a deadline.
+ *
+ * @param pid the pid of the child
+ * @param cmd the command run by the child
+ * @param timeout_ns the time the child may run for in nanoseconds, -1 for no deadline
+ * @return the execution status of the child
+ */
+int wait_command_timeout(pid_t pid, const struct command *cmd, int64_t timeout_ns);
+
+/**
+ * Forks a subshell that runs a list of commands, with its input redirected from /dev/null.
+ *
+ * @param list the commands to run
+ * @param output_fd the standard output of the subshell, -1 to keep the one of the shell
+ * @param error_fd the standard error of the subshell, -1 to keep the one of the shell
+ * @return the pid of the subshell or -1 if the fork failed, the subshell itself does not return
+ */
+pid_t fork_list(struct command *list, int output_fd, int error_fd);
+
+#endif
@@ -0,0 +1,186 @@
+#define _DEFAULT_SOURCE // timeradd
+
+#include "stats.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "output.h"
+#include "shell.h"
+
+// Resources used by children, summed except for the peak RSS
+struct usage_totals {
+    size_t count; // Number of children
+    struct timeval user;
+    struct timeval system;
+    long max_rss; // KiB, the largest of the children
+    long voluntary_switches;
+    long involuntary_switches;
+    long blocks_in;
+    long blocks_out;
+};
+
+struct stats_entry {
+    char *name;
+    struct usage_totals totals;
+    struct stats_entry *next; // Next entry of the bucket
+};
+
+static struct stats_entry *buckets[STATS_BUCKETS];
+static size_t entry_count = 0;
+
+static int report_pipelines = 0;
+static struct usage_totals pipeline;
+static char pipeline_label[STATS_LABEL_LENGTH];
+static size_t label_length = 0;
+
+static size_t bucket_of(const char *name) {
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+    for (const char *c = name; *c; c++) {
+        hash ^= (unsigned char) *c;
+        hash *= 1099511628211ULL;
+    }
+    return hash % STATS_BUCKETS;
+}
+
+static void totals_add(struct usage_totals *totals, const struct rusage *usage) {
+    totals->count++;
+    timeradd(&totals->user, &usage->ru_utime, &totals->user);
+    timeradd(&totals->system, &usage->ru_stime, &totals->system);
+    if (usage->ru_maxrss > totals->max_rss) totals->max_rss = usage->ru_maxrss;
+    totals->voluntary_switches += usage->ru_nvcsw;
+    totals->involuntary_switches += usage->ru_nivcsw;
+    totals->blocks_in += usage->ru_inblock;
+    totals->blocks_out += usage->ru_oublock;
+}
+
+static double seconds(struct timeval time) {
+    return (double) time.tv_sec + (double) time.tv_usec / 1e6;
+}
+
+/**
+ * Finds the entry of a command, it is created the first time.
+ * @return the entry or NULL if the allocation failed
+ */
+static struct stats_entry *entry_find(const char *name) {
+    struct stats_entry **slot = &buckets[bucket_of(name)];
+    while (*slot != NULL && strcmp((*slot)->name, name) != 0) slot = &(*slot)->next;
+    if (*slot != NULL) return *slot;
+
+    struct stats_entry *entry = calloc(1, sizeof(struct stats_entry));
+    char *copy = strdup(name);
+    if (entry == NULL || copy == NULL) {
+        free(entry);
+        free(copy);
+        return NULL;
+    }
+
+    entry->name = copy;
+    *slot = entry;
+    entry_count++;
+    return entry;
+}
+
+void stats_record(const char *name, const struct rusage *usage, int foreground) {
+    struct stats_entry *entry = entry_find(name);
+    if (entry != NULL) totals_add(&entry->totals, usage);
+
+    if (!foreground || !report_pipelines) return;
+    totals_add(&pipeline, usage);
+
+    // The label names the commands of the pipeline, in the order in which they finished
+    int written = snprintf(pipeline_label + label_length, STATS_LABEL_LENGTH - label_length,
+                           label_length ? " | %s" : "%s", name);
+    if (written > 0) label_length += (size_t) written;
+    if (label_length >= STATS_LABEL_LENGTH) label_length = STATS_LABEL_LENGTH - 1;
+}
+
+void stats_report(void) {
+    if (!report_pipelines || pipeline.count == 0) return;
+
+    output_flush();
+    fprintf(stderr, "%s: user %.3fs system %.3fs, max RSS %ld KiB, context switches %ld voluntary %ld involuntary, "
+                    "blocks %ld in %ld out\n",
+            pipeline_label, seconds(pipeline.user), seconds(pipeline.system), pipeline.max_rss,
+            pipeline.voluntary_switches, pipeline.involuntary_switches, pipeline.blocks_in, pipeline.blocks_out);
+
+    memset(&pipeline, 0, sizeof(pipeline));
+    label_length = 0;
+    pipeline_label[0] = '\0';
+}
+
+void stats_clear(void) {
+    for (size_t i = 0; i < STATS_BUCKETS; i++) {
+        while (buckets[i] != NULL) {
+            struct stats_entry *entry = buckets[i];
+            buckets[i] = entry->next;
+            free(entry->name);
+            free(entry);
+        }
+    }
+    entry_count = 0;
+}
+
+/**
+ * Orders the entries by CPU time, the most expensive commands first.
+ */
+static int compare_cpu(const void *a, const void *b) {
+    const struct usage_totals *x = &(*(struct stats_entry *const *) a)->totals;
+    const struct usage_totals *y = &(*(struct stats_entry *const *) b)->totals;
+    double cpu_x = seconds(x->user) + seconds(x->system);
+    double cpu_y = seconds(y->user) + seconds(y->system);
+    return (cpu_x < cpu_y) - (cpu_x > cpu_y);
+}
+
+/**
+ * Lists the totals of every command.
+ */
+static int stats_dump(void) {
+    struct stats_entry **entries = malloc((entry_count ? entry_count : 1) * sizeof(struct stats_entry *));
+    if (entries == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return EXECUTION_FAILED;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < STATS_BUCKETS; i++) {
+        for (struct stats_entry *entry = buckets[i]; entry != NULL; entry = entry->next) entries[count++] = entry;
+    }
+    qsort(entries, count, sizeof(struct stats_entry *), compare_cpu);
+
+    output_printf(STDOUT_FILENO, "%-16s %6s %9s %9s %9s %9s %9s %9s %9s\n", "command", "runs", "user", "system",
+                  "maxrss", "nvcsw", "nivcsw", "inblock", "oublock");
+    for (size_t i = 0; i < count; i++) {
+        const struct usage_totals *totals = &entries[i]->totals;
+        output_printf(STDOUT_FILENO, "%-16s %6zu %9.3f %9.3f %9ld %9ld %9ld %9ld %9ld\n", entries[i]->name,
+                      totals->count, seconds(totals->user), seconds(totals->system), totals->max_rss,
+                      totals->voluntary_switches, totals->involuntary_switches, totals->blocks_in,
+                      totals->blocks_out);
+    }
+
+    free(entries);
+    return EXECUTION_SUCCESS;
+}
+
+int builtin_stats(char **args, struct command *block) {
+    (void) block;
+
+    if (args[1] == NULL) return stats_dump();
+
+    for (int i = 1; args[i] != NULL; i++) {
+        if (strcmp(args[i], "-r") == 0) {
+            stats_clear();
+        } else if (strcmp(args[i], "-p") == 0 && args[i + 1] != NULL &&
+                   (strcmp(args[i + 1], "on") == 0 || strcmp(args[i + 1], "off") == 0)) {
+            report_pipelines = strcmp(args[++i], "on") == 0;
+        } else {
+            fprintf(stderr, "stats: usage: stats [-r] [-p on|off]\n");
+            return EXECUTION_FAILED;
+        }
+    }
+    return EXECUTION_SUCCESS;
+}
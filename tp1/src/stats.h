@@ -0,0 +1,45 @@
+#ifndef TP1_STATS_H
+#define TP1_STATS_H
+
+#include <sys/resource.h>
+
+#include "parser.h"
+
+// Number of buckets of the table of totals per command
+#define STATS_BUCKETS 64
+
+// Maximum length of the label of a pipeline in its summary
+#define STATS_LABEL_LENGTH 128
+
+/**
+ * Adds the resources used by a child, as returned by wait4, to the totals of its command. The children
+ * of a foreground pipeline are also added to the summary of that pipeline.
+ *
+ * @param name the name of the command
+ * @param usage the resources used by the child
+ * @param foreground 1 if the child is part of the pipeline the shell waits for, 0 for a background job
+ */
+void stats_record(const char *name, const struct rusage *usage, int foreground);
+
+/**
+ * Prints the summary of the pipeline that just finished on stderr, if "stats -p on" asked for it, then
+ * starts the summary of the next one.
+ */
+void stats_report(void);
+
+/**
+ * Frees the table of totals.
+ */
+void stats_clear(void);
+
+/**
+ * stats [-r] [-p on|off]: lists the resources used by each command since the shell started, resets them
+ * with -r, or prints a summary after each pipeline with -p on.
+ *
+ * @param args the arguments of the command, the last element is NULL
+ * @param block unused
+ * @return execution_success, or execution_failed if an option is not valid
+ */
+int builtin_stats(char **args, struct command *block);
+
+#endif
@@ -0,0 +1,216 @@
+#define _GNU_SOURCE // syscall
+
+#include "supervise.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+
+#include "output.h"
+#include "zygote.h"
+
+// Maximum number of events returned by each epoll_wait call
+#define SUPERVISE_EVENTS 16
+
+static int watch_fd = -1; // Epoll set of the watched processes, -1 until the first one is watched
+static pid_t *watched = NULL; // Process of each pidfd in the epoll set, indexed by file descriptor, 0 if none
+static size_t watched_capacity = 0;
+
+/**
+ * Collects the status of a process, which has already finished if its pidfd is readable.
+ * @return 0 on success, -1 if the process could not be waited for
+ */
+static int reap(struct supervised_child *child) {
+    if (zygote_wait(child->pid, &child->status, &child->usage) == 0) return 0;
+
+    while (wait4(child->pid, &child->status, 0, &child->usage) == -1) {
+        if (errno != EINTR) {
+            child->status = -1;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Sends SIGTERM to the processes that are still running when the deadline expires.
+ */
+static void kill_pending(struct supervised_child *children, const int *pidfds, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (pidfds[i] < 0) continue;
+
+        // The pidfd designates the process even if its pid is reused
+        if (syscall(SYS_pidfd_send_signal, pidfds[i], SIGTERM, NULL, 0) == 0) children[i].timed_out = 1;
+    }
+}
+
+/**
+ * Starts the timer of the deadline.
+ * @return the timerfd or -1 on error
+ */
+static int deadline_start(int epoll_fd, int64_t timeout_ns, size_t key) {
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (timer_fd == -1) {
+        perror("timerfd_create");
+        return -1;
+    }
+
+    // A zero value would disarm the timer, the deadline is at least one nanosecond away
+    if (timeout_ns < 1) timeout_ns = 1;
+    struct itimerspec deadline = {{0, 0}, {timeout_ns / 1000000000, timeout_ns % 1000000000}};
+    struct epoll_event event = {EPOLLIN, {.u64 = key}};
+
+    if (timerfd_settime(timer_fd, 0, &deadline, NULL) == -1 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event) == -1) {
+        perror("timerfd");
+        close(timer_fd);
+        return -1;
+    }
+    return timer_fd;
+}
+
+int supervise_wait(struct supervised_child *children, size_t count, int64_t timeout_ns) {
+    // The output of the shell is shown before it blocks, not when the processes finish
+    output_flush();
+
+    int *pidfds = malloc(count * sizeof(int)); // -1 if the process is not watched, -2 once it is done
+    if (pidfds == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return -1;
+    }
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    size_t pending = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        children[i].timed_out = 0;
+
+        // A process that cannot be watched, e.g. without pidfd support, is waited for at the end
+        pidfds[i] = epoll_fd == -1 ? -1 : (int) syscall(SYS_pidfd_open, children[i].pid, 0);
+        if (pidfds[i] == -1) continue;
+
+        struct epoll_event event = {EPOLLIN, {.u64 = i}};
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pidfds[i], &event) == -1) {
+            close(pidfds[i]);
+            pidfds[i] = -1;
+            continue;
+        }
+        pending++;
+    }
+
+    // The key of the timer is count, the keys of the processes are their indices
+    int timer_fd = -1;
+    if (timeout_ns >= 0 && pending > 0) timer_fd = deadline_start(epoll_fd, timeout_ns, count);
+
+    int result = 0;
+    while (pending > 0) {
+        struct epoll_event events[SUPERVISE_EVENTS];
+        int ready = epoll_wait(epoll_fd, events, SUPERVISE_EVENTS, -1);
+        if (ready == -1) {
+            if (errno == EINTR) continue; // SIGCHLD of a background job
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int e = 0; e < ready; e++) {
+            size_t i = events[e].data.u64;
+
+            if (i == count) {
+                uint64_t expirations;
+                ssize_t length = read(timer_fd, &expirations, sizeof(expirations));
+                (void) length;
+                kill_pending(children, pidfds, count);
+                continue;
+            }
+
+            if (reap(&children[i]) == -1) result = -1;
+            close(pidfds[i]); // Closing the pidfd also removes it from the epoll set
+            pidfds[i] = -2;
+            pending--;
+        }
+    }
+
+    // The processes that were not watched, and the ones left if epoll_wait failed
+    for (size_t i = 0; i < count; i++) {
+        if (pidfds[i] == -2) continue;
+        if (pidfds[i] >= 0) close(pidfds[i]);
+        if (reap(&children[i]) == -1) result = -1;
+    }
+
+    if (timer_fd != -1) close(timer_fd);
+    if (epoll_fd != -1) close(epoll_fd);
+    free(pidfds);
+    return result;
+}
+
+int supervise_watch(pid_t pid) {
+    if (watch_fd == -1) watch_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (watch_fd == -1) return -1;
+
+    int pidfd = (int) syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd == -1) return -1;
+
+    if ((size_t) pidfd >= watched_capacity) {
+        size_t capacity = watched_capacity ? watched_capacity : 64;
+        while (capacity <= (size_t) pidfd) capacity *= 2;
+
+        pid_t *table = realloc(watched, capacity * sizeof(pid_t));
+        if (table == NULL) {
+            close(pidfd);
+            return -1;
+        }
+        memset(table + watched_capacity, 0, (capacity - watched_capacity) * sizeof(pid_t));
+        watched = table;
+        watched_capacity = capacity;
+    }
+
+    struct epoll_event event = {EPOLLIN, {.fd = pidfd}};
+    if (epoll_ctl(watch_fd, EPOLL_CTL_ADD, pidfd, &event) == -1) {
+        close(pidfd);
+        return -1;
+    }
+
+    watched[pidfd] = pid;
+    return 0;
+}
+
+pid_t supervise_next(int timeout_ms) {
+    if (watch_fd == -1) return 0;
+
+    struct epoll_event event;
+    int ready;
+    while ((ready = epoll_wait(watch_fd, &event, 1, timeout_ms)) == -1 && errno == EINTR);
+    if (ready == -1) {
+        perror("epoll_wait");
+        return -1;
+    }
+    if (ready == 0) return 0;
+
+    pid_t pid = watched[event.data.fd];
+    watched[event.data.fd] = 0;
+    close(event.data.fd); // Closing the pidfd also removes it from the epoll set
+    return pid;
+}
+
+int supervise_fd(void) {
+    return watch_fd;
+}
+
+void supervise_close(void) {
+    for (size_t fd = 0; fd < watched_capacity; fd++) {
+        if (watched[fd] != 0) close((int) fd);
+    }
+    free(watched);
+    watched = NULL;
+    watched_capacity = 0;
+
+    if (watch_fd != -1) close(watch_fd);
+    watch_fd = -1;
+}
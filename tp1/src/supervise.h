@@ -0,0 +1,61 @@
+#ifndef TP1_SUPERVISE_H
+#define TP1_SUPERVISE_H
+
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+struct supervised_child {
+    pid_t pid; // Process to wait for, a child of the shell or a process launched by the zygote
+    int status; // Wait status, valid once the process is done
+    struct rusage usage; // Resources used by the process, valid once it is done
+    int timed_out; // 1 if the process was killed because it ran past the deadline, 0 otherwise
+};
+
+/**
+ * Waits for several processes at once, in the order in which they finish.
+ *
+ * A pidfd is opened for each process and they are multiplexed with epoll, together with a timerfd for
+ * the deadline. The processes still running at the deadline are sent SIGTERM and are then waited for.
+ * When pidfds are not supported, the processes are waited for one after the other and the deadline
+ * is not enforced.
+ *
+ * @param children the processes, their status, usage and timed_out fields are filled
+ * @param count the number of processes
+ * @param timeout_ns the time the processes may run for in nanoseconds, -1 for no deadline
+ * @return 0 on success, -1 if a process could not be waited for
+ */
+int supervise_wait(struct supervised_child *children, size_t count, int64_t timeout_ns);
+
+/**
+ * Watches a process that runs while the shell goes on, e.g. a background job or a list of parallel.
+ * A pidfd is opened for the process and added to an epoll set shared by all the watched processes, the
+ * process is not reaped when it finishes.
+ *
+ * @param pid the process, a child of the shell
+ * @return 0 on success, -1 if the process cannot be watched, e.g. without pidfd support
+ */
+int supervise_watch(pid_t pid);
+
+/**
+ * Finds a watched process that has finished, and stops watching it. The caller reaps it.
+ *
+ * @param timeout_ms the time to wait for a process to finish in milliseconds, -1 to block, 0 to return at once
+ * @return the process, 0 if none has finished, -1 on error
+ */
+pid_t supervise_next(int timeout_ms);
+
+/**
+ * Returns the epoll set of the watched processes, which is readable when one of them has finished.
+ *
+ * @return the file descriptor, -1 if no process has been watched yet
+ */
+int supervise_fd(void);
+
+/**
+ * Stops watching every process and closes the epoll set. Used at exit and by forked subshells, whose
+ * parent's processes are not their children.
+ */
+void supervise_close(void);
+
+#endif
@@ -0,0 +1,36 @@
+#include "timeout.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+
+#include "shell.h"
+
+int builtin_timeout_accepts(char *const *args) {
+    if (args[1] == NULL || args[2] == NULL) return 0;
+
+    // Digits with at most one decimal point, strtod would also take e.g. "inf" or "0x10"
+    int digits = 0;
+    int points = 0;
+    for (const char *c = args[1]; *c; c++) {
+        if (isdigit((unsigned char) *c)) digits++;
+        else if (*c == '.') points++;
+        else return 0;
+    }
+    return digits > 0 && points <= 1;
+}
+
+int builtin_timeout(char **args, struct command *block) {
+    (void) block;
+
+    double seconds = strtod(args[1], NULL);
+
+    // The command is a simple command made of the remaining arguments, which are already expanded
+    struct command command = {0};
+    command.type = CMD_SIMPLE;
+    command.args = args + 2;
+
+    pid_t pid = spawn_command(&command, -1, -1, -1);
+    if (pid < 0) return EXECUTION_FAILED;
+
+    return wait_command_timeout(pid, &command, seconds > 0 ? (int64_t) (seconds * 1e9) : -1);
+}
@@ -0,0 +1,31 @@
+#ifndef TP1_TIMEOUT_H
+#define TP1_TIMEOUT_H
+
+#include "parser.h"
+
+/**
+ * Tells whether the builtin runs a timeout command. The duration must be a plain number of seconds,
+ * the suffixes and the options of the timeout program, e.g. "1s" or "-s KILL", are left to it.
+ *
+ * @param args the arguments of the command, the last element is NULL
+ * @return 1 if the duration is a plain number followed by a command, 0 otherwise
+ */
+int builtin_timeout_accepts(char *const *args);
+
+/**
+ * timeout SECONDS command [arg]...: runs a command and sends it SIGTERM if it is still running after the
+ * given number of seconds, which may be fractional. 0 disables the deadline.
+ *
+ * Only one SIGTERM is sent, there is no SIGKILL afterwards: a command that ignores SIGTERM is waited
+ * for until it exits.
+ *
+ * The command is waited for with a pidfd and a timerfd, so the shell sleeps until either one fires.
+ * The status of a command that timed out is 124.
+ *
+ * @param args the arguments of the command, the last element is NULL
+ * @param block unused
+ * @return the execution status of the command
+ */
+int builtin_timeout(char **args, struct command *block);
+
+#endif
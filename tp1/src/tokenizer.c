@@ -1,249 +1,768 @@
-#include "tokenizer.h"
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <memory.h>
-
-int is_whitespace(char c) {
-    return c == ' ' || c == '\t' || c == '\r';
-}
-
-int is_operator(char c) {
-    return c == '&' || c == '|' || c == ';' || c == '\n';
-}
-
-int is_terminator(char c) {
-    return c == '\0' || c == EOF;
-}
-
-int is_symbol_char(char c) {
-    return !is_whitespace(c) && !is_operator(c) && !is_terminator(c);
-}
-
-char toEscaped(char c) {
-    switch (c) {
-        case 'a':
-            return '\a';
-        case 'b':
-            return '\b';
-        case 't':
-            return '\t';
-        case 'n':
-            return '\n';
-        case 'r':
-            return '\r';
-        case '\\':
-            return '\\';
-        case '\'':
-            return '\'';
-        case '\"':
-            return '\"';
-        case '0':
-            return '\0';
-        default:
-            return c;
-    }
-}
-
-void buffer_check_sub(char **buffer, int *buffer_size, int i) {
-    if (i < *buffer_size - 1) return;
-    *buffer_size = *buffer_size + (*buffer_size >> 1); // Grow buffer by 1.5x
-    char *new_buffer = realloc(*buffer, *buffer_size);
-    if (!new_buffer) // Reallocation failed
-    {
-        free(*buffer);
-        *buffer = NULL;
-    }
-    *buffer = new_buffer;
-}
-
-char *read_string_literal(char c) {
-    char end = c;
-
-    int buffer_size = 32;
-    char *buffer = malloc(buffer_size);
-
-    if (!buffer) return NULL; // String buffer allocation failed
-
-    int i = 0;
-
-    for (;;) {
-        c = (char) getchar();
-        if (c == end) break; // End of string literal
-        if (c == EOF) // Unexpected EOF
-        {
-            free(buffer);
-            return NULL;
-        }
-
-        if (c == '\\') // Escape character
-        {
-            c = (char) getchar();
-            char es = toEscaped(c);
-
-            if (c == EOF || es == c) // Invalid escape sequence
-            {
-                free(buffer);
-                return NULL;
-            }
-
-            c = es;
-        }
-
-        buffer[i++] = c;
-        buffer_check_sub(&buffer, &buffer_size, i);
-        if (buffer == NULL) return NULL; // Grow buffer failed
-    }
-
-    buffer[i] = '\0';
-    return buffer;
-}
-
-char *read_symbol(char c) {
-    if (!is_symbol_char(c)) return NULL; // No symbol start character
-
-    int buffer_size = 64;
-    char *buffer = malloc(buffer_size);
-
-    if (!buffer) return NULL; // String buffer allocation failed
-
-    int i = 1;
-    buffer[0] = c;
-
-    for (;;) {
-        c = (char) getchar();
-        if (!is_symbol_char(c)) {
-            ungetc(c, stdin);
-            break;
-        }
-
-        buffer[i++] = c;
-        buffer_check_sub(&buffer, &buffer_size, i);
-        if (buffer == NULL) return NULL; // Grow buffer failed
-    }
-
-    buffer[i] = '\0';
-    return buffer;
-}
-
-
-struct token *tok_next(void) {
-    // Skip whitespace
-    signed char c;
-    while (is_whitespace(c = (signed char) getchar()));
-
-    // End of input
-    if (c == EOF) return NULL;
-
-    // Create token
-
-    struct token *token = malloc(sizeof(struct token));
-    memset(token, 0, sizeof(struct token)); // Zero initialize
-
-    switch (c) {
-        case '\n':
-            token->category = TOK_NEWLINE;
-            break;
-        case ';':
-            token->category = TOK_SEMICOLON;
-            break;
-        case '|': {
-            signed char peek = (signed char) getchar();
-            if (peek == '|') token->category = TOK_LOGICAL_OR;
-            else {
-                token->category = TOK_PIPE;
-                ungetc(peek, stdin);
-            }
-            break;
-        }
-        case '&': {
-            signed char peek = (signed char) getchar();
-            if (peek == '&') token->category = TOK_LOGICAL_AND;
-            else ungetc(peek, stdin);
-            break;
-        }
-        case '\"': // Fallthrough
-        case '\'': {
-            token->category = TOK_STRING_LITERAL;
-            token->value = read_string_literal(c);
-
-            if (!token->value) // Failed to read string literal
-            {
-                free(token);
-                return NULL;
-            }
-
-            break;
-        }
-        default: // Symbol
-        {
-            token->category = TOK_SYMBOL;
-            token->value = read_symbol(c);
-
-            if (!token->value) // Failed to read symbol
-            {
-                free(token);
-                return NULL;
-            }
-
-            break;
-        }
-    }
-
-    return token;
-}
-
-struct token *tok_next_line(void) {
-    struct token token_sentinel = {NULL, NULL, TOK_INVALID};
-    struct token *tokens = &token_sentinel;
-
-    struct token *token;
-    while ((token = tok_next())) {
-        tokens->next = token;
-        tokens = token;
-
-        if (token->category == TOK_NEWLINE) break;
-    }
-
-    return token_sentinel.next;
-}
-
-void tok_free(struct token *tokens) {
-    for (struct token *token = tokens, *next; token; token = next) {
-        next = token->next;
-        free(token->value);
-        free(token);
-    }
-}
-
-void tok_debug_print(const struct token *tokens) {
-    for (const struct token *token = tokens; token; token = token->next) {
-        switch (token->category) {
-            case TOK_SYMBOL:
-                printf("TOK_SYMBOL(%s)\n", token->value);
-                break;
-            case TOK_STRING_LITERAL:
-                printf("TOK_STRING_LITERAL(%s)\n", token->value);
-                break;
-            case TOK_PIPE:
-                printf("TOK_PIPE\n");
-                break;
-            case TOK_LOGICAL_AND:
-                printf("TOK_LOGICAL_AND\n");
-                break;
-            case TOK_LOGICAL_OR:
-                printf("TOK_LOGICAL_OR\n");
-                break;
-            case TOK_SEMICOLON:
-                printf("TOK_SEMICOLON\n");
-                break;
-            case TOK_NEWLINE:
-                printf("TOK_NEWLINE\n");
-                break;
-            default:
-                printf("TOK_INVALID\n");
-                break;
-        }
-    }
-}
-
+#include "tokenizer.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+// In-memory input, NULL when the tokens are read from the standard input. The state is per thread, the
+// parse-ahead thread reads the standard input while the shell tokenizes command substitutions.
+static _Thread_local const char *input_cursor = NULL;
+static _Thread_local const char *input_end = NULL;
+
+// Block of the standard input being tokenized. It is read with read rather than stdio: at exit, a forked
+// child would seek the shared file offset back to the position of its copy of the stdio buffer.
+#define STDIN_BUFFER_SIZE 8192
+static char stdin_buffer[STDIN_BUFFER_SIZE];
+static size_t stdin_position = 0;
+static size_t stdin_length = 0;
+static int stdin_eof = 0;
+static int stdin_interrupt_fd = -1; // Interrupts the reads of the standard input when it is readable
+
+// Characters of the standard input read since the start of the current line. Like the tokenizer of the
+// standard input, they are not per thread: a single thread reads the input, and a child forked by another
+// thread still references them
+static char *line_text = NULL;
+static size_t line_length = 0;
+static size_t line_capacity = 0;
+static int line_resumed = 0; // The last call to tok_next_line stopped in the middle of a line
+
+enum tok_mode {
+    MODE_START = 0, // Between two tokens
+    MODE_OPERATOR, // After "|", "&", ">" or "2", which may start an operator of two characters
+    MODE_SYMBOL,
+    MODE_STRING, // In quotes, a string literal or the value of an assignment
+    MODE_ESCAPE, // After a "\" in quotes
+    MODE_SUBSTITUTION, // In a "$(...)", copied as is
+};
+
+struct tok_state {
+    enum tok_mode mode;
+    enum tok_mode resume; // Mode that continues after the ")" of a substitution
+    char quote; // Quote of the current string
+    char operator; // First character of the current operator
+    char substitution_quote; // Quote opened in the current substitution, 0 if there is none
+    int depth; // Open parentheses of the current substitution
+    int dollar; // The last character is a "$" that may start a substitution
+    int backslash; // The last character is a "\" outside of quotes, which continues the line before a newline
+
+    struct token *token; // Token being read, NULL between two tokens
+    char *value; // Value of the token being read
+    size_t length;
+    size_t capacity;
+
+    struct token *line; // Tokens of the current line
+    struct token **tail;
+    enum token_category last; // Category of the last token of the line, TOK_INVALID if there is none
+    int in_command; // The last token is part of a command, "for", "while" and "done" are only keywords before one
+    char *nesting; // Constructs open on the line: '{' for a block, '(' for a subshell, 'l' for a loop
+    size_t nesting_depth;
+    size_t nesting_capacity;
+    int complete; // The line ends with a newline or the end of the input
+    const char *error; // First error of the line, which is then dropped
+};
+
+static struct tok_state stdin_state;
+static _Thread_local struct tok_state memory_state;
+
+static void step(struct tok_state *state, char c);
+
+/**
+ * Appends a chunk of input to the text of the current line. The text is only used for the history, a
+ * chunk that does not fit is dropped.
+ */
+void line_record(const char *input, size_t length) {
+    if (line_length + length > line_capacity) {
+        size_t capacity = line_capacity ? line_capacity : 128;
+        while (capacity < line_length + length) capacity *= 2;
+        char *text = realloc(line_text, capacity);
+        if (!text) return;
+        line_text = text;
+        line_capacity = capacity;
+    }
+    memcpy(line_text + line_length, input, length);
+    line_length += length;
+}
+
+/**
+ * Reads the next block of the standard input.
+ * @return the number of bytes read, 0 at the end of the input or if the read was interrupted
+ */
+size_t read_stdin(void) {
+    // The read only starts once the input is ready, so that the interrupt can stop a reader that would block
+    if (stdin_interrupt_fd != -1) {
+        struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {stdin_interrupt_fd, POLLIN, 0}};
+        int ready = poll(fds, 2, -1);
+        if ((ready == -1 && errno == EINTR) || (ready > 0 && fds[1].revents)) return 0;
+    }
+
+    ssize_t length = read(STDIN_FILENO, stdin_buffer, STDIN_BUFFER_SIZE);
+    if (length <= 0) {
+        if (length == 0 || errno != EINTR) stdin_eof = 1;
+        return 0;
+    }
+    stdin_position = 0;
+    stdin_length = (size_t) length;
+    return stdin_length;
+}
+
+void tok_set_interrupt_fd(int fd) {
+    stdin_interrupt_fd = fd;
+}
+
+void tok_set_input(const char *buffer, size_t length) {
+    input_cursor = buffer;
+    input_end = buffer ? buffer + length : NULL;
+
+    // A line left unfinished by the previous buffer does not continue in this one
+    tok_state_reset(&memory_state);
+}
+
+int tok_eof(void) {
+    if (!input_cursor) return stdin_eof;
+    return input_cursor >= input_end;
+}
+
+int is_whitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+int is_operator(char c) {
+    return c == '&' || c == '|' || c == ';' || c == '\n' || c == '<' || c == '>' || c == '(' || c == ')';
+}
+
+int is_terminator(char c) {
+    return c == '\0' || c == EOF;
+}
+
+int is_symbol_char(char c) {
+    return !is_whitespace(c) && !is_operator(c) && !is_terminator(c);
+}
+
+/**
+ * Determines whether a symbol is the start of an assignment, i.e., a name followed by "=".
+ */
+int is_assignment_prefix(const char *buffer, int length) {
+    if (length < 2 || buffer[length - 1] != '=') return 0;
+    if (!isalpha((unsigned char) buffer[0]) && buffer[0] != '_') return 0;
+
+    for (int i = 1; i < length - 1; i++) {
+        if (!isalnum((unsigned char) buffer[i]) && buffer[i] != '_') return 0;
+    }
+    return 1;
+}
+
+char toEscaped(char c) {
+    switch (c) {
+        case 'a':
+            return '\a';
+        case 'b':
+            return '\b';
+        case 't':
+            return '\t';
+        case 'n':
+            return '\n';
+        case 'r':
+            return '\r';
+        case '\\':
+            return '\\';
+        case '\'':
+            return '\'';
+        case '\"':
+            return '\"';
+        case '0':
+            return '\0';
+        default:
+            return c;
+    }
+}
+
+/**
+ * Records an error of the current line, only the first one is kept.
+ */
+static void fail(struct tok_state *state, const char *message) {
+    if (state->error == NULL) state->error = message;
+}
+
+/**
+ * Opens a block, a subshell or a loop, the line goes on until it is closed.
+ */
+static void nest(struct tok_state *state, char construct) {
+    if (state->nesting_depth == state->nesting_capacity) {
+        size_t capacity = state->nesting_capacity ? state->nesting_capacity * 2 : 8;
+        char *nesting = realloc(state->nesting, capacity);
+        if (!nesting) {
+            fail(state, "Memory allocation error");
+            return;
+        }
+        state->nesting = nesting;
+        state->nesting_capacity = capacity;
+    }
+    state->nesting[state->nesting_depth++] = construct;
+}
+
+/**
+ * Closes the innermost construct if it is of the given kind, the parser reports the other closings.
+ */
+static void unnest(struct tok_state *state, char construct) {
+    if (state->nesting_depth > 0 && state->nesting[state->nesting_depth - 1] == construct) {
+        state->nesting_depth--;
+    }
+}
+
+/**
+ * Follows the constructs opened and closed by a token, with the same rules as the parser: "{" and "}"
+ * are recognized anywhere, "for", "while" and "done" only at the start of a command.
+ */
+static void track(struct tok_state *state, const struct token *token) {
+    int command_start = !state->in_command;
+    state->last = token->category;
+
+    switch (token->category) {
+        case TOK_SEMICOLON:
+        case TOK_NEWLINE:
+        case TOK_PIPE:
+        case TOK_LOGICAL_AND:
+        case TOK_LOGICAL_OR:
+        case TOK_BACKGROUND:
+            state->in_command = 0;
+            return;
+        case TOK_OPEN_PAREN:
+            state->in_command = 0;
+            nest(state, '(');
+            return;
+        case TOK_CLOSE_PAREN:
+            state->in_command = 1;
+            unnest(state, '(');
+            return;
+        case TOK_SYMBOL:
+            break;
+        default:
+            state->in_command = 1;
+            return;
+    }
+
+    state->in_command = 1;
+    if (token->quote != 0) return;
+
+    if (strcmp(token->value, "{") == 0) {
+        state->in_command = 0;
+        nest(state, '{');
+    } else if (strcmp(token->value, "}") == 0) {
+        unnest(state, '{');
+    } else if (!command_start) {
+        return;
+    } else if (strcmp(token->value, "for") == 0 || strcmp(token->value, "while") == 0) {
+        nest(state, 'l');
+    } else if (strcmp(token->value, "do") == 0) {
+        state->in_command = 0;
+    } else if (strcmp(token->value, "done") == 0) {
+        unnest(state, 'l');
+    }
+}
+
+/**
+ * Adds a token to the current line.
+ */
+static void emit(struct tok_state *state, struct token *token) {
+    *state->tail = token;
+    state->tail = &token->next;
+    track(state, token);
+}
+
+/**
+ * Adds a token without value to the current line.
+ */
+static void emit_operator(struct tok_state *state, enum token_category category) {
+    struct token *token = calloc(1, sizeof(struct token));
+    if (!token) {
+        fail(state, "Memory allocation error");
+        return;
+    }
+
+    token->category = category;
+    emit(state, token);
+    // A newline in an open construct only separates two of its commands
+    if (category == TOK_NEWLINE && state->nesting_depth == 0) state->complete = 1;
+}
+
+/**
+ * Starts a token with a value, its characters are then appended one by one.
+ */
+static void begin_token(struct tok_state *state, enum token_category category, char quote) {
+    state->token = calloc(1, sizeof(struct token));
+    state->capacity = 32;
+    state->value = malloc(state->capacity);
+    if (!state->token || !state->value) fail(state, "Memory allocation error");
+
+    if (state->token) {
+        state->token->category = category;
+        state->token->quote = quote;
+    }
+    state->length = 0;
+    state->dollar = 0;
+}
+
+/**
+ * Appends a character to the value of the current token, the value grows by 1.5x.
+ */
+static void append(struct tok_state *state, char c) {
+    if (!state->value) return; // Allocation failed, the line is dropped
+
+    if (state->length + 1 >= state->capacity) {
+        state->capacity += state->capacity >> 1;
+        char *value = realloc(state->value, state->capacity);
+        if (!value) {
+            free(state->value);
+            state->value = NULL;
+            fail(state, "Memory allocation error");
+            return;
+        }
+        state->value = value;
+    }
+    state->value[state->length++] = c;
+}
+
+/**
+ * Ends the current token and adds it to the line.
+ */
+static void finish_token(struct tok_state *state) {
+    struct token *token = state->token;
+    state->token = NULL;
+    state->mode = MODE_START;
+    state->dollar = 0;
+
+    if (!token || !state->value) {
+        free(token);
+        free(state->value);
+        state->value = NULL;
+        return;
+    }
+
+    state->value[state->length] = '\0';
+    token->value = state->value;
+    state->value = NULL;
+    emit(state, token);
+}
+
+/**
+ * Starts a symbol with its first character.
+ */
+static void begin_symbol(struct tok_state *state) {
+    begin_token(state, TOK_SYMBOL, 0);
+    state->mode = MODE_SYMBOL;
+}
+
+/**
+ * Reads the first character of a token.
+ */
+static void step_start(struct tok_state *state, char c) {
+    if (is_whitespace(c) || c == '\0') return;
+
+    switch (c) {
+        case '\\':
+            state->backslash = 1;
+            return;
+        case '\n':
+            // The command goes on after the operator
+            if (state->last == TOK_PIPE || state->last == TOK_LOGICAL_AND || state->last == TOK_LOGICAL_OR) return;
+            emit_operator(state, TOK_NEWLINE);
+            return;
+        case ';':
+            emit_operator(state, TOK_SEMICOLON);
+            return;
+        case '(':
+            emit_operator(state, TOK_OPEN_PAREN);
+            return;
+        case ')':
+            emit_operator(state, TOK_CLOSE_PAREN);
+            return;
+        case '<':
+            emit_operator(state, TOK_REDIRECT_INPUT);
+            return;
+        case '|': // Fallthrough
+        case '&':
+        case '>':
+        case '2': // "2>" redirects the standard error, a 2 followed by anything else starts a symbol
+            state->operator = c;
+            state->mode = MODE_OPERATOR;
+            return;
+        case '\"': // Fallthrough
+        case '\'':
+            begin_token(state, TOK_STRING_LITERAL, c);
+            state->quote = c;
+            state->mode = MODE_STRING;
+            return;
+        default:
+            begin_symbol(state);
+            step(state, c);
+            return;
+    }
+}
+
+/**
+ * Reads the character that follows the first character of an operator.
+ */
+static void step_operator(struct tok_state *state, char c) {
+    state->mode = MODE_START;
+
+    // The category when the operator is doubled, then when it is alone
+    enum token_category doubled;
+    enum token_category single;
+    switch (state->operator) {
+        case '|':
+            doubled = TOK_LOGICAL_OR;
+            single = TOK_PIPE;
+            break;
+        case '&':
+            doubled = TOK_LOGICAL_AND;
+            single = TOK_BACKGROUND;
+            break;
+        case '>':
+            doubled = TOK_REDIRECT_APPEND;
+            single = TOK_REDIRECT_OUTPUT;
+            break;
+        default:
+            if (c == '>') {
+                emit_operator(state, TOK_REDIRECT_ERROR);
+                return;
+            }
+            begin_symbol(state);
+            append(state, '2');
+            step(state, c);
+            return;
+    }
+
+    if (c == state->operator) {
+        emit_operator(state, doubled);
+        return;
+    }
+    emit_operator(state, single);
+    step(state, c);
+}
+
+/**
+ * Starts a command substitution, the "$(" has been appended.
+ */
+static void begin_substitution(struct tok_state *state) {
+    state->resume = state->mode;
+    state->mode = MODE_SUBSTITUTION;
+    state->depth = 1;
+    state->substitution_quote = 0;
+    state->dollar = 0;
+}
+
+/**
+ * Reads a character of a symbol. A command substitution is part of the symbol, even if it contains spaces
+ * or operators, and the value of an assignment may be quoted.
+ */
+static void step_symbol(struct tok_state *state, char c) {
+    if (state->dollar && c == '(') {
+        append(state, c);
+        begin_substitution(state);
+        return;
+    }
+    state->dollar = 0;
+
+    if (c == '\\') {
+        state->backslash = 1;
+        return;
+    }
+
+    // The value of an assignment may be quoted, the word is then expanded as a string literal
+    if ((c == '\"' || c == '\'') && state->value && is_assignment_prefix(state->value, (int) state->length)) {
+        if (state->token) state->token->quote = c;
+        state->quote = c;
+        state->mode = MODE_STRING;
+        return;
+    }
+
+    if (!is_symbol_char(c)) {
+        finish_token(state);
+        step(state, c);
+        return;
+    }
+
+    append(state, c);
+    state->dollar = c == '$';
+}
+
+/**
+ * Reads a character in quotes. Command substitutions are expanded in double quotes, their own quotes do
+ * not end the string.
+ */
+static void step_string(struct tok_state *state, char c) {
+    if (c == state->quote) {
+        finish_token(state);
+        return;
+    }
+
+    if (state->dollar && c == '(') {
+        append(state, c);
+        begin_substitution(state);
+        return;
+    }
+    state->dollar = 0;
+
+    if (c == '\\') {
+        state->mode = MODE_ESCAPE;
+        return;
+    }
+
+    append(state, c);
+    state->dollar = c == '$' && state->quote == '\"';
+}
+
+/**
+ * Reads the character that follows a "\" in quotes.
+ */
+static void step_escape(struct tok_state *state, char c) {
+    state->mode = MODE_STRING;
+    if (c == '\n') return; // Line continuation
+
+    char es = toEscaped(c);
+    if (es == c) fail(state, "Parsing error: invalid escape sequence");
+    append(state, es);
+}
+
+/**
+ * Reads a character of a command substitution. Quotes and nested parentheses are kept as is, the command
+ * is tokenized when the substitution runs.
+ */
+static void step_substitution(struct tok_state *state, char c) {
+    append(state, c);
+
+    if (state->substitution_quote) {
+        if (c == state->substitution_quote) state->substitution_quote = 0;
+    } else if (c == '\'' || c == '\"') {
+        state->substitution_quote = c;
+    } else if (c == '(') {
+        state->depth++;
+    } else if (c == ')' && --state->depth == 0) {
+        state->mode = state->resume;
+    }
+}
+
+/**
+ * Advances the state machine by one character.
+ */
+static void step(struct tok_state *state, char c) {
+    // A "\" followed by a newline continues the line, before anything else it is part of a symbol
+    if (state->backslash) {
+        state->backslash = 0;
+        if (c == '\n') return;
+
+        if (state->mode == MODE_START) begin_symbol(state);
+        append(state, '\\');
+    }
+
+    switch (state->mode) {
+        case MODE_START:
+            step_start(state, c);
+            break;
+        case MODE_OPERATOR:
+            step_operator(state, c);
+            break;
+        case MODE_SYMBOL:
+            step_symbol(state, c);
+            break;
+        case MODE_STRING:
+            step_string(state, c);
+            break;
+        case MODE_ESCAPE:
+            step_escape(state, c);
+            break;
+        case MODE_SUBSTITUTION:
+            step_substitution(state, c);
+            break;
+    }
+}
+
+struct tok_state *tok_state_new(void) {
+    struct tok_state *state = calloc(1, sizeof(struct tok_state));
+    if (state) state->tail = &state->line;
+    return state;
+}
+
+void tok_state_reset(struct tok_state *state) {
+    free(state->token);
+    free(state->value);
+    tok_free(state->line);
+    free(state->nesting);
+    *state = (struct tok_state) {0};
+    state->tail = &state->line;
+}
+
+void tok_state_free(struct tok_state *state) {
+    if (!state) return;
+    tok_state_reset(state);
+    free(state);
+}
+
+int tok_feed(struct tok_state *state, const char *input, size_t length, size_t *consumed) {
+    if (!state->tail) state->tail = &state->line;
+
+    size_t i = 0;
+    while (i < length && !state->complete) step(state, input[i++]);
+
+    *consumed = i;
+    return state->complete;
+}
+
+int tok_feed_end(struct tok_state *state) {
+    if (!state->tail) state->tail = &state->line;
+    if (state->complete) return 1;
+
+    // A null character ends the current symbol or operator, a "\" just before it is part of a symbol
+    if (state->mode == MODE_START || state->mode == MODE_OPERATOR || state->mode == MODE_SYMBOL) {
+        step(state, '\0');
+    } else if (state->mode == MODE_SUBSTITUTION) {
+        fail(state, "Parsing error: missing )");
+    } else {
+        fail(state, "Parsing error: missing closing quote");
+    }
+
+    state->complete = state->line != NULL || state->error != NULL;
+    return state->complete;
+}
+
+struct token *tok_take_line(struct tok_state *state) {
+    if (!state->complete) return NULL;
+
+    struct token *line = state->line;
+    state->line = NULL;
+    if (state->error) {
+        fprintf(stderr, "%s\n", state->error);
+        tok_free(line);
+        line = NULL;
+    }
+
+    // The partial token of a dropped line is not continued
+    tok_state_reset(state);
+    return line;
+}
+
+struct token *tok_next_line(void) {
+    struct tok_state *state = input_cursor ? &memory_state : &stdin_state;
+    if (!input_cursor) {
+        if (!line_resumed) line_length = 0;
+        line_resumed = 0;
+    }
+
+    while (!state->complete) {
+        const char *input;
+        size_t length;
+
+        if (input_cursor) {
+            if (input_cursor >= input_end) {
+                tok_feed_end(state);
+                break;
+            }
+            input = input_cursor;
+            length = (size_t) (input_end - input_cursor);
+        } else {
+            if (stdin_position == stdin_length && read_stdin() == 0) {
+                if (stdin_eof) {
+                    tok_feed_end(state);
+                    break;
+                }
+
+                // Interrupted by a signal, the next call continues the line where it stopped
+                line_resumed = 1;
+                return NULL;
+            }
+            input = stdin_buffer + stdin_position;
+            length = stdin_length - stdin_position;
+        }
+
+        size_t consumed;
+        tok_feed(state, input, length, &consumed);
+
+        if (input_cursor) {
+            input_cursor += consumed;
+        } else {
+            line_record(input, consumed);
+            stdin_position += consumed;
+        }
+    }
+
+    return tok_take_line(state);
+}
+
+const char *tok_line_text(size_t *length) {
+    *length = line_length;
+    return line_text ? line_text : "";
+}
+
+void tok_release(void) {
+    tok_state_reset(&stdin_state);
+    tok_state_reset(&memory_state);
+    free(line_text);
+    line_text = NULL;
+    line_length = 0;
+    line_capacity = 0;
+}
+
+void tok_free(struct token *tokens) {
+    for (struct token *token = tokens, *next; token; token = next) {
+        next = token->next;
+        free(token->value);
+        free(token);
+    }
+}
+
+void tok_debug_print(const struct token *tokens) {
+    for (const struct token *token = tokens; token; token = token->next) {
+        switch (token->category) {
+            case TOK_SYMBOL:
+                printf("TOK_SYMBOL(%s)\n", token->value);
+                break;
+            case TOK_STRING_LITERAL:
+                printf("TOK_STRING_LITERAL(%s)\n", token->value);
+                break;
+            case TOK_PIPE:
+                printf("TOK_PIPE\n");
+                break;
+            case TOK_LOGICAL_AND:
+                printf("TOK_LOGICAL_AND\n");
+                break;
+            case TOK_LOGICAL_OR:
+                printf("TOK_LOGICAL_OR\n");
+                break;
+            case TOK_SEMICOLON:
+                printf("TOK_SEMICOLON\n");
+                break;
+            case TOK_NEWLINE:
+                printf("TOK_NEWLINE\n");
+                break;
+            case TOK_BACKGROUND:
+                printf("TOK_BACKGROUND\n");
+                break;
+            case TOK_REDIRECT_INPUT:
+                printf("TOK_REDIRECT_INPUT\n");
+                break;
+            case TOK_REDIRECT_OUTPUT:
+                printf("TOK_REDIRECT_OUTPUT\n");
+                break;
+            case TOK_REDIRECT_APPEND:
+                printf("TOK_REDIRECT_APPEND\n");
+                break;
+            case TOK_REDIRECT_ERROR:
+                printf("TOK_REDIRECT_ERROR\n");
+                break;
+            case TOK_OPEN_PAREN:
+                printf("TOK_OPEN_PAREN\n");
+                break;
+            case TOK_CLOSE_PAREN:
+                printf("TOK_CLOSE_PAREN\n");
+                break;
+            default:
+                printf("TOK_INVALID\n");
+                break;
+        }
+    }
+}
+
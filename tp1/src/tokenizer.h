@@ -1,53 +1,153 @@
-#ifndef TP1_TOKENIZER_H
-#define TP1_TOKENIZER_H
-
-enum token_category {
-    TOK_INVALID = 0,
-    TOK_SYMBOL,
-    TOK_STRING_LITERAL,
-    TOK_SEMICOLON,
-    TOK_PIPE,
-    TOK_LOGICAL_AND,
-    TOK_LOGICAL_OR,
-    TOK_NEWLINE
-};
-
-struct token {
-    struct token *next; // Token suivant
-    char *value; // Valeur du token, NULL si le token n'a pas de valeur
-    enum token_category category; // Catégorie du token
-};
-
-/**
- * Cette fonction lit le prochain token depuis l'entrée standard.
- *
- * @return le prochain token ou NULL si la fin de l'entrée est atteinte
- */
-struct token* tok_next(void);
-
-/**
- * Cette fonction lit une ligne de tokens depuis l'entrée standard.
- * Une ligne se termine par un token de catégorie TOK_NEWLINE ou NULL si la fin de l'entrée est atteinte.
- *
- * @return la liste de tokens ou NULL si la fin de l'entrée est atteinte
- */
-struct token* tok_next_line(void);
-
-/**
- * Cette fonction libère la mémoire allouée pour une liste de tokens.
- *
- * @param tokens list chainée de tokens
- */
-void tok_free(struct token* tokens);
-
-/**
- * Cette fonction affiche une liste de tokens.
- * Utilisé pour le débogage.
- *
- * @param tokens list chainée de tokens
- */
-void tok_debug_print(const struct token* tokens);
-
-
-
-#endif
+#ifndef TP1_TOKENIZER_H
+#define TP1_TOKENIZER_H
+
+#include <stddef.h>
+
+enum token_category {
+    TOK_INVALID = 0,
+    TOK_SYMBOL,
+    TOK_STRING_LITERAL,
+    TOK_SEMICOLON,
+    TOK_PIPE,
+    TOK_LOGICAL_AND,
+    TOK_LOGICAL_OR,
+    TOK_NEWLINE,
+    TOK_BACKGROUND,
+    TOK_REDIRECT_INPUT,
+    TOK_REDIRECT_OUTPUT,
+    TOK_REDIRECT_APPEND,
+    TOK_REDIRECT_ERROR,
+    TOK_OPEN_PAREN,
+    TOK_CLOSE_PAREN
+};
+
+struct token {
+    struct token *next; // Token suivant
+    char *value; // Valeur du token, NULL si le token n'a pas de valeur
+    enum token_category category; // Catégorie du token
+    char quote; // Guillemet qui entoure une chaîne ('\'' ou '"'), 0 pour les autres tokens
+};
+
+/**
+ * Cette fonction remplace l'entrée standard par un tampon en mémoire pour les prochains tokens.
+ * Le tampon doit rester valide tant que des tokens sont lus; les tokens ne le référencent pas.
+ *
+ * @param buffer le tampon à lire ou NULL pour revenir à l'entrée standard
+ * @param length la taille du tampon
+ */
+void tok_set_input(const char *buffer, size_t length);
+
+/**
+ * Cette fonction permet d'interrompre les lectures de l'entrée standard. Quand le descripteur devient
+ * lisible, une lecture qui attend l'entrée retourne comme si elle avait été interrompue par un signal.
+ *
+ * @param fd le descripteur qui interrompt les lectures, ou -1 pour n'en utiliser aucun
+ */
+void tok_set_interrupt_fd(int fd);
+
+/**
+ * Cette fonction indique si la fin de l'entrée a été atteinte.
+ *
+ * @return 1 si toute l'entrée a été lue, 0 sinon
+ */
+int tok_eof(void);
+
+// État d'un tokenizer qui reçoit son entrée par morceaux
+struct tok_state;
+
+/**
+ * Cette fonction crée un tokenizer incrémental. Il s'arrête à la fin de chaque morceau d'entrée et reprend
+ * au même endroit avec le suivant, sans relire les caractères déjà traités: une chaîne entre guillemets,
+ * un "$(...)", un bloc "{", une sous-commande "(" ou une boucle ouverts, ou une ligne qui se termine par
+ * "\", "&&", "||" ou "|" continuent sur les lignes suivantes.
+ *
+ * @return le tokenizer, à libérer avec tok_state_free, ou NULL si l'allocation a échoué
+ */
+struct tok_state *tok_state_new(void);
+
+/**
+ * Cette fonction abandonne la ligne en cours d'un tokenizer.
+ *
+ * @param state le tokenizer
+ */
+void tok_state_reset(struct tok_state *state);
+
+/**
+ * Cette fonction libère un tokenizer et la ligne en cours.
+ *
+ * @param state le tokenizer
+ */
+void tok_state_free(struct tok_state *state);
+
+/**
+ * Cette fonction donne un morceau d'entrée au tokenizer. La lecture s'arrête après le caractère qui
+ * termine une ligne complète, le reste du morceau est à redonner après tok_take_line.
+ *
+ * @param state le tokenizer
+ * @param input le morceau d'entrée
+ * @param length la taille du morceau
+ * @param consumed reçoit le nombre de caractères lus
+ * @return 1 si une ligne complète est prête, 0 s'il faut plus d'entrée
+ */
+int tok_feed(struct tok_state *state, const char *input, size_t length, size_t *consumed);
+
+/**
+ * Cette fonction indique au tokenizer la fin de l'entrée, qui termine la ligne en cours.
+ * Une chaîne ou un "$(...)" qui n'est pas fermé est une erreur.
+ *
+ * @param state le tokenizer
+ * @return 1 si une dernière ligne est prête, 0 sinon
+ */
+int tok_feed_end(struct tok_state *state);
+
+/**
+ * Cette fonction retire la ligne complète du tokenizer. Une ligne qui contient une erreur est abandonnée
+ * et l'erreur est affichée.
+ *
+ * @param state le tokenizer
+ * @return la liste de tokens de la ligne, NULL si elle n'est pas complète ou contient une erreur
+ */
+struct token *tok_take_line(struct tok_state *state);
+
+/**
+ * Cette fonction lit une ligne de tokens depuis l'entrée standard.
+ * Une ligne se termine par un token de catégorie TOK_NEWLINE ou NULL si la fin de l'entrée est atteinte.
+ * Une lecture interrompue par un signal retourne NULL et le prochain appel continue la même ligne.
+ *
+ * @return la liste de tokens ou NULL si la fin de l'entrée est atteinte
+ */
+struct token* tok_next_line(void);
+
+/**
+ * Cette fonction retourne le texte lu sur l'entrée standard par le dernier appel à tok_next_line, tel
+ * qu'il a été écrit. Le texte reste valide jusqu'à la prochaine lecture de l'entrée standard.
+ *
+ * @param length reçoit la longueur du texte, qui n'est pas terminé par un caractère nul
+ * @return le texte de la ligne
+ */
+const char *tok_line_text(size_t *length);
+
+/**
+ * Cette fonction libère la ligne en cours du thread courant, ainsi que la ligne en cours et le texte de
+ * l'entrée standard. Le thread qui lit l'entrée standard l'appelle avant de se terminer.
+ */
+void tok_release(void);
+
+/**
+ * Cette fonction libère la mémoire allouée pour une liste de tokens.
+ *
+ * @param tokens list chainée de tokens
+ */
+void tok_free(struct token* tokens);
+
+/**
+ * Cette fonction affiche une liste de tokens.
+ * Utilisé pour le débogage.
+ *
+ * @param tokens list chainée de tokens
+ */
+void tok_debug_print(const struct token* tokens);
+
+
+
+#endif
@@ -0,0 +1,197 @@
+#define _GNU_SOURCE // MAP_POPULATE
+
+#include "trace.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+struct trace_event {
+    const char *name; // String literal, valid in the children since they are forks of the shell
+    uint64_t start; // Nanoseconds
+    uint64_t duration; // Nanoseconds, 0 for instant events
+    pid_t pid;
+    char phase; // 'X' for spans, 'i' for instant events
+    char detail[TRACE_DETAIL_LENGTH];
+};
+
+struct trace_buffer {
+    atomic_size_t count; // Number of slots taken, may exceed the capacity
+    struct trace_event events[TRACE_CAPACITY];
+};
+
+static struct trace_buffer *buffer = NULL; // Shared with the children, NULL when tracing is disabled
+static const char *output_path = NULL;
+static pid_t shell_pid;
+static uint64_t trace_start;
+static struct timeval children_user;
+static struct timeval children_system;
+
+static uint64_t clock_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Takes a slot in the buffer and fills it. Only atomic operations are used, the children and the
+ * signal handlers of the shell record events concurrently.
+ */
+static void trace_record(const char *name, char phase, uint64_t start, uint64_t duration, pid_t pid,
+                         const char *detail) {
+    size_t slot = atomic_fetch_add(&buffer->count, 1);
+    if (slot >= TRACE_CAPACITY) return; // Buffer full, the event is dropped
+
+    struct trace_event *event = &buffer->events[slot];
+    event->name = name;
+    event->start = start;
+    event->duration = duration;
+    event->pid = pid;
+    event->phase = phase;
+
+    size_t i = 0;
+    if (detail) {
+        for (; detail[i] && i < TRACE_DETAIL_LENGTH - 1; i++) event->detail[i] = detail[i];
+    }
+    event->detail[i] = '\0';
+}
+
+int trace_enabled(void) {
+    return buffer != NULL;
+}
+
+uint64_t trace_now(void) {
+    return buffer ? clock_now() : 0;
+}
+
+void trace_span(const char *name, uint64_t start, const char *detail) {
+    if (!buffer) return;
+    uint64_t end = clock_now();
+    trace_record(name, 'X', start, end - start, getpid(), detail);
+}
+
+void trace_instant(const char *name, pid_t pid, const char *detail) {
+    if (!buffer) return;
+    trace_record(name, 'i', clock_now(), 0, pid, detail);
+}
+
+void trace_rusage(const struct rusage *usage) {
+    if (!buffer) return;
+    timeradd(&children_user, &usage->ru_utime, &children_user);
+    timeradd(&children_system, &usage->ru_stime, &children_system);
+}
+
+/**
+ * Writes a string as a JSON string literal.
+ */
+static void json_write_string(FILE *file, const char *string) {
+    fputc('"', file);
+    for (const char *c = string; *c; c++) {
+        if (*c == '"' || *c == '\\') fprintf(file, "\\%c", *c);
+        else if ((unsigned char) *c < 0x20) fprintf(file, "\\u%04x", *c);
+        else fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+/**
+ * Writes the events as Chrome trace-event JSON, with timestamps in microseconds.
+ */
+static void trace_write_json(size_t count) {
+    FILE *file = fopen(output_path, "w");
+    if (file == NULL) {
+        perror(output_path);
+        return;
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    int first = 1;
+    for (size_t i = 0; i < count; i++) {
+        const struct trace_event *event = &buffer->events[i];
+        if (event->name == NULL) continue; // Slot taken by a process that did not fill it
+
+        fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+        first = 0;
+        json_write_string(file, event->name);
+        fprintf(file, ",\"cat\":\"shell\",\"ph\":\"%c\",\"ts\":%.3f,", event->phase,
+                (double) (event->start - trace_start) / 1000.0);
+        if (event->phase == 'X') fprintf(file, "\"dur\":%.3f,", (double) event->duration / 1000.0);
+        else fprintf(file, "\"s\":\"p\",");
+        fprintf(file, "\"pid\":%d,\"tid\":%d,\"args\":{\"detail\":", event->pid, event->pid);
+        json_write_string(file, event->detail);
+        fprintf(file, "}}");
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ns\"}\n");
+
+    fclose(file);
+}
+
+/**
+ * Prints a time-style summary: the time spent in each phase, then the real time of the shell and the
+ * CPU time of its children.
+ */
+static void trace_print_summary(size_t count, size_t recorded) {
+    static const char *phases[] = {"tokenize", "parse", "pipe", "fork", "wait"};
+
+    fprintf(stderr, "\n%-10s %8s %12s %10s\n", "phase", "count", "total (ms)", "avg (us)");
+    for (size_t p = 0; p < sizeof(phases) / sizeof(phases[0]); p++) {
+        size_t phase_count = 0;
+        uint64_t total = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (buffer->events[i].name && strcmp(buffer->events[i].name, phases[p]) == 0) {
+                phase_count++;
+                total += buffer->events[i].duration;
+            }
+        }
+        fprintf(stderr, "%-10s %8zu %12.3f %10.3f\n", phases[p], phase_count, (double) total / 1e6,
+                phase_count ? (double) total / 1e3 / (double) phase_count : 0.0);
+    }
+    if (recorded > count) fprintf(stderr, "(%zu events dropped, the trace buffer is full)\n", recorded - count);
+
+    uint64_t real = clock_now() - trace_start;
+    fprintf(stderr, "\nreal\t%lum%.3fs\n", real / 60000000000, (double) (real % 60000000000) / 1e9);
+    fprintf(stderr, "user\t%ldm%ld.%03lds\n", children_user.tv_sec / 60, children_user.tv_sec % 60,
+            (long) children_user.tv_usec / 1000);
+    fprintf(stderr, "sys\t%ldm%ld.%03lds\n", children_system.tv_sec / 60, children_system.tv_sec % 60,
+            (long) children_system.tv_usec / 1000);
+}
+
+/**
+ * Writes the trace when the shell exits. The children run their exit handlers too, they are ignored.
+ */
+static void trace_finish(void) {
+    if (!buffer || getpid() != shell_pid) return;
+
+    size_t recorded = atomic_load(&buffer->count);
+    size_t count = recorded < TRACE_CAPACITY ? recorded : TRACE_CAPACITY;
+
+    trace_write_json(count);
+    trace_print_summary(count, recorded);
+
+    munmap(buffer, sizeof(struct trace_buffer));
+    buffer = NULL;
+}
+
+void trace_init(void) {
+    output_path = getenv("SHELL_TRACE");
+    if (output_path == NULL || output_path[0] == '\0') return;
+
+    // Allocate and fault in the whole buffer now, so that recording an event never allocates
+    buffer = mmap(NULL, sizeof(struct trace_buffer), PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (buffer == MAP_FAILED) {
+        perror("mmap");
+        buffer = NULL;
+        return;
+    }
+    atomic_init(&buffer->count, 0);
+
+    shell_pid = getpid();
+    trace_start = clock_now();
+    atexit(trace_finish);
+}
@@ -0,0 +1,62 @@
+#ifndef TP1_TRACE_H
+#define TP1_TRACE_H
+
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+// Maximum number of events recorded, the buffer is allocated once when tracing starts
+#define TRACE_CAPACITY 65536
+
+// Maximum length of the detail of an event, e.g. the name of the command
+#define TRACE_DETAIL_LENGTH 32
+
+/**
+ * Starts tracing if the SHELL_TRACE environment variable names an output file.
+ *
+ * The events are written to that file as Chrome trace-event JSON when the shell exits, and a
+ * time-style summary is printed on stderr. The event buffer is shared with the children, so that
+ * they can record when they exec.
+ */
+void trace_init(void);
+
+/**
+ * Determines whether the shell is traced.
+ *
+ * @return 1 if tracing is enabled, 0 otherwise
+ */
+int trace_enabled(void);
+
+/**
+ * Returns the current time for the start of a span.
+ *
+ * @return the monotonic time in nanoseconds, or 0 if tracing is disabled
+ */
+uint64_t trace_now(void);
+
+/**
+ * Records a span that started at the given time and ends now.
+ *
+ * @param name the name of the span, a string literal
+ * @param start the start of the span, as returned by trace_now
+ * @param detail the detail of the span, e.g. the name of the command, or NULL
+ */
+void trace_span(const char *name, uint64_t start, const char *detail);
+
+/**
+ * Records an instant event. This function is async-signal-safe.
+ *
+ * @param name the name of the event, a string literal
+ * @param pid the process the event belongs to
+ * @param detail the detail of the event, e.g. the name of the command, or NULL
+ */
+void trace_instant(const char *name, pid_t pid, const char *detail);
+
+/**
+ * Adds the resources used by a child, as returned by wait4, to the summary.
+ *
+ * @param usage the resources used by the child
+ */
+void trace_rusage(const struct rusage *usage);
+
+#endif
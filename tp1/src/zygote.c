@@ -0,0 +1,399 @@
+#define _GNU_SOURCE // environ
+
+#include "zygote.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "trace.h"
+
+/**
+ * A launch request starts with this header, followed by the arguments then the environment variables
+ * of the command, each one terminated by a '\0'. The standard file descriptors are attached with
+ * SCM_RIGHTS.
+ */
+struct zygote_request {
+    uint32_t argc; // Number of arguments
+    uint32_t envc; // Number of environment variables
+};
+
+enum zygote_event_type {
+    ZYGOTE_STARTED = 0,
+    ZYGOTE_EXITED,
+};
+
+/**
+ * Message sent by the zygote to the shell.
+ */
+struct zygote_event {
+    enum zygote_event_type type;
+    pid_t pid; // Command the event is about, -1 if it could not be launched
+    int error; // errno of the failed launch
+    int status; // Wait status of the command that exited
+    struct rusage usage; // Resources used by the command that exited
+};
+
+/**
+ * A command launched by the zygote that the shell has not waited for yet.
+ */
+struct zygote_child {
+    pid_t pid;
+    int exited; // 1 once the exit of the command was received
+    int status;
+    struct rusage usage;
+};
+
+static int zygote_socket = -1; // Shell end of the socket, -1 if there is no zygote
+static pid_t zygote_pid = -1;
+static pid_t owner_pid = -1; // Process that started the zygote
+static struct zygote_child *children = NULL;
+static size_t child_count = 0;
+static size_t child_capacity = 0;
+
+// Request being built by the shell or received by the zygote, they are separate processes
+static char message[ZYGOTE_MESSAGE_SIZE];
+
+/*
+ * Zygote side
+ */
+
+static void zygote_send(int socket, const struct zygote_event *event) {
+    while (send(socket, event, sizeof(struct zygote_event), MSG_NOSIGNAL) == -1 && errno == EINTR);
+}
+
+/**
+ * Forks and executes the command of a request.
+ */
+static void zygote_launch(int socket, int signal_fd, size_t length, const int fds[3]) {
+    struct zygote_event event = {.type = ZYGOTE_STARTED, .pid = -1, .error = E2BIG};
+
+    struct zygote_request request;
+    memcpy(&request, message, sizeof(request));
+
+    size_t count = (size_t) request.argc + request.envc;
+    char **strings = malloc((count + 2) * sizeof(char *));
+    if (strings == NULL || request.argc == 0) {
+        free(strings);
+        zygote_send(socket, &event);
+        return;
+    }
+
+    // Split the strings, the arguments and the environment each end with NULL
+    char **argv = strings;
+    char **envp = strings + request.argc + 1;
+    char *cursor = message + sizeof(request);
+    char *end = message + length;
+    size_t i = 0;
+    for (; i < count && cursor < end; i++) {
+        if (i < request.argc) argv[i] = cursor;
+        else envp[i - request.argc] = cursor;
+        cursor += strnlen(cursor, end - cursor) + 1;
+    }
+    argv[request.argc] = NULL;
+    envp[request.envc] = NULL;
+
+    if (i < count || cursor > end) { // Malformed request
+        free(strings);
+        zygote_send(socket, &event);
+        return;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+
+        for (int fd = 0; fd < 3; fd++) dup2(fds[fd], fd);
+        for (int fd = 0; fd < 3; fd++) close(fds[fd]);
+        close(socket);
+        close(signal_fd);
+
+        trace_instant("exec", getpid(), argv[0]);
+        // The path is searched with the PATH of the command, not the one the zygote started with
+        environ = envp;
+        execvp(argv[0], argv);
+
+        fprintf(stderr, "%s: command not found\n", argv[0]);
+        _exit(EXIT_FAILURE);
+    }
+
+    event.pid = pid;
+    event.error = pid == -1 ? errno : 0;
+    free(strings);
+    zygote_send(socket, &event);
+}
+
+/**
+ * Sends the exit of every command that has finished.
+ */
+static void zygote_reap(int socket) {
+    struct zygote_event event = {.type = ZYGOTE_EXITED};
+    while ((event.pid = wait4(-1, &event.status, WNOHANG, &event.usage)) > 0) zygote_send(socket, &event);
+}
+
+/**
+ * Main loop of the zygote: launches the commands requested by the shell and reports their exits, until
+ * the shell closes the socket.
+ */
+_Noreturn static void zygote_main(int socket, pid_t shell_pid) {
+    // The zygote must not outlive the shell
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (getppid() != shell_pid) _exit(EXIT_SUCCESS);
+
+    // The commands receive their standard file descriptors with the requests, the zygote keeps none
+    int dev_null = open("/dev/null", O_RDWR);
+    if (dev_null != -1) {
+        for (int fd = 0; fd < 3; fd++) dup2(dev_null, fd);
+        if (dev_null > 2) close(dev_null);
+    }
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    int signal_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+
+    struct pollfd pollfds[2] = {{socket, POLLIN, 0}, {signal_fd, POLLIN, 0}};
+    for (;;) {
+        if (poll(pollfds, 2, -1) == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (pollfds[1].revents) {
+            struct signalfd_siginfo info;
+            while (read(signal_fd, &info, sizeof(info)) > 0);
+            zygote_reap(socket);
+        }
+
+        if (pollfds[0].revents) {
+            union {
+                char buffer[CMSG_SPACE(3 * sizeof(int))];
+                struct cmsghdr align;
+            } control;
+            struct iovec iov = {message, sizeof(message)};
+            struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buffer,
+                                 .msg_controllen = sizeof(control.buffer)};
+
+            ssize_t length = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+            if (length == -1 && errno == EINTR) continue;
+            if (length <= 0) break; // The shell closed the socket
+
+            int fds[3] = {-1, -1, -1};
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            int has_fds = cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+                          cmsg->cmsg_len == CMSG_LEN(sizeof(fds));
+            if (has_fds) memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+            if (has_fds && (size_t) length >= sizeof(struct zygote_request) && !(msg.msg_flags & MSG_TRUNC)) {
+                zygote_launch(socket, signal_fd, length, fds);
+            } else {
+                struct zygote_event event = {.type = ZYGOTE_STARTED, .pid = -1, .error = EINVAL};
+                zygote_send(socket, &event);
+            }
+
+            for (int fd = 0; fd < 3; fd++) {
+                if (fds[fd] != -1) close(fds[fd]);
+            }
+        }
+    }
+
+    _exit(EXIT_SUCCESS);
+}
+
+/*
+ * Shell side
+ */
+
+void zygote_start(void) {
+    const char *mode = getenv("SHELL_ZYGOTE");
+    if (mode == NULL || mode[0] == '\0' || strcmp(mode, "0") == 0) return;
+
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) == -1) {
+        perror("socketpair");
+        return;
+    }
+
+    pid_t shell_pid = getpid();
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(sockets[0]);
+        close(sockets[1]);
+        return;
+    }
+
+    if (pid == 0) {
+        close(sockets[0]);
+        zygote_main(sockets[1], shell_pid);
+    }
+
+    close(sockets[1]);
+    zygote_socket = sockets[0];
+    zygote_pid = pid;
+    owner_pid = shell_pid;
+}
+
+/**
+ * Forgets the zygote, e.g. when it died. The commands that were not waited for are considered failed.
+ */
+static void zygote_lost(void) {
+    close(zygote_socket);
+    zygote_socket = -1;
+
+    for (size_t i = 0; i < child_count; i++) {
+        if (children[i].exited) continue;
+        children[i].exited = 1;
+        children[i].status = EXIT_FAILURE << 8;
+        memset(&children[i].usage, 0, sizeof(struct rusage));
+    }
+}
+
+int zygote_active(void) {
+    if (zygote_socket == -1) return 0;
+    if (getpid() == owner_pid) return 1;
+
+    // A forked subshell does not share the zygote of its parent
+    close(zygote_socket);
+    zygote_socket = -1;
+    child_count = 0;
+    return 0;
+}
+
+static struct zygote_child *child_find(pid_t pid) {
+    for (size_t i = 0; i < child_count; i++) {
+        if (children[i].pid == pid) return &children[i];
+    }
+    return NULL;
+}
+
+/**
+ * Receives the next event of the zygote. The exits are recorded in the table of the children.
+ * @return 0 on success, -1 if the zygote is lost
+ */
+static int zygote_receive(struct zygote_event *event) {
+    ssize_t length;
+    while ((length = recv(zygote_socket, event, sizeof(struct zygote_event), 0)) == -1 && errno == EINTR);
+
+    if (length != sizeof(struct zygote_event)) {
+        fprintf(stderr, "zygote: connection lost\n");
+        zygote_lost();
+        return -1;
+    }
+
+    if (event->type == ZYGOTE_EXITED) {
+        struct zygote_child *child = child_find(event->pid);
+        if (child != NULL) {
+            child->exited = 1;
+            child->status = event->status;
+            child->usage = event->usage;
+        }
+    }
+
+    return 0;
+}
+
+pid_t zygote_spawn(char *const argv[], char *const envp[], const int fds[3]) {
+    if (child_count == child_capacity) {
+        size_t capacity = child_capacity ? child_capacity * 2 : 16;
+        struct zygote_child *table = realloc(children, capacity * sizeof(struct zygote_child));
+        if (table == NULL) return ZYGOTE_UNAVAILABLE;
+        children = table;
+        child_capacity = capacity;
+    }
+
+    // Serialize the request, commands that do not fit are forked by the shell
+    struct zygote_request request = {0, 0};
+    size_t length = sizeof(request);
+    for (int list = 0; list < 2; list++) {
+        char *const *strings = list == 0 ? argv : envp;
+        uint32_t *count = list == 0 ? &request.argc : &request.envc;
+        for (; strings[*count]; (*count)++) {
+            size_t size = strlen(strings[*count]) + 1;
+            if (length + size > sizeof(message)) return ZYGOTE_UNAVAILABLE;
+            memcpy(message + length, strings[*count], size);
+            length += size;
+        }
+    }
+    memcpy(message, &request, sizeof(request));
+
+    union {
+        char buffer[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = {message, length};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buffer,
+                         .msg_controllen = sizeof(control.buffer)};
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, 3 * sizeof(int));
+
+    ssize_t sent;
+    while ((sent = sendmsg(zygote_socket, &msg, MSG_NOSIGNAL)) == -1 && errno == EINTR);
+    if (sent == -1) {
+        if (errno == EMSGSIZE) return ZYGOTE_UNAVAILABLE;
+        fprintf(stderr, "zygote: connection lost\n");
+        zygote_lost();
+        return ZYGOTE_UNAVAILABLE;
+    }
+
+    // Wait for the pid, the exits of other commands are recorded on the way
+    struct zygote_event event;
+    do {
+        if (zygote_receive(&event) == -1) return -1;
+    } while (event.type != ZYGOTE_STARTED);
+
+    if (event.pid == -1) {
+        fprintf(stderr, "Fork failed: %s\n", strerror(event.error));
+        return -1;
+    }
+
+    struct zygote_child *child = &children[child_count++];
+    memset(child, 0, sizeof(struct zygote_child));
+    child->pid = event.pid;
+    return event.pid;
+}
+
+int zygote_wait(pid_t pid, int *status, struct rusage *usage) {
+    struct zygote_child *child = child_find(pid);
+    if (child == NULL) return -1;
+
+    struct zygote_event event;
+    while (!child->exited && zygote_receive(&event) == 0);
+
+    *status = child->status;
+    *usage = child->usage;
+
+    // Forget the command, the last one takes its place
+    *child = children[--child_count];
+    return 0;
+}
+
+void zygote_stop(void) {
+    if (zygote_socket != -1 && getpid() == owner_pid) {
+        close(zygote_socket);
+        waitpid(zygote_pid, NULL, 0);
+    }
+    zygote_socket = -1;
+
+    free(children);
+    children = NULL;
+    child_count = 0;
+    child_capacity = 0;
+}
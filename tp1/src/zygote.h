@@ -0,0 +1,59 @@
+#ifndef TP1_ZYGOTE_H
+#define TP1_ZYGOTE_H
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+// Maximum size of a launch request, i.e., of the arguments and environment of a command
+#define ZYGOTE_MESSAGE_SIZE 131072
+
+// Returned by zygote_spawn when the command must be forked by the shell itself
+#define ZYGOTE_UNAVAILABLE (-2)
+
+/**
+ * Starts the zygote if the SHELL_ZYGOTE environment variable is set to a value other than "0".
+ *
+ * The zygote is a helper process forked while the shell is still small. It launches the external
+ * commands of the shell: the shell sends it the arguments, the environment and the standard file
+ * descriptors of a command over a Unix socket, the zygote forks and executes it, then sends back its
+ * pid and, later, its wait status. Forking the small zygote is cheaper than forking the shell.
+ *
+ * Commands launched by the zygote run in the working directory the shell was started in.
+ */
+void zygote_start(void);
+
+/**
+ * Determines whether commands can be launched by the zygote. Only the process that started the
+ * zygote uses it, subshells fork their commands themselves.
+ *
+ * @return 1 if the zygote is running and owned by the current process, 0 otherwise
+ */
+int zygote_active(void);
+
+/**
+ * Launches a command through the zygote.
+ *
+ * @param argv the arguments of the command, the last element is NULL
+ * @param envp the environment of the command, the last element is NULL
+ * @param fds the standard input, output and error of the command
+ * @return the pid of the command, -1 if it could not be launched, or ZYGOTE_UNAVAILABLE if the
+ * zygote cannot launch it and the shell must fork it itself
+ */
+pid_t zygote_spawn(char *const argv[], char *const envp[], const int fds[3]);
+
+/**
+ * Blocks until a command launched by the zygote has finished.
+ *
+ * @param pid the pid returned by zygote_spawn
+ * @param status receives the wait status of the command
+ * @param usage receives the resources used by the command
+ * @return 0 on success, -1 if the command was not launched by the zygote
+ */
+int zygote_wait(pid_t pid, int *status, struct rusage *usage);
+
+/**
+ * Stops the zygote and releases the memory used to track its commands.
+ */
+void zygote_stop(void);
+
+#endif
@@ -0,0 +1,404 @@
+/**
+ * Compares the throughput of the ready queue with the previous implementation, a mutex per priority level
+ * and a node allocated by each push, when 2 to 64 threads use it at the same time.
+ *
+ * The queue starts with one process per thread, then each thread pops a process and pushes it back, so
+ * that the queue is never empty for long and the threads contend on it rather than sleep. Three workloads
+ * are measured: every process at MAX_PRIORITY_LEVEL, the FIFO level, processes spread over all the
+ * levels with random lengths, so that the sorted levels are used too, and a backlog of thousands of
+ * processes on the sorted levels, with a tenth of the operations. Once the threads are done, the queue is
+ * drained to check that each process is still in it exactly once.
+ *
+ * The removal of every queued process is also timed, each one is removed from the sorted levels and
+ * pushed back to MAX_PRIORITY_LEVEL + 1, for backlogs of 1024 to 65536 processes. The time per process
+ * should not grow with the backlog.
+ *
+ * The calls to malloc are counted by wrapping it at link time, to report the allocations per operation.
+ *
+ * Usage: ready_queue_bench [operations per thread] [maximum number of threads]
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "process.h"
+#include "ready_queue.h"
+
+// Number of processes queued by the backlog workload
+#define BACKLOG 4096
+
+////
+//// Allocation counter
+////
+
+static atomic_size_t allocations;
+
+void *__real_malloc(size_t size);
+
+void *__wrap_malloc(size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+////
+//// Previous implementation
+////
+
+typedef struct mutex_queue mutex_queue_t;
+
+struct mutex_queue {
+    pthread_cond_t cond;
+    pthread_mutex_t wait_mutex;
+
+    pthread_mutex_t queue_mutex[NUM_PRIORITY_LEVELS];
+    node_t *head[NUM_PRIORITY_LEVELS];
+    node_t *tail[NUM_PRIORITY_LEVELS];
+    size_t size[NUM_PRIORITY_LEVELS];
+};
+
+static void mutex_queue_init(mutex_queue_t *queue) {
+    for (int i = 0; i < NUM_PRIORITY_LEVELS; i++) {
+        queue->head[i] = NULL;
+        queue->tail[i] = NULL;
+        queue->size[i] = 0;
+        pthread_mutex_init(&queue->queue_mutex[i], NULL);
+    }
+    pthread_mutex_init(&queue->wait_mutex, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+}
+
+static void mutex_queue_destroy(mutex_queue_t *queue) {
+    for (int i = 0; i < NUM_PRIORITY_LEVELS; i++) {
+        pthread_mutex_destroy(&queue->queue_mutex[i]);
+    }
+    pthread_mutex_destroy(&queue->wait_mutex);
+    pthread_cond_destroy(&queue->cond);
+}
+
+static void mutex_queue_push(mutex_queue_t *queue, process_t *process) {
+    int priority = process->priority_level;
+
+    node_t *new_node = malloc(sizeof(node_t));
+    if (new_node == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_lock(&queue->queue_mutex[priority]);
+
+    new_node->process = process;
+    new_node->next = NULL;
+    new_node->prev = NULL;
+    if (priority == MAX_PRIORITY_LEVEL) {
+        if (queue->tail[priority] != NULL) {
+            new_node->next = queue->tail[priority];
+            queue->tail[priority]->prev = new_node;
+        } else {
+            queue->head[priority] = new_node;
+        }
+        queue->tail[priority] = new_node;
+    } else {
+        node_t *prev = NULL;
+        node_t *current = queue->tail[priority];
+        while (current != NULL) {
+            if (current->process->burst_length + current->process->io_length <
+                process->burst_length + process->io_length) {
+                break;
+            }
+            prev = current;
+            current = current->next;
+        }
+
+        new_node->next = current;
+        new_node->prev = prev;
+        if (prev != NULL) {
+            prev->next = new_node;
+        } else {
+            queue->tail[priority] = new_node;
+        }
+        if (current != NULL) {
+            current->prev = new_node;
+        } else {
+            queue->head[priority] = new_node;
+        }
+    }
+    queue->size[priority]++;
+
+    pthread_mutex_unlock(&queue->queue_mutex[priority]);
+
+    // The signal is sent under the mutex of the sleepers, the previous implementation could lose it
+    pthread_mutex_lock(&queue->wait_mutex);
+    pthread_cond_signal(&queue->cond);
+    pthread_mutex_unlock(&queue->wait_mutex);
+}
+
+static process_t *mutex_queue_pop(mutex_queue_t *queue) {
+    int priority = -1;
+    while (1) {
+        for (int i = 0; i < NUM_PRIORITY_LEVELS; i++) {
+            pthread_mutex_lock(&queue->queue_mutex[i]);
+            if (queue->size[i] > 0) {
+                priority = i;
+                break;
+            }
+            pthread_mutex_unlock(&queue->queue_mutex[i]);
+        }
+        if (priority != -1) break;
+
+        pthread_mutex_lock(&queue->wait_mutex);
+        int empty = 1;
+        for (int i = 0; i < NUM_PRIORITY_LEVELS; i++) {
+            pthread_mutex_lock(&queue->queue_mutex[i]);
+            empty = empty && queue->size[i] == 0;
+            pthread_mutex_unlock(&queue->queue_mutex[i]);
+        }
+        if (empty) pthread_cond_wait(&queue->cond, &queue->wait_mutex);
+        pthread_mutex_unlock(&queue->wait_mutex);
+    }
+
+    node_t *head = queue->head[priority];
+    process_t *process = head->process;
+
+    queue->size[priority]--;
+    queue->head[priority] = head->prev;
+    if (queue->head[priority] == NULL) {
+        queue->tail[priority] = NULL;
+    } else {
+        queue->head[priority]->next = NULL;
+    }
+
+    pthread_mutex_unlock(&queue->queue_mutex[priority]);
+    free(head);
+    return process;
+}
+
+////
+//// Benchmark
+////
+
+typedef enum {
+    QUEUE_MUTEX,
+    QUEUE_LOCK_FREE,
+} queue_kind_t;
+
+typedef struct bench_run bench_run_t;
+
+struct bench_run {
+    queue_kind_t kind;
+    mutex_queue_t mutex_queue;
+    ready_queue_t ready_queue;
+    size_t operations; // Pops and pushes done by each thread
+    pthread_barrier_t start;
+};
+
+static uint64_t clock_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void bench_push(bench_run_t *run, process_t *process) {
+    if (run->kind == QUEUE_MUTEX) {
+        mutex_queue_push(&run->mutex_queue, process);
+    } else {
+        ready_queue_push(&run->ready_queue, process);
+    }
+}
+
+static process_t *bench_pop(bench_run_t *run) {
+    if (run->kind == QUEUE_MUTEX) {
+        return mutex_queue_pop(&run->mutex_queue);
+    }
+    return ready_queue_pop(&run->ready_queue);
+}
+
+static void *bench_thread(void *user_data) {
+    bench_run_t *run = (bench_run_t *) user_data;
+    pthread_barrier_wait(&run->start);
+    for (size_t i = 0; i < run->operations; i++) {
+        bench_push(run, bench_pop(run));
+    }
+    return NULL;
+}
+
+struct bench_result {
+    double throughput; // Operations per second, a pop and a push each, 0 if a process was lost
+    double allocations; // Calls to malloc per operation
+};
+
+/**
+ * Runs the threads on one implementation.
+ */
+static struct bench_result bench(queue_kind_t kind, process_t **processes, size_t count, size_t threads,
+                                 size_t operations) {
+    bench_run_t *run = malloc(sizeof(bench_run_t));
+    pthread_t *ids = malloc(threads * sizeof(pthread_t));
+    int *seen = calloc(count, sizeof(int));
+    if (run == NULL || ids == NULL || seen == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    run->kind = kind;
+    run->operations = operations;
+    if (kind == QUEUE_MUTEX) {
+        mutex_queue_init(&run->mutex_queue);
+    } else {
+        ready_queue_init(&run->ready_queue);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        bench_push(run, processes[i]);
+    }
+
+    // The threads are created before the count starts, since pthread_create allocates their stacks
+    pthread_barrier_init(&run->start, NULL, threads + 1);
+    for (size_t i = 0; i < threads; i++) {
+        pthread_create(&ids[i], NULL, bench_thread, run);
+    }
+    size_t allocations_before = atomic_load(&allocations);
+    uint64_t start = clock_now();
+    pthread_barrier_wait(&run->start);
+    for (size_t i = 0; i < threads; i++) {
+        pthread_join(ids[i], NULL);
+    }
+    uint64_t elapsed = clock_now() - start;
+    size_t allocated = atomic_load(&allocations) - allocations_before;
+    pthread_barrier_destroy(&run->start);
+
+    int valid = 1;
+    for (size_t i = 0; i < count; i++) {
+        process_t *process = bench_pop(run);
+        if (process == NULL || seen[process->pid]++) valid = 0;
+    }
+
+    if (kind == QUEUE_MUTEX) {
+        mutex_queue_destroy(&run->mutex_queue);
+    } else {
+        ready_queue_destroy(&run->ready_queue);
+    }
+    free(seen);
+    free(ids);
+    free(run);
+
+    struct bench_result result;
+    result.throughput = valid ? (double) (threads * operations) / ((double) elapsed / 1e9) : 0;
+    result.allocations = (double) allocated / (double) (threads * operations);
+    return result;
+}
+
+/**
+ * Runs a workload from 2 to max_threads threads.
+ *
+ * @param first_level the processes are spread over the levels from first_level to last_level
+ * @param backlog the number of processes in the queue, max_threads if it is smaller
+ */
+static void bench_workload(const char *name, int first_level, int last_level, size_t backlog, size_t max_threads,
+                           size_t operations) {
+    size_t count = backlog > max_threads ? backlog : max_threads;
+    process_t **processes = malloc(count * sizeof(process_t *));
+    if (processes == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    srand(1);
+    for (size_t i = 0; i < count; i++) {
+        processes[i] = create_process((int) i);
+        processes[i]->priority_level = first_level + (int) (i % (last_level - first_level + 1));
+        if (last_level != MAX_PRIORITY_LEVEL) {
+            processes[i]->burst_length = rand() % 1000;
+            processes[i]->io_length = rand() % 1000;
+        }
+    }
+
+    printf("\n%s", name);
+    if (backlog > 0) printf(", %zu processes queued", backlog);
+    printf("\n%8s %16s %16s %8s %14s %14s\n", "threads", "mutex ops/s", "lock-free ops/s", "speedup",
+           "mutex allocs", "lock-free allocs");
+    for (size_t threads = 2; threads <= max_threads; threads *= 2) {
+        size_t queued = backlog > threads ? backlog : threads;
+        struct bench_result mutex = bench(QUEUE_MUTEX, processes, queued, threads, operations);
+        struct bench_result lock_free = bench(QUEUE_LOCK_FREE, processes, queued, threads, operations);
+        if (mutex.throughput == 0 || lock_free.throughput == 0) {
+            fprintf(stderr, "A process was lost with %zu threads\n", threads);
+            exit(EXIT_FAILURE);
+        }
+        printf("%8zu %16.0f %16.0f %7.2fx %14.4f %14.4f\n", threads, mutex.throughput, lock_free.throughput,
+               lock_free.throughput / mutex.throughput, mutex.allocations, lock_free.allocations);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        destroy_process(processes[i]);
+    }
+    free(processes);
+}
+
+/**
+ * Removes every queued process and pushes it back to MAX_PRIORITY_LEVEL + 1.
+ */
+static void bench_remove(void) {
+    printf("\nRemoval of every queued process\n%8s %16s %16s\n", "queued", "ns per removal", "total ms");
+    for (size_t count = 1024; count <= 65536; count *= 4) {
+        process_t **processes = malloc(count * sizeof(process_t *));
+        ready_queue_t *queue = malloc(sizeof(ready_queue_t));
+        if (processes == NULL || queue == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+
+        srand(1);
+        ready_queue_init(queue);
+        for (size_t i = 0; i < count; i++) {
+            processes[i] = create_process((int) i);
+            processes[i]->priority_level = MAX_PRIORITY_LEVEL + 2 + (int) (i % (MIN_PRIORITY_LEVEL - 1));
+            processes[i]->burst_length = rand() % 1000;
+            processes[i]->io_length = rand() % 1000;
+            ready_queue_push(queue, processes[i]);
+        }
+
+        uint64_t start = clock_now();
+        for (size_t i = 0; i < count; i++) {
+            if (!ready_queue_remove(queue, processes[i])) {
+                fprintf(stderr, "Process %zu was not found in the queue\n", i);
+                exit(EXIT_FAILURE);
+            }
+            processes[i]->priority_level = MAX_PRIORITY_LEVEL + 1;
+            ready_queue_push(queue, processes[i]);
+        }
+        uint64_t elapsed = clock_now() - start;
+        printf("%8zu %16.1f %16.3f\n", count, (double) elapsed / (double) count, (double) elapsed / 1e6);
+
+        ready_queue_destroy(queue);
+        for (size_t i = 0; i < count; i++) {
+            destroy_process(processes[i]);
+        }
+        free(queue);
+        free(processes);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t operations = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    size_t max_threads = argc > 2 ? strtoul(argv[2], NULL, 10) : 64;
+    if (operations == 0 || max_threads < 2) {
+        fprintf(stderr, "Usage: %s [operations per thread] [maximum number of threads]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%zu pops and pushes per thread", operations);
+
+    bench_workload("Every process at MAX_PRIORITY_LEVEL", MAX_PRIORITY_LEVEL, MAX_PRIORITY_LEVEL, 0, max_threads,
+                   operations);
+    bench_workload("Processes spread over the levels", MAX_PRIORITY_LEVEL, MIN_PRIORITY_LEVEL, 0, max_threads,
+                   operations);
+    bench_workload("Backlog on the sorted levels", MAX_PRIORITY_LEVEL + 1,
+                   MIN_PRIORITY_LEVEL, BACKLOG, max_threads, operations / 10 + 1);
+    bench_remove();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,5 @@
+#
+# Benchmarks
+#
+
+option(BUILD_BENCHMARKS "Build benchmarks" OFF)
@@ -0,0 +1,148 @@
+#include "boost.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "process.h"
+#include "worker.h"
+
+// Timers are linked in the slot of their deadline, a slot holds the timers of every turn of the wheel
+static boost_timer_t *wheel[BOOST_WHEEL_SIZE];
+static uint64_t cursor; // Next tick to expire
+static uint64_t epoch; // Time of tick 0 in milliseconds
+
+static pthread_mutex_t wheel_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t thread;
+static int running = 0;
+
+static uint64_t boost_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static process_t *process_of(boost_timer_t *timer) {
+    return (process_t *) ((char *) timer - offsetof(process_t, boost));
+}
+
+// Unlinks a timer from its slot, the mutex of the wheel must be held
+static void timer_unlink(boost_timer_t *timer) {
+    if (timer->prev != NULL) {
+        timer->prev->next = timer->next;
+    } else {
+        wheel[timer->deadline & (BOOST_WHEEL_SIZE - 1)] = timer->next;
+    }
+    if (timer->next != NULL) timer->next->prev = timer->prev;
+
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->scheduled = 0;
+}
+
+static void *boost_thread(void *user_data) {
+    (void) user_data;
+
+    struct timespec wake;
+    clock_gettime(CLOCK_MONOTONIC, &wake);
+
+    pthread_mutex_lock(&wheel_mutex);
+    while (running) {
+        pthread_mutex_unlock(&wheel_mutex);
+
+        // Sleep until the next tick, on the absolute time so that the ticks do not drift
+        wake.tv_nsec += BOOST_TICK * 1000000L;
+        if (wake.tv_nsec >= 1000000000L) {
+            wake.tv_sec += wake.tv_nsec / 1000000000L;
+            wake.tv_nsec %= 1000000000L;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR);
+
+        // Expire the ticks that passed, one timer at a time so that the wheel is not locked during a boost
+        pthread_mutex_lock(&wheel_mutex);
+        uint64_t now = (boost_now() - epoch) / BOOST_TICK;
+        while (running && cursor <= now) {
+            boost_timer_t *timer = wheel[cursor & (BOOST_WHEEL_SIZE - 1)];
+            while (timer != NULL && timer->deadline > cursor) timer = timer->next;
+
+            if (timer == NULL) {
+                cursor++;
+                continue;
+            }
+
+            timer_unlink(timer);
+            pthread_mutex_unlock(&wheel_mutex);
+            priority_boost(process_of(timer));
+            pthread_mutex_lock(&wheel_mutex);
+        }
+    }
+    pthread_mutex_unlock(&wheel_mutex);
+
+    return NULL;
+}
+
+void boost_start(void) {
+    pthread_mutex_lock(&wheel_mutex);
+    if (running) {
+        pthread_mutex_unlock(&wheel_mutex);
+        return;
+    }
+
+    epoch = boost_now();
+    cursor = 0;
+    running = 1;
+    pthread_mutex_unlock(&wheel_mutex);
+
+    if (pthread_create(&thread, NULL, boost_thread, NULL) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void boost_stop(void) {
+    pthread_mutex_lock(&wheel_mutex);
+    if (!running) {
+        pthread_mutex_unlock(&wheel_mutex);
+        return;
+    }
+    running = 0;
+    pthread_mutex_unlock(&wheel_mutex);
+
+    pthread_join(thread, NULL);
+
+    for (int i = 0; i < BOOST_WHEEL_SIZE; i++) {
+        while (wheel[i] != NULL) timer_unlink(wheel[i]);
+    }
+}
+
+void boost_schedule(process_t *process, uint64_t delay) {
+    boost_timer_t *timer = &process->boost;
+
+    pthread_mutex_lock(&wheel_mutex);
+    if (!running || timer->scheduled) {
+        pthread_mutex_unlock(&wheel_mutex);
+        return;
+    }
+
+    // Round up so that the boost never fires early
+    uint64_t deadline = (boost_now() - epoch + delay + BOOST_TICK - 1) / BOOST_TICK;
+    if (deadline < cursor) deadline = cursor;
+
+    boost_timer_t **slot = &wheel[deadline & (BOOST_WHEEL_SIZE - 1)];
+    timer->deadline = deadline;
+    timer->prev = NULL;
+    timer->next = *slot;
+    if (*slot != NULL) (*slot)->prev = timer;
+    *slot = timer;
+    timer->scheduled = 1;
+    pthread_mutex_unlock(&wheel_mutex);
+}
+
+void boost_cancel(process_t *process) {
+    pthread_mutex_lock(&wheel_mutex);
+    if (process->boost.scheduled) timer_unlink(&process->boost);
+    pthread_mutex_unlock(&wheel_mutex);
+}
@@ -0,0 +1,37 @@
+#ifndef TP2_BOOST_H
+#define TP2_BOOST_H
+
+#include <stdint.h>
+
+// Length of a tick of the timing wheel in milliseconds, the boosts fire at most one tick late
+#define BOOST_TICK 50
+
+// Number of slots of the timing wheel, must be a power of two. Delays longer than a turn of the wheel
+// wait for more than one turn in their slot.
+#define BOOST_WHEEL_SIZE 128
+
+typedef struct process process_t;
+typedef struct boost_timer boost_timer_t;
+
+// Timer of a process, linked in a slot of the timing wheel while it is scheduled
+struct boost_timer {
+    struct boost_timer *next;
+    struct boost_timer *prev;
+    uint64_t deadline; // Tick at which the timer fires
+    int scheduled;
+};
+
+// Starts the thread that boosts the processes, does nothing if it is running
+void boost_start(void);
+
+// Stops the thread and drops the timers that did not fire, does nothing if it is not running
+void boost_stop(void);
+
+// Boosts a process once the delay in milliseconds has passed, in O(1)
+// Does nothing if a boost of the process is already scheduled
+void boost_schedule(process_t *process, uint64_t delay);
+
+// Cancels the boost of a process, in O(1), does nothing if none is scheduled
+void boost_cancel(process_t *process);
+
+#endif
@@ -22,7 +22,10 @@ process_t *create_process(int pid) {
     process->found_burst = 0;
     process->found_io = 0;
     process->already_executed = 0;
-    process->waiting_boost = 0;
+    process->boost.scheduled = 0;
+    atomic_init(&process->queue, NULL);
+    atomic_init(&process->queue_level, 0);
+    atomic_init(&process->queue_node, NULL);
     pthread_mutex_init(&process->mutex, NULL);
     return process;
 }
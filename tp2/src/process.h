@@ -10,10 +10,16 @@
 #define MAX_PRIORITY_LEVEL_QUANTUM 1
 
 #include <stdint.h>
+#include <stdatomic.h>
 #include <pthread.h>
 
+#include "boost.h"
+
 typedef struct process process_t;
 
+struct node;
+struct ready_queue;
+
 struct process {
     int pid; // Don't change this!
 
@@ -25,7 +31,12 @@ struct process {
     int found_burst;
     int found_io;
     int already_executed;
-    int waiting_boost;
+    boost_timer_t boost; // Pending boost of the priority level
+
+    // Where the process waits, so that it can be removed without a search
+    struct ready_queue *_Atomic queue; // NULL when the process is not in a ready queue
+    _Atomic int queue_level;
+    struct node *_Atomic queue_node; // NULL while the process is in the ring of the level
     pthread_mutex_t mutex;
 };
 
@@ -5,20 +5,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
-#include <math.h>
 
 #include "os.h"
 
 void ready_queue_init(ready_queue_t *queue) {
     for (int i = 0; i < NUM_PRIORITY_LEVELS; i++) {
-        queue->head[i] = NULL;
-        queue->tail[i] = NULL;
-        queue->size[i] = 0;
+        ring_init(&queue->ring[i]);
+        queue->root[i] = NULL;
+        queue->sequence[i] = 0;
+        queue->free_nodes[i] = NULL;
+        queue->chunks[i] = NULL;
+        atomic_init(&queue->size[i], 0);
         pthread_mutex_init(&queue->queue_mutex[i], NULL);
     }
     queue->quantum = INITIAL_QUANTUM;
     queue->quantum_counter = 0;
-    pthread_mutex_init(&queue->useless_mutex, NULL);
+    atomic_init(&queue->waiting, 0);
+    atomic_init(&queue->overflow, 0);
+    pthread_mutex_init(&queue->wait_mutex, NULL);
     pthread_mutex_init(&queue->quantum_mutex, NULL);
     pthread_mutex_init(&queue->read_max_queue_mutex, NULL);
     pthread_cond_init(&queue->cond, NULL);
@@ -27,16 +31,16 @@ void ready_queue_init(ready_queue_t *queue) {
 void ready_queue_destroy(ready_queue_t *queue) {
     for (int i = 0; i < NUM_PRIORITY_LEVELS; i++) {
         pthread_mutex_lock(&queue->queue_mutex[i]);
-        node_t *current = queue->head[i];
-        while (current != NULL) {
-            node_t *next = current->next;
-            free(current);
-            current = next;
+        node_chunk_t *chunk = queue->chunks[i];
+        while (chunk != NULL) {
+            node_chunk_t *next = chunk->next;
+            free(chunk);
+            chunk = next;
         }
         pthread_mutex_unlock(&queue->queue_mutex[i]);
         pthread_mutex_destroy(&queue->queue_mutex[i]);
     }
-    pthread_mutex_destroy(&queue->useless_mutex);
+    pthread_mutex_destroy(&queue->wait_mutex);
     pthread_mutex_destroy(&queue->quantum_mutex);
     pthread_mutex_destroy(&queue->read_max_queue_mutex);
     pthread_cond_destroy(&queue->cond);
@@ -77,313 +81,322 @@ void add_to_quantum_average(ready_queue_t *queue, process_t *process) {
 }
 
 
-void ready_queue_push(ready_queue_t *queue, process_t *process) {
-    int priority = DEFAULT_PRIORITY_LEVEL + 1;
-    if (process != NULL) {
-        priority = process->priority_level;
-    }
+/**
+ * Takes a node from the pool of a level, the mutex of the level must be held.
+ */
+static node_t *node_get(ready_queue_t *queue, int priority) {
+    if (queue->free_nodes[priority] == NULL) {
+        // The pool is empty, allocate a chunk of nodes
+        node_chunk_t *chunk = malloc(sizeof(node_chunk_t));
+        if (chunk == NULL) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        chunk->next = queue->chunks[priority];
+        queue->chunks[priority] = chunk;
 
-    // Allocate a new node
-    node_t *new_node = malloc(sizeof(node_t));
-    if (new_node == NULL) {
-        perror("malloc");
-        exit(EXIT_FAILURE);
+        for (int i = 0; i < NODE_CHUNK_SIZE; i++) {
+            chunk->nodes[i].next = i + 1 < NODE_CHUNK_SIZE ? &chunk->nodes[i + 1] : NULL;
+            chunk->nodes[i].queue = queue;
+            chunk->nodes[i].level = priority;
+        }
+        queue->free_nodes[priority] = &chunk->nodes[0];
     }
 
-    // Lock the queue
-    pthread_mutex_lock(&queue->queue_mutex[priority]);
+    node_t *node = queue->free_nodes[priority];
+    queue->free_nodes[priority] = node->next;
+    return node;
+}
 
-    // Initialize the new node
-    new_node->process = process;
-    new_node->next = NULL;
-    new_node->prev = NULL;
-    if (process == NULL || priority == MAX_PRIORITY_LEVEL) {
-        if (queue->tail[priority] != NULL) {
-            new_node->next = queue->tail[priority];
-            queue->tail[priority]->prev = new_node;
-        } else {
-            queue->head[priority] = new_node;
-        }
-        queue->tail[priority] = new_node;
-    } else if (process->already_executed) {
-        // Add process to head
-        if (queue->head[priority] != NULL) {
-            queue->head[priority]->next = new_node;
-            new_node->prev = queue->head[priority];
-        } else {
-            queue->tail[priority] = new_node;
-        }
-        queue->head[priority] = new_node;
-    } else {
-        // Add the process to the right position based on its burst length + io length
-        // Find the right position
-        node_t *prev = NULL;
-        node_t *current = queue->tail[priority];
-        while (current != NULL) {
-            if (current->process->burst_length + current->process->io_length <
-                process->burst_length + process->io_length) {
-                break;
-            }
-            prev = current;
-            current = current->next;
-        }
+/**
+ * Gives a node back to the pool of a level, the mutex of the level must be held.
+ */
+static void node_put(ready_queue_t *queue, int priority, node_t *node) {
+    node->next = queue->free_nodes[priority];
+    queue->free_nodes[priority] = node;
+}
 
-        // Link the neighbors of the new node
-        new_node->next = current;
-        new_node->prev = prev;
-        if (prev != NULL) {
-            prev->next = new_node;
-        } else {
-            queue->tail[priority] = new_node;
-        }
-        if (current != NULL) {
-            current->prev = new_node;
-        } else {
-            queue->head[priority] = new_node;
-        }
+/**
+ * Tells whether a node must be popped before another one.
+ */
+static int node_before(const node_t *a, const node_t *b) {
+    if (a->rank != b->rank) return a->rank < b->rank;
+    if (a->length != b->length) return a->length < b->length;
+    return a->sequence < b->sequence;
+}
+
+/**
+ * Links two heaps, the root that must be popped last becomes the first child of the other one.
+ *
+ * @return the root of the heap
+ */
+static node_t *heap_meld(node_t *a, node_t *b) {
+    if (a == NULL) return b;
+    if (b == NULL) return a;
+    if (node_before(b, a)) {
+        node_t *swap = a;
+        a = b;
+        b = swap;
     }
-    queue->size[priority]++;
 
-    // Signal the condition variable and unlock the queue
-    pthread_mutex_unlock(&queue->queue_mutex[priority]);
-    pthread_cond_signal(&queue->cond);
+    b->prev = a;
+    b->next = a->child;
+    if (a->child != NULL) a->child->prev = b;
+    a->child = b;
+    return a;
 }
 
-process_t *ready_queue_pop(ready_queue_t *queue) {
-    int priority = -1;
-    // Pop the highest priority process
-    while (1) {
-        for (int i = 0; i < NUM_PRIORITY_LEVELS; i++) {
-            if (queue->size[i] > 0) {
-                pthread_mutex_lock(&queue->queue_mutex[i]);
-                if (queue->size[i] > 0) {
-                    priority = i;
-                    break;
-                } else {
-                    pthread_mutex_unlock(&queue->queue_mutex[i]);
-                    continue;
-                }
-            }
-        }
-        if (priority == -1) {
-            pthread_mutex_lock(&queue->useless_mutex);
-            pthread_cond_wait(&queue->cond, &queue->useless_mutex);
-            pthread_mutex_unlock(&queue->useless_mutex);
-        } else {
-            break;
+/**
+ * Links the siblings of a list into one heap, melding them by pairs from left to right, then the pairs
+ * from right to left, which keeps the pops at O(log n) amortized.
+ *
+ * @return the root of the heap
+ */
+static node_t *heap_merge_pairs(node_t *first) {
+    // Meld the pairs, the results are stacked through next
+    node_t *stack = NULL;
+    while (first != NULL) {
+        node_t *a = first;
+        node_t *b = a->next;
+        first = b != NULL ? b->next : NULL;
+
+        a->next = a->prev = NULL;
+        if (b != NULL) {
+            b->next = b->prev = NULL;
+            a = heap_meld(a, b);
         }
+        a->next = stack;
+        stack = a;
     }
 
-    // Decrement the size of the queue
-    queue->size[priority]--;
-
-    // Save the process of the node
-    node_t *head = queue->head[priority];
-
-    // Verify if the head is null
-    if (head == NULL) {
-        return NULL;
+    // Meld the pairs, from the last one
+    node_t *root = NULL;
+    while (stack != NULL) {
+        node_t *next = stack->next;
+        stack->next = NULL;
+        root = heap_meld(stack, root);
+        stack = next;
     }
+    return root;
+}
 
-    // Get the process
-    process_t *process = head->process;
+/**
+ * Adds a process to the heap of its level, the mutex of the level must be held.
+ */
+static void heap_insert(ready_queue_t *queue, int priority, process_t *process) {
+    node_t *node = node_get(queue, priority);
+    uint64_t sequence = queue->sequence[priority]++;
 
-    // Update the queue's head and tail
-    queue->head[priority] = queue->head[priority]->prev;
-    if (queue->head[priority] == NULL) {
-        queue->tail[priority] = NULL;
+    // Initialize the new node
+    node->process = process;
+    node->child = NULL;
+    node->next = NULL;
+    node->prev = NULL;
+    node->length = 0;
+    if (process == NULL) {
+        // Poison pills are popped after every process of the level
+        node->rank = 2;
+        node->sequence = sequence;
+    } else if (priority != MAX_PRIORITY_LEVEL && process->already_executed) {
+        // Processes that already ran are popped first, the last one pushed first
+        node->rank = 0;
+        node->sequence = UINT64_MAX - sequence;
     } else {
-        queue->head[priority]->next = NULL;
+        // Order the process by its burst length + io length, FIFO on MAX_PRIORITY_LEVEL
+        node->rank = 1;
+        if (priority != MAX_PRIORITY_LEVEL) {
+            node->length = process->burst_length + process->io_length;
+        }
+        node->sequence = sequence;
     }
 
-    // Unlock the queue
-    pthread_mutex_unlock(&queue->queue_mutex[priority]);
-
-    // Free the node
-    free(head);
-
-    // Return the process
-    return process;
+    queue->root[priority] = heap_meld(queue->root[priority], node);
+    if (process != NULL) atomic_store(&process->queue_node, node);
+    if (priority == MAX_PRIORITY_LEVEL) atomic_fetch_add(&queue->overflow, 1);
 }
 
-int ready_queue_remove(ready_queue_t *queue, process_t *process) {
-    if (process == NULL)
-        return 0;
-
-    int priority = process->priority_level;
-
-    // Lock the queue
-    pthread_mutex_lock(&queue->queue_mutex[priority]);
+/**
+ * Unlinks a node from the heap of its level, the mutex of the level must be held.
+ */
+static void heap_unlink(ready_queue_t *queue, int priority, node_t *node) {
+    // The process is no longer queued, unless it was pushed again
+    process_t *process = node->process;
+    if (process != NULL && atomic_load(&process->queue_node) == node) {
+        atomic_store(&process->queue_node, NULL);
+        atomic_store(&process->queue, NULL);
+    }
 
-    // Traverse the queue to find and remove the process
-    node_t *prev = NULL;
-    node_t *current = queue->tail[priority];
-    int was_found = 0;
-    while (current != NULL) {
-        if (current->process == process) {
-            was_found = 1;
-            if (prev == NULL) {
-                queue->tail[priority] = current->next;
-            } else {
-                prev->next = current->next;
-            }
+    node_t *children = heap_merge_pairs(node->child);
 
-            if (current->next == NULL) {
-                queue->head[priority] = current->prev;
-            } else {
-                current->next->prev = prev;
-            }
-            // Free the node and decrement the size
-            free(current);
-            queue->size[priority]--;
-            break;
+    if (node == queue->root[priority]) {
+        queue->root[priority] = children;
+    } else {
+        // The previous node is the parent of the first child, or the previous sibling
+        if (node->prev->child == node) {
+            node->prev->child = node->next;
+        } else {
+            node->prev->next = node->next;
         }
-        prev = current;
-        current = current->next;
+        if (node->next != NULL) node->next->prev = node->prev;
+
+        queue->root[priority] = heap_meld(queue->root[priority], children);
     }
+    if (queue->root[priority] != NULL) queue->root[priority]->prev = NULL;
 
-    // Unlock the queue
-    pthread_mutex_unlock(&queue->queue_mutex[priority]);
+    node_put(queue, priority, node);
+    if (priority == MAX_PRIORITY_LEVEL) atomic_fetch_sub(&queue->overflow, 1);
+}
 
-    return was_found;
+/**
+ * Moves the processes pushed to the ring of a sorted level to its heap, the mutex of the level must be
+ * held. The ring of MAX_PRIORITY_LEVEL is never drained, it is the queue of the level.
+ */
+static void heap_drain(ready_queue_t *queue, int priority) {
+    if (priority == MAX_PRIORITY_LEVEL) return;
+
+    process_t *process;
+    while (ring_pop(&queue->ring[priority], &process)) {
+        heap_insert(queue, priority, process);
+    }
 }
 
+/**
+ * Removes the root of the heap of a level, the mutex of the level must be held.
+ */
+static process_t *heap_pop(ready_queue_t *queue, int priority) {
+    node_t *root = queue->root[priority];
+    process_t *process = root->process;
+    heap_unlink(queue, priority, root);
+    return process;
+}
 
-int ready_queue_remove_par(ready_queue_t *queue, process_t *process) {
-    if (process == NULL)
-        return 0;
+int ready_queue_try_pop(ready_queue_t *queue, process_t **process) {
+    for (int i = 0; i < NUM_PRIORITY_LEVELS; i++) {
+        if (atomic_load(&queue->size[i]) == 0) continue;
 
-    int priority = process->priority_level;
+        int found = 0;
+        if (i == MAX_PRIORITY_LEVEL && ring_pop(&queue->ring[i], process)) {
+            if (*process != NULL) atomic_store(&(*process)->queue, NULL);
+            found = 1;
+        } else {
+            // A sorted level, or the processes of MAX_PRIORITY_LEVEL that did not fit in its ring
+            pthread_mutex_lock(&queue->queue_mutex[i]);
+            heap_drain(queue, i);
+            if (queue->root[i] != NULL) {
+                *process = heap_pop(queue, i);
+                found = 1;
+            }
+            pthread_mutex_unlock(&queue->queue_mutex[i]);
+        }
 
-    // Allocate memory for the struct and set the data
-    remove_parallel_data_t *data = malloc(sizeof(remove_parallel_data_t));
-    data->process = process;
-    data->queue = queue;
+        if (found) {
+            atomic_fetch_sub(&queue->size[i], 1);
+            return 1;
+        }
+    }
+    return 0;
+}
 
-    // Create the left and right threads
-    void *found_left;
-    void *found_right;
-    pthread_t left_thread;
-    pthread_t right_thread;
+void ready_queue_push(ready_queue_t *queue, process_t *process) {
+    int priority = DEFAULT_PRIORITY_LEVEL + 1;
+    if (process != NULL) {
+        priority = process->priority_level;
+    }
 
-    // Lock the queue
-    pthread_mutex_lock(&queue->queue_mutex[priority]);
+    // Record where the process waits, before it can be popped
+    if (process != NULL) {
+        atomic_store(&process->queue_node, NULL);
+        atomic_store(&process->queue_level, priority);
+        atomic_store(&process->queue, queue);
+    }
 
-    // Start a new thread to monitor the priority change
-    pthread_create(&left_thread, NULL, remove_left_thread, data);
-    pthread_create(&right_thread, NULL, remove_right_thread, data);
+    // Count the process before a pop can see it, so that the size never goes below 0
+    atomic_fetch_add(&queue->size[priority], 1);
+
+    // The ring of MAX_PRIORITY_LEVEL takes no push while the heap of the level holds older processes, the
+    // newer ones would be popped first. Once the ring is popped empty, the heap is popped in FIFO order.
+    int overflowing = priority == MAX_PRIORITY_LEVEL && atomic_load(&queue->overflow) > 0;
+    if (overflowing || !ring_push(&queue->ring[priority], process)) {
+        // The ring is full or skipped, fall back to the heap of the level
+        pthread_mutex_lock(&queue->queue_mutex[priority]);
+        heap_insert(queue, priority, process);
+        pthread_mutex_unlock(&queue->queue_mutex[priority]);
+    }
 
-    // Wait for the threads to finish
-    pthread_join(left_thread, &found_left);
-    pthread_join(right_thread, &found_right);
+    // Wake a core if one is sleeping. Either the core sees the new size before it sleeps,
+    // or this load sees that it is waiting, since both sides write then read with sequential consistency.
+    if (atomic_load(&queue->waiting) > 0) {
+        pthread_mutex_lock(&queue->wait_mutex);
+        pthread_cond_signal(&queue->cond);
+        pthread_mutex_unlock(&queue->wait_mutex);
+    }
+}
 
-    // Unlock the queue
-    pthread_mutex_unlock(&queue->queue_mutex[priority]);
-    int found = *((int *) found_left) || *((int *) found_right);
+process_t *ready_queue_pop(ready_queue_t *queue) {
+    process_t *process;
+    while (!ready_queue_try_pop(queue, &process)) {
+        pthread_mutex_lock(&queue->wait_mutex);
+        atomic_fetch_add(&queue->waiting, 1);
+
+        // Check again now that the pushes know that this core is waiting
+        if (!ready_queue_try_pop(queue, &process)) {
+            pthread_cond_wait(&queue->cond, &queue->wait_mutex);
+            atomic_fetch_sub(&queue->waiting, 1);
+            pthread_mutex_unlock(&queue->wait_mutex);
+            continue;
+        }
 
-    // Free the data
-    free(data);
-    free(found_left);
-    free(found_right);
+        atomic_fetch_sub(&queue->waiting, 1);
+        pthread_mutex_unlock(&queue->wait_mutex);
+        break;
+    }
 
-    return found;
+    return process;
 }
 
-void *remove_left_thread(void *thread_data) {
-    // Extract process and queue from the argument
-    struct remove_parallel_data *data = (struct remove_parallel_data *) thread_data;
-    process_t *process = data->process;
-    ready_queue_t *queue = data->queue;
-
-    int priority = process->priority_level;
-    int moves = floor(queue->size[priority] / 2);
-
-    // Traverse the queue to find and remove the process
-    node_t *prev = NULL;
-    node_t *current = queue->tail[priority];
-
-    void *was_found = malloc(sizeof(int));
-    *((int *) was_found) = 0;
-
-    int position = 1;
-    while (current != NULL && position < moves && !data->stop) {
-        if (current->process == process) {
-            // Set the stop flag and the was_found flag
-            data->stop = 1;
-            *((int *) was_found) = 1;
-
-            // Remove the node from the queue
-            if (prev == NULL) {
-                queue->tail[priority] = current->next;
-            } else {
-                prev->next = current->next;
-            }
-
-            if (current->next == NULL) {
-                queue->head[priority] = current->prev;
-            } else {
-                current->next->prev = prev;
-            }
+int ready_queue_peek(ready_queue_t *queue, uint64_t *length) {
+    for (int i = 0; i < NUM_PRIORITY_LEVELS; i++) {
+        if (atomic_load(&queue->size[i]) == 0) continue;
 
-            // Free the node and decrement the size
-            free(current);
-            queue->size[priority]--;
-            break;
+        // The ring of MAX_PRIORITY_LEVEL is a FIFO, its processes are not ordered by length
+        if (i == MAX_PRIORITY_LEVEL) {
+            *length = 0;
+            return i;
         }
-        prev = current;
-        current = current->next;
-        position++;
-    }
 
-    return was_found;
+        pthread_mutex_lock(&queue->queue_mutex[i]);
+        heap_drain(queue, i);
+        node_t *root = queue->root[i];
+        if (root != NULL) *length = root->length;
+        pthread_mutex_unlock(&queue->queue_mutex[i]);
+
+        if (root != NULL) return i;
+    }
+    return NUM_PRIORITY_LEVELS;
 }
 
-void *remove_right_thread(void *thread_data) {
-    // Extract process and queue from the argument
-    struct remove_parallel_data *data = (struct remove_parallel_data *) thread_data;
-    process_t *process = data->process;
-    ready_queue_t *queue = data->queue;
-
-    int priority = process->priority_level;
-    int moves = ceil(queue->size[priority] / 2);
-
-    // Traverse the queue to find and remove the process
-    node_t *prev = NULL;
-    node_t *current = queue->head[priority];
-
-    void *was_found = malloc(sizeof(int));
-    *((int *) was_found) = 0;
-
-    int position = 0;
-    while (current != NULL && position < moves && !data->stop) {
-        if (current->process == process) {
-            // Set the stop flag and the was_found flag
-            data->stop = 1;
-            *((int *) was_found) = 1;
-
-            // Remove the node from the queue
-            if (prev == NULL) {
-                queue->head[priority] = current->prev;
-            } else {
-                prev->prev = current->prev;
-            }
+int ready_queue_remove(ready_queue_t *queue, process_t *process) {
+    if (process == NULL || atomic_load(&process->queue) != queue)
+        return 0;
 
-            if (current->prev == NULL) {
-                queue->tail[priority] = current->next;
-            } else {
-                current->prev->next = prev;
-            }
+    // The level where the process was pushed, not its current priority level which may have changed since
+    int priority = atomic_load(&process->queue_level);
 
-            // Free the node and decrement the size
-            free(current);
-            queue->size[priority]--;
-            break;
-        }
-        prev = current;
-        current = current->prev;
-        position++;
+    // Lock the queue, the process gets its node if it is still in the ring of the level
+    pthread_mutex_lock(&queue->queue_mutex[priority]);
+    heap_drain(queue, priority);
+
+    // The process may have been popped or pushed elsewhere in the meantime, the node must still hold it
+    node_t *node = atomic_load(&process->queue_node);
+    int was_found = node != NULL && node->queue == queue && node->level == priority && node->process == process;
+    if (was_found) {
+        heap_unlink(queue, priority, node);
+        atomic_fetch_sub(&queue->size[priority], 1);
     }
 
+    // Unlock the queue
+    pthread_mutex_unlock(&queue->queue_mutex[priority]);
+
     return was_found;
 }
 
@@ -2,39 +2,68 @@
 #define TP2_READY_QUEUE_H
 
 #include <stdint.h>
+#include <stdatomic.h>
 #include <pthread.h>
 
 #include "process.h"
+#include "ring.h"
+
+// Number of nodes allocated at once when the pool of a level is empty
+#define NODE_CHUNK_SIZE 64
 
 typedef struct ready_queue ready_queue_t;
 typedef struct node node_t;
-typedef struct remove_parallel_data remove_parallel_data_t;
-
+typedef struct node_chunk node_chunk_t;
+
+// Each priority level has a lock-free ring and a pairing heap protected by the mutex of the level.
+// The ring of MAX_PRIORITY_LEVEL is its FIFO queue, the heap only takes the processes pushed while the
+// ring is full, and the ones pushed after them until the heap is empty again, so that they are popped
+// in the order of their pushes. The rings of the other levels take the pushes without locking, the
+// processes are moved to the heap, ordered by burst length + io length, by the next pop or remove on
+// the level.
 struct ready_queue {
+    ring_t ring[NUM_PRIORITY_LEVELS];
+
+    // Cores sleeping in ready_queue_pop, a push only takes the mutex to wake one when there are some
+    atomic_int waiting;
     pthread_cond_t cond;
-    pthread_mutex_t useless_mutex;
+    pthread_mutex_t wait_mutex;
 
     pthread_mutex_t queue_mutex[NUM_PRIORITY_LEVELS];
     pthread_mutex_t read_max_queue_mutex;
     pthread_mutex_t quantum_mutex;
-    node_t *head[NUM_PRIORITY_LEVELS];
-    node_t *tail[NUM_PRIORITY_LEVELS];
-    size_t size[NUM_PRIORITY_LEVELS];
+    node_t *root[NUM_PRIORITY_LEVELS]; // Process popped next
+    uint64_t sequence[NUM_PRIORITY_LEVELS]; // Number of processes inserted in the heap, breaks the ties
+    node_t *free_nodes[NUM_PRIORITY_LEVELS]; // Pool of unused nodes, linked by next
+    node_chunk_t *chunks[NUM_PRIORITY_LEVELS]; // Memory of the nodes, freed with the queue
+    atomic_size_t size[NUM_PRIORITY_LEVELS]; // Processes of the ring and of the heap
+    atomic_size_t overflow; // Processes of MAX_PRIORITY_LEVEL in its heap
 
     uint64_t quantum;
     int quantum_counter;
 };
 
+// Node of a pairing heap, the children of a node are a list of siblings
 struct node {
     process_t *process;
-    struct node *next;
-    struct node *prev;
+    struct node *child; // First child
+    struct node *next; // Next sibling
+    struct node *prev; // Previous sibling, or the parent of the first child
+
+    // Queue and level of the pool that the node belongs to, they never change
+    struct ready_queue *queue;
+    int level;
+
+    // The nodes are ordered by rank, then by length, then by sequence
+    int rank; // 0 for the processes that already ran, 1 for the others, 2 for the poison pills
+    uint64_t length; // Burst length + io length
+    uint64_t sequence;
 };
 
-struct remove_parallel_data {
-    process_t *process;
-    ready_queue_t *queue;
-    int stop;
+// Nodes are allocated by chunks and never returned to the allocator before the queue is destroyed
+struct node_chunk {
+    struct node_chunk *next;
+    node_t nodes[NODE_CHUNK_SIZE];
 };
 
 /**
@@ -83,12 +112,35 @@ process_t *ready_queue_pop(ready_queue_t *queue);
 
 
 /**
- *  This function removes a process from its queue.
+ * This function removes the process with the highest priority without blocking.
+ *
+ * @param queue the ready queue
+ * @param process where the removed process is stored
+ *
+ * @return 1 if a process was removed, 0 if the queue is empty
+ */
+int ready_queue_try_pop(ready_queue_t *queue, process_t **process);
+
+/**
+ * This function finds the process that the next pop would return, without removing it. The queue is
+ * not locked between the peek and the pop, so the pop may return another process.
+ *
+ * @param queue the ready queue
+ * @param length where the burst length + io length of the process is stored, 0 on MAX_PRIORITY_LEVEL
+ *
+ * @return the priority level of the process, or NUM_PRIORITY_LEVELS if the queue is empty
+ */
+int ready_queue_peek(ready_queue_t *queue, uint64_t *length);
+
+/**
+ *  This function removes a process from its queue. The process records its queue, level and node
+ *  when it is pushed, so the removal is an unlink from the heap of the level, without a search.
+ *  A process waiting in the ring of MAX_PRIORITY_LEVEL cannot be removed, it will be popped in its turn.
  *
  * @param queue the ready queue
  * @param process the removed process
  *
- * @return 0 if the process was removed, 1 otherwise
+ * @return 1 if the process was removed, 0 otherwise
  */
 int ready_queue_remove(ready_queue_t *queue, process_t *process);
 
@@ -106,10 +158,4 @@ void add_to_quantum_average(ready_queue_t *queue, process_t *process);
 
 void remove_from_quantum_average(ready_queue_t *queue, process_t *process);
 
-int ready_queue_remove_par(ready_queue_t *queue, process_t *process);
-
-void *remove_right_thread(void *thread_data);
-
-void *remove_left_thread(void *thread_data);
-
 #endif
@@ -0,0 +1,70 @@
+#include "ring.h"
+
+#include <stdint.h>
+
+void ring_init(ring_t *ring) {
+    for (size_t i = 0; i < RING_SIZE; i++) {
+        atomic_init(&ring->slots[i].sequence, i);
+        ring->slots[i].process = NULL;
+    }
+    atomic_init(&ring->push_position, 0);
+    atomic_init(&ring->pop_position, 0);
+}
+
+int ring_push(ring_t *ring, process_t *process) {
+    size_t position = atomic_load_explicit(&ring->push_position, memory_order_relaxed);
+    ring_slot_t *slot;
+    while (1) {
+        slot = &ring->slots[position & (RING_SIZE - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+
+        if (difference == 0) {
+            // The slot is free, claim the position
+            if (atomic_compare_exchange_weak_explicit(&ring->push_position, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            // The slot still holds the process of the previous lap
+            return 0;
+        } else {
+            // Another producer claimed the position
+            position = atomic_load_explicit(&ring->push_position, memory_order_relaxed);
+        }
+    }
+
+    // Publish the process to the consumer of this position
+    slot->process = process;
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+    return 1;
+}
+
+int ring_pop(ring_t *ring, process_t **process) {
+    size_t position = atomic_load_explicit(&ring->pop_position, memory_order_relaxed);
+    ring_slot_t *slot;
+    while (1) {
+        slot = &ring->slots[position & (RING_SIZE - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t) sequence - (intptr_t) (position + 1);
+
+        if (difference == 0) {
+            // The slot holds a process, claim the position
+            if (atomic_compare_exchange_weak_explicit(&ring->pop_position, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            // The producer of this position has not published its process yet
+            return 0;
+        } else {
+            // Another consumer claimed the position
+            position = atomic_load_explicit(&ring->pop_position, memory_order_relaxed);
+        }
+    }
+
+    // Free the slot for the producer of the next lap
+    *process = slot->process;
+    atomic_store_explicit(&slot->sequence, position + RING_SIZE, memory_order_release);
+    return 1;
+}
@@ -0,0 +1,47 @@
+#ifndef TP2_RING_H
+#define TP2_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "process.h"
+
+// Number of slots of a ring, must be a power of two
+#define RING_SIZE 1024
+
+// Size of a cache line, the positions of the producers and of the consumers are kept on their own lines
+#define CACHE_LINE_SIZE 64
+
+typedef struct ring ring_t;
+typedef struct ring_slot ring_slot_t;
+
+struct ring_slot {
+    // Position of the push that may fill the slot, or that position + 1 once it holds a process
+    atomic_size_t sequence;
+    process_t *process;
+};
+
+/**
+ * Bounded multi-producer multi-consumer queue of processes, without locks. Each slot has a sequence
+ * number which tells whether the slot is free for a given position of the producers or holds the
+ * process of a given position of the consumers, so that producers and consumers only contend on their
+ * own position, with one compare-and-swap per operation.
+ */
+struct ring {
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t push_position;
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t pop_position;
+    _Alignas(CACHE_LINE_SIZE) ring_slot_t slots[RING_SIZE];
+};
+
+// Initializes an empty ring
+void ring_init(ring_t *ring);
+
+// Adds a process at the end of the ring, NULL is a valid process
+// Returns 1 if the process was added, 0 if the ring is full
+int ring_push(ring_t *ring, process_t *process);
+
+// Removes the process at the start of the ring
+// Returns 1 if a process was removed and stored in process, 0 if the ring is empty
+int ring_pop(ring_t *ring, process_t **process);
+
+#endif
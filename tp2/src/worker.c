@@ -1,13 +1,13 @@
 #include "worker.h"
 
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "boost.h"
 #include "process.h"
 #include "os.h"
 
-#include <unistd.h>  // For sleep function
-
 // Time in seconds to wait before checking if the priority level of a process needs to be increased
 #define BOOST_TIME 3
 
@@ -20,6 +20,9 @@
 // i.e. const float CONSTANTS[] = {HIGHEST_PRIORITY_CONSTANT, ..., LOWEST_PRIORITY_CONSTANT};
 const float CONSTANTS[] = {0, 0.3, 0.5, 0.8};
 
+// Workers indexed by core, so that an idle core can steal from the local queue of another
+static worker_t *_Atomic workers[OS_CORES];
+
 void *worker_run(void *user_data) {
     worker_t *worker = (worker_t *) user_data;
     ready_queue_t *ready_queue = worker->ready_queue;
@@ -29,8 +32,8 @@ void *worker_run(void *user_data) {
     uint64_t start_time;
     uint64_t quantum;
     while (1) {
-        // Pop a process from the ready queue
-        process = ready_queue_pop(ready_queue);
+        // Pop a process from the ready queues
+        process = worker_next(worker);
 
         // This mutex makes sure that only one worker can preempt
         // between micro quantums and get the new max priority
@@ -112,13 +115,19 @@ void *worker_run(void *user_data) {
         pthread_mutex_unlock(&process->mutex);
 
         // Adjust priority level based on process behavior
-        update_priority_level(process, ready_queue);
+        update_priority_level(process);
 
         // If the process was preempted or blocked, push it back to the ready queue
         pthread_mutex_lock(&process->mutex);
         switch (process->status) {
             case OS_RUN_PREEMPTED:
-                ready_queue_push(ready_queue, process);
+                // Keep the process on this core to avoid a context switch,
+                // unless another core is idle and waiting for work
+                if (atomic_load(&ready_queue->waiting) > 0) {
+                    ready_queue_push(ready_queue, process);
+                } else {
+                    ready_queue_push(&worker->local_queue, process);
+                }
                 break;
             case OS_RUN_BLOCKED:
                 // Include the process in the quantum average
@@ -151,6 +160,49 @@ void *worker_run(void *user_data) {
     return NULL;
 }
 
+process_t *worker_next(worker_t *worker) {
+    process_t *process;
+    while (1) {
+        uint64_t local_length, shared_length, length;
+        int local = ready_queue_peek(&worker->local_queue, &local_length);
+        int shared = ready_queue_peek(worker->ready_queue, &shared_length);
+
+        // Look for a victim, starting from a random core
+        worker_t *victim = NULL;
+        int stolen = NUM_PRIORITY_LEVELS;
+        uint64_t stolen_length = 0;
+        int start = rand_r(&worker->seed) % OS_CORES;
+        for (int i = 0; i < OS_CORES; i++) {
+            worker_t *other = atomic_load(&workers[(start + i) % OS_CORES]);
+            if (other == NULL || other == worker) continue;
+
+            int priority = ready_queue_peek(&other->local_queue, &length);
+            if (priority < stolen || (priority == stolen && length < stolen_length)) {
+                victim = other;
+                stolen = priority;
+                stolen_length = length;
+            }
+        }
+
+        // Take the best process, by priority level then by length, preferring the local queue,
+        // then the shared queue when they are equal
+        int local_first = local < shared || (local == shared && local_length <= shared_length);
+        int best = local_first ? local : shared;
+        uint64_t best_length = local_first ? local_length : shared_length;
+        ready_queue_t *queue = local_first ? &worker->local_queue : worker->ready_queue;
+        if (stolen < best || (stolen == best && stolen_length < best_length)) {
+            queue = &victim->local_queue;
+            best = stolen;
+        }
+
+        if (best == NUM_PRIORITY_LEVELS) {
+            // Nothing to run, sleep until the OS or a busy core pushes to the shared queue
+            return ready_queue_pop(worker->ready_queue);
+        }
+        if (ready_queue_try_pop(queue, &process)) return process;
+    }
+}
+
 uint64_t get_quantum(ready_queue_t *queue, int priority) {
     if (priority == MAX_PRIORITY_LEVEL) {
         return MAX_PRIORITY_LEVEL_QUANTUM;
@@ -164,15 +216,8 @@ uint64_t get_quantum(ready_queue_t *queue, int priority) {
     return quantum;
 }
 
-void *priority_monitor_thread(void *thread_data) {
-    // Extract process and ready_queue from the argument
-    process_t *process = ((struct queue_process_data *) thread_data)->process;
-    ready_queue_t *ready_queue = ((struct queue_process_data *) thread_data)->ready_queue;
-
-    // Sleep for a while
-    sleep(BOOST_TIME);
-
-    // Check if the priority is still the same or decreased during the sleep
+void priority_boost(process_t *process) {
+    // Check if the priority is still the same or decreased since the boost was scheduled
     pthread_mutex_lock(&process->mutex);
     if (process->status != OS_RUN_DONE) {
         // By default, the new level is the maximum priority level + 1
@@ -185,58 +230,40 @@ void *priority_monitor_thread(void *thread_data) {
 
         // Check if the priority level of the process is higher than the new level
         if (process->priority_level > new_level) {
+            // A process that waits in a ready queue keeps its place there and runs with the quantum of the
+            // new level, moving it would let the long processes pass the new ones and worsen the score.
+            // Otherwise, the worker or the OS pushes it back at the new level.
             process->priority_level = new_level;
-
-            // Remove the process from the ready queue if it is there and push it back to give it the right queue.
-            // If it is not in the queue, then the process will be automatically added back to the ready queue
-            // by the worker or the OS.
-            int was_removed = ready_queue_remove(ready_queue, process);
-            if (was_removed) {
-                // Add the process to the right priority level ready queue
-                ready_queue_push(ready_queue, process);
-            }
         }
     }
-    process->waiting_boost = 0;
     pthread_mutex_unlock(&process->mutex);
-
-    free(thread_data);
-    return NULL;
 }
 
-void update_priority_level(process_t *process, ready_queue_t *ready_queue) {
+void update_priority_level(process_t *process) {
     switch (process->status) {
         case OS_RUN_PREEMPTED:
             // Process was preempted, demote priority level
             pthread_mutex_lock(&process->mutex);
             process->priority_level = min(process->priority_level + 1, MIN_PRIORITY_LEVEL);
 
-            if (BOOST_TIME != 0 && NUM_PRIORITY_LEVELS > 2 && !process->waiting_boost) {
-                process->waiting_boost = 1;
-
-                // Create an instance of the structure and populate it with process and ready_queue data
-                // Allocate memory for the struct
-                queue_process_data_t *data = malloc(sizeof(queue_process_data_t));
-                data->process = process;
-                data->ready_queue = ready_queue;
-
-                // Start a new thread to monitor the priority change
-                pthread_t monitor_thread;
-                pthread_create(&monitor_thread, NULL, priority_monitor_thread, data);
-                pthread_detach(monitor_thread);  // Detach the thread to avoid memory leak
+            // Schedule a boost, unless one is already pending
+            if (BOOST_TIME != 0 && NUM_PRIORITY_LEVELS > 2) {
+                boost_schedule(process, BOOST_TIME * 1000);
             }
             pthread_mutex_unlock(&process->mutex);
             break;
         case OS_RUN_BLOCKED:
-            // Process was blocked, promote priority level
+            // Process was blocked, promote priority level, a pending boost is no longer needed
             pthread_mutex_lock(&process->mutex);
             process->priority_level = MAX_PRIORITY_LEVEL;
+            boost_cancel(process);
             pthread_mutex_unlock(&process->mutex);
             break;
         case OS_RUN_DONE:
-            // Process is done, reset priority level
+            // Process is done, reset priority level and cancel its boost
             pthread_mutex_lock(&process->mutex);
             process->priority_level = MAX_PRIORITY_LEVEL;
+            boost_cancel(process);
             pthread_mutex_unlock(&process->mutex);
             break;
 
@@ -244,12 +271,12 @@ void update_priority_level(process_t *process, ready_queue_t *ready_queue) {
 }
 
 worker_t *worker_create(int core, ready_queue_t *ready_queue) {
-    // Allocate memory for the worker
-    worker_t *worker = malloc(sizeof(worker_t));
+    // Allocate memory for the worker, aligned for the rings of its local queue
+    worker_t *worker = aligned_alloc(_Alignof(worker_t), sizeof(worker_t));
+    worker_init(worker, core, ready_queue);
 
-    // Initialize the worker
-    worker->core = core;
-    worker->ready_queue = ready_queue;
+    // The first worker starts the boost thread, the next ones find it running
+    boost_start();
 
     // Create the worker thread and return the worker
     pthread_create(&worker->thread, NULL, worker_run, worker);
@@ -257,9 +284,26 @@ worker_t *worker_create(int core, ready_queue_t *ready_queue) {
 }
 
 void worker_destroy(worker_t *worker) {
+    // The workers are joined, stop the boosts before the processes are destroyed
+    boost_stop();
+
+    worker_release(worker);
     free(worker);
 }
 
+void worker_init(worker_t *worker, int core, ready_queue_t *ready_queue) {
+    worker->core = core;
+    worker->ready_queue = ready_queue;
+    ready_queue_init(&worker->local_queue);
+    worker->seed = core + 1;
+    atomic_store(&workers[core], worker);
+}
+
+void worker_release(worker_t *worker) {
+    atomic_store(&workers[worker->core], NULL);
+    ready_queue_destroy(&worker->local_queue);
+}
+
 void worker_join(worker_t *worker) {
     pthread_join(worker->thread, NULL);
 }
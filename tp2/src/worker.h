@@ -6,30 +6,39 @@
 #include "ready_queue.h"
 
 typedef struct worker worker_t;
-typedef struct queue_process_data queue_process_data_t;
 
 struct worker {
     pthread_t thread;
 
     int core;
-    ready_queue_t *ready_queue;
-};
-
-struct queue_process_data {
-    ready_queue_t *ready_queue;
-    process_t *process;
+    ready_queue_t *ready_queue; // Shared by the cores, filled by the OS
+    ready_queue_t local_queue; // Processes preempted on this core, other cores steal from it when idle
+    unsigned int seed; // Picks the victims of the steals
 };
 
 void *worker_run(void *user_data);
 
+// Return the next process to run: the best one of the local queue, of the shared queue and of the local
+// queue of another core, by priority level then by length, blocking on the shared queue if there is none
+process_t *worker_next(worker_t *worker);
+
 worker_t *worker_create(int core, ready_queue_t *ready_queue);
 
 void worker_destroy(worker_t *worker);
 
+// Initialize a worker and register its local queue for the steals of the other cores, without starting its thread
+void worker_init(worker_t *worker, int core, ready_queue_t *ready_queue);
+
+// Unregister a worker and release its local queue
+void worker_release(worker_t *worker);
+
 void worker_join(worker_t *worker);
 
+// Raise the priority level of a process that waited too long on a low level, called by the boost thread
+void priority_boost(process_t *process);
+
 // Update the priority level of a process based on its status
-void update_priority_level(process_t *process, ready_queue_t *ready_queue);
+void update_priority_level(process_t *process);
 
 // Return the quantum for a given priority level
 uint64_t get_quantum(ready_queue_t *queue, int priority);
@@ -1,9 +1,12 @@
 
 #include <check.h>
 #include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
 
 #include "ready_queue.h"
+#include "ring.h"
+#include "worker.h"
 
 START_TEST(test_ready_queue_init_zero_size)
 {
@@ -165,6 +168,515 @@ START_TEST(test_ready_queue_pop_blocks)
 }
 END_TEST
 
+START_TEST(test_ring_push_pop_fifo)
+{
+    static ring_t ring;
+    ring_init(&ring);
+
+    struct process* process[10];
+    for (int i = 0; i < 10; i++) {
+        process[i] = create_process(i);
+        ck_assert_int_eq(ring_push(&ring, process[i]), 1);
+    }
+
+    process_t *popped;
+    for (int i = 0; i < 10; i++) {
+        ck_assert_int_eq(ring_pop(&ring, &popped), 1);
+        ck_assert_ptr_eq(popped, process[i]);
+    }
+    ck_assert_int_eq(ring_pop(&ring, &popped), 0);
+
+    for (int i = 0; i < 10; i++) {
+        destroy_process(process[i]);
+    }
+}
+END_TEST
+
+START_TEST(test_ring_full)
+{
+    static ring_t ring;
+    ring_init(&ring);
+
+    struct process* process[4];
+    for (int i = 0; i < 4; i++) {
+        process[i] = create_process(i);
+    }
+
+    for (int i = 0; i < RING_SIZE; i++) {
+        ck_assert_int_eq(ring_push(&ring, process[i % 4]), 1);
+    }
+    ck_assert_int_eq(ring_push(&ring, process[0]), 0);
+
+    // A pop frees a slot for the next push, the order is kept across the wrap around
+    process_t *popped;
+    ck_assert_int_eq(ring_pop(&ring, &popped), 1);
+    ck_assert_ptr_eq(popped, process[0]);
+    ck_assert_int_eq(ring_push(&ring, NULL), 1);
+
+    for (int i = 1; i < RING_SIZE; i++) {
+        ck_assert_int_eq(ring_pop(&ring, &popped), 1);
+        ck_assert_ptr_eq(popped, process[i % 4]);
+    }
+    ck_assert_int_eq(ring_pop(&ring, &popped), 1);
+    ck_assert_ptr_eq(popped, NULL);
+    ck_assert_int_eq(ring_pop(&ring, &popped), 0);
+
+    for (int i = 0; i < 4; i++) {
+        destroy_process(process[i]);
+    }
+}
+END_TEST
+
+#define RING_THREADS 4
+#define RING_OPERATIONS 10000
+
+static ring_t concurrent_ring;
+static struct process* ring_processes[RING_THREADS * RING_OPERATIONS];
+static atomic_int ring_seen[RING_THREADS * RING_OPERATIONS];
+
+void *ring_producer(void *user_data)
+{
+    int first = *(int *) user_data * RING_OPERATIONS;
+    for (int i = first; i < first + RING_OPERATIONS; i++) {
+        while (!ring_push(&concurrent_ring, ring_processes[i])) sched_yield();
+    }
+    return NULL;
+}
+
+void *ring_consumer(void *user_data)
+{
+    (void) user_data;
+    process_t *popped;
+    for (int i = 0; i < RING_OPERATIONS; i++) {
+        while (!ring_pop(&concurrent_ring, &popped)) sched_yield();
+        atomic_fetch_add(&ring_seen[popped->pid], 1);
+    }
+    return NULL;
+}
+
+START_TEST(test_ring_concurrent)
+{
+    ring_init(&concurrent_ring);
+    for (int i = 0; i < RING_THREADS * RING_OPERATIONS; i++) {
+        ring_processes[i] = create_process(i);
+        atomic_store(&ring_seen[i], 0);
+    }
+
+    pthread_t producers[RING_THREADS];
+    pthread_t consumers[RING_THREADS];
+    int index[RING_THREADS];
+    for (int i = 0; i < RING_THREADS; i++) {
+        index[i] = i;
+        pthread_create(&producers[i], NULL, ring_producer, &index[i]);
+        pthread_create(&consumers[i], NULL, ring_consumer, NULL);
+    }
+    for (int i = 0; i < RING_THREADS; i++) {
+        pthread_join(producers[i], NULL);
+        pthread_join(consumers[i], NULL);
+    }
+
+    // Each process was popped exactly once
+    for (int i = 0; i < RING_THREADS * RING_OPERATIONS; i++) {
+        ck_assert_int_eq(atomic_load(&ring_seen[i]), 1);
+        destroy_process(ring_processes[i]);
+    }
+    process_t *popped;
+    ck_assert_int_eq(ring_pop(&concurrent_ring, &popped), 0);
+}
+END_TEST
+
+START_TEST(test_ready_queue_ring_overflow)
+{
+    struct ready_queue queue;
+    ready_queue_init(&queue);
+
+    // More processes than the ring of MAX_PRIORITY_LEVEL holds, the others go to the heap of the level
+    int count = RING_SIZE + 10;
+    struct process* process[RING_SIZE + 10];
+    for (int i = 0; i < count; i++) {
+        process[i] = create_process(i);
+        ready_queue_push(&queue, process[i]);
+    }
+    ck_assert_int_eq(ready_queue_size(&queue), count);
+
+    int found[RING_SIZE + 10] = {0};
+    for (int i = 0; i < count; i++) {
+        process_t *p = ready_queue_pop(&queue);
+        ck_assert_ptr_ne(p, NULL);
+        found[p->pid]++;
+    }
+    ck_assert_int_eq(ready_queue_size(&queue), 0);
+
+    for (int i = 0; i < count; i++) {
+        ck_assert_int_eq(found[i], 1);
+        destroy_process(process[i]);
+    }
+
+    ready_queue_destroy(&queue);
+}
+END_TEST
+
+static struct ready_queue shared_queue;
+static worker_t worker_a;
+static worker_t worker_b;
+
+static void workers_setup(void)
+{
+    ready_queue_init(&shared_queue);
+    worker_init(&worker_a, 0, &shared_queue);
+    worker_init(&worker_b, 1, &shared_queue);
+}
+
+static void workers_teardown(void)
+{
+    worker_release(&worker_a);
+    worker_release(&worker_b);
+    ready_queue_destroy(&shared_queue);
+}
+
+static struct process* process_at(int pid, int priority_level, uint64_t length)
+{
+    struct process* process = create_process(pid);
+    process->priority_level = priority_level;
+    process->burst_length = length;
+    return process;
+}
+
+START_TEST(test_worker_next_best_level)
+{
+    workers_setup();
+
+    // The shared queue has a process of a higher priority level than the local queue
+    struct process* local = process_at(0, MIN_PRIORITY_LEVEL, 10);
+    struct process* shared = process_at(1, MAX_PRIORITY_LEVEL + 1, 100);
+    ready_queue_push(&worker_a.local_queue, local);
+    ready_queue_push(&shared_queue, shared);
+
+    ck_assert_ptr_eq(worker_next(&worker_a), shared);
+    ck_assert_ptr_eq(worker_next(&worker_a), local);
+
+    workers_teardown();
+    destroy_process(local);
+    destroy_process(shared);
+}
+END_TEST
+
+START_TEST(test_worker_next_local_first)
+{
+    workers_setup();
+
+    // Same level and length, the local queue is preferred
+    struct process* local = process_at(0, MIN_PRIORITY_LEVEL, 10);
+    struct process* shared = process_at(1, MIN_PRIORITY_LEVEL, 10);
+    ready_queue_push(&worker_a.local_queue, local);
+    ready_queue_push(&shared_queue, shared);
+
+    ck_assert_ptr_eq(worker_next(&worker_a), local);
+    ck_assert_ptr_eq(worker_next(&worker_a), shared);
+
+    workers_teardown();
+    destroy_process(local);
+    destroy_process(shared);
+}
+END_TEST
+
+START_TEST(test_worker_next_steals)
+{
+    workers_setup();
+
+    // An idle core takes the processes waiting in the local queue of another core, the shortest first
+    struct process* longer = process_at(0, MIN_PRIORITY_LEVEL, 100);
+    struct process* shorter = process_at(1, MIN_PRIORITY_LEVEL, 10);
+    ready_queue_push(&worker_b.local_queue, longer);
+    ready_queue_push(&worker_b.local_queue, shorter);
+
+    ck_assert_ptr_eq(worker_next(&worker_a), shorter);
+    ck_assert_ptr_eq(worker_next(&worker_a), longer);
+    ck_assert_int_eq(ready_queue_size(&worker_b.local_queue), 0);
+
+    workers_teardown();
+    destroy_process(longer);
+    destroy_process(shorter);
+}
+END_TEST
+
+START_TEST(test_worker_next_steal_after_shared)
+{
+    workers_setup();
+
+    // The local queue of another core is only taken from when it has a better process
+    struct process* stolen = process_at(0, MIN_PRIORITY_LEVEL, 10);
+    struct process* shared = process_at(1, MAX_PRIORITY_LEVEL, 10);
+    ready_queue_push(&worker_b.local_queue, stolen);
+    ready_queue_push(&shared_queue, shared);
+
+    ck_assert_ptr_eq(worker_next(&worker_a), shared);
+    ck_assert_ptr_eq(worker_next(&worker_a), stolen);
+
+    workers_teardown();
+    destroy_process(stolen);
+    destroy_process(shared);
+}
+END_TEST
+
+static int chunk_count(struct ready_queue* queue, int priority)
+{
+    int count = 0;
+    for (node_chunk_t *chunk = queue->chunks[priority]; chunk != NULL; chunk = chunk->next) count++;
+    return count;
+}
+
+START_TEST(test_ready_queue_node_reuse)
+{
+    struct ready_queue queue;
+    ready_queue_init(&queue);
+
+    int level = MAX_PRIORITY_LEVEL + 1;
+    struct process* process[NODE_CHUNK_SIZE];
+    for (int i = 0; i < NODE_CHUNK_SIZE; i++) {
+        process[i] = process_at(i, level, i);
+    }
+
+    // The nodes given back by the pops are used by the next pushes, a single chunk is allocated
+    for (int round = 0; round < 100; round++) {
+        for (int i = 0; i < NODE_CHUNK_SIZE; i++) {
+            ready_queue_push(&queue, process[i]);
+        }
+        for (int i = 0; i < NODE_CHUNK_SIZE; i++) {
+            ck_assert_ptr_eq(ready_queue_pop(&queue), process[i]);
+        }
+    }
+    ck_assert_int_eq(chunk_count(&queue, level), 1);
+
+    for (int i = 0; i < NODE_CHUNK_SIZE; i++) {
+        destroy_process(process[i]);
+    }
+    ready_queue_destroy(&queue);
+}
+END_TEST
+
+START_TEST(test_ready_queue_node_chunks_grow)
+{
+    struct ready_queue queue;
+    ready_queue_init(&queue);
+
+    // One process more than a chunk holds needs a second chunk, which is kept for the next pushes
+    int level = MAX_PRIORITY_LEVEL + 1;
+    int count = NODE_CHUNK_SIZE + 1;
+    struct process* process[NODE_CHUNK_SIZE + 1];
+    for (int i = 0; i < count; i++) {
+        process[i] = process_at(i, level, i);
+    }
+
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < count; i++) {
+            ready_queue_push(&queue, process[i]);
+        }
+        for (int i = 0; i < count; i++) {
+            ck_assert_ptr_eq(ready_queue_pop(&queue), process[i]);
+        }
+        ck_assert_int_eq(chunk_count(&queue, level), 2);
+    }
+
+    for (int i = 0; i < count; i++) {
+        destroy_process(process[i]);
+    }
+    ready_queue_destroy(&queue);
+}
+END_TEST
+
+START_TEST(test_ready_queue_sorted_level_order)
+{
+    struct ready_queue queue;
+    ready_queue_init(&queue);
+
+    // A sorted level pops the shortest processes first, the ties in the order of the pushes
+    uint64_t lengths[8] = {50, 10, 40, 10, 30, 20, 50, 0};
+    int expected[8] = {7, 1, 3, 5, 4, 2, 0, 6};
+    struct process* process[8];
+    for (int i = 0; i < 8; i++) {
+        process[i] = process_at(i, MIN_PRIORITY_LEVEL, lengths[i]);
+        ready_queue_push(&queue, process[i]);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        ck_assert_ptr_eq(ready_queue_pop(&queue), process[expected[i]]);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        destroy_process(process[i]);
+    }
+    ready_queue_destroy(&queue);
+}
+END_TEST
+
+START_TEST(test_ready_queue_max_level_fifo)
+{
+    struct ready_queue queue;
+    ready_queue_init(&queue);
+
+    // MAX_PRIORITY_LEVEL ignores the lengths
+    struct process* process[8];
+    for (int i = 0; i < 8; i++) {
+        process[i] = process_at(i, MAX_PRIORITY_LEVEL, 8 - i);
+        ready_queue_push(&queue, process[i]);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        ck_assert_ptr_eq(ready_queue_pop(&queue), process[i]);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        destroy_process(process[i]);
+    }
+    ready_queue_destroy(&queue);
+}
+END_TEST
+
+START_TEST(test_ready_queue_levels_order)
+{
+    struct ready_queue queue;
+    ready_queue_init(&queue);
+
+    // The levels are popped from MAX_PRIORITY_LEVEL to MIN_PRIORITY_LEVEL, a poison pill after the
+    // processes of its level
+    struct process* low = process_at(0, MIN_PRIORITY_LEVEL, 0);
+    struct process* middle = process_at(1, MAX_PRIORITY_LEVEL + 1, 100);
+    struct process* high = process_at(2, MAX_PRIORITY_LEVEL, 100);
+    ready_queue_push(&queue, low);
+    ready_queue_push(&queue, NULL);
+    ready_queue_push(&queue, middle);
+    ready_queue_push(&queue, high);
+
+    ck_assert_ptr_eq(ready_queue_pop(&queue), high);
+    ck_assert_ptr_eq(ready_queue_pop(&queue), middle);
+    ck_assert_ptr_eq(ready_queue_pop(&queue), NULL);
+    ck_assert_ptr_eq(ready_queue_pop(&queue), low);
+
+    destroy_process(low);
+    destroy_process(middle);
+    destroy_process(high);
+    ready_queue_destroy(&queue);
+}
+END_TEST
+
+START_TEST(test_ready_queue_overflow_fifo)
+{
+    static struct ready_queue queue;
+    ready_queue_init(&queue);
+
+    // Fill the ring of MAX_PRIORITY_LEVEL and overflow it, then keep pushing while popping: the processes
+    // must come out in the order of their pushes
+    int count = 3 * RING_SIZE;
+    static struct process* process[3 * RING_SIZE];
+    for (int i = 0; i < count; i++) {
+        process[i] = create_process(i);
+    }
+
+    int pushed = 0;
+    int popped = 0;
+    while (pushed < RING_SIZE + 10) {
+        ready_queue_push(&queue, process[pushed++]);
+    }
+    while (popped < count) {
+        ck_assert_ptr_eq(ready_queue_pop(&queue), process[popped]);
+        popped++;
+        if (pushed < count) ready_queue_push(&queue, process[pushed++]);
+    }
+    ck_assert_int_eq(ready_queue_size(&queue), 0);
+
+    for (int i = 0; i < count; i++) {
+        destroy_process(process[i]);
+    }
+    ready_queue_destroy(&queue);
+}
+END_TEST
+
+START_TEST(test_ready_queue_remove_sorted)
+{
+    struct ready_queue queue;
+    ready_queue_init(&queue);
+
+    // Remove the first, a middle and the last process of a sorted level, the others keep their order
+    struct process* process[5];
+    for (int i = 0; i < 5; i++) {
+        process[i] = process_at(i, MIN_PRIORITY_LEVEL, 10 * (i + 1));
+        ready_queue_push(&queue, process[i]);
+    }
+
+    int removed[3] = {0, 2, 4};
+    for (int i = 0; i < 3; i++) {
+        ck_assert_int_eq(ready_queue_remove(&queue, process[removed[i]]), 1);
+        ck_assert_ptr_null(process[removed[i]]->queue);
+        ck_assert_ptr_null(process[removed[i]]->queue_node);
+    }
+    ck_assert_int_eq(ready_queue_size(&queue), 2);
+
+    // A removed process is not in the queue anymore
+    ck_assert_int_eq(ready_queue_remove(&queue, process[0]), 0);
+
+    ck_assert_ptr_eq(ready_queue_pop(&queue), process[1]);
+    ck_assert_ptr_eq(ready_queue_pop(&queue), process[3]);
+    ck_assert_int_eq(ready_queue_size(&queue), 0);
+
+    for (int i = 0; i < 5; i++) {
+        destroy_process(process[i]);
+    }
+    ready_queue_destroy(&queue);
+}
+END_TEST
+
+START_TEST(test_ready_queue_remove_not_queued)
+{
+    struct ready_queue queue;
+    struct ready_queue other;
+    ready_queue_init(&queue);
+    ready_queue_init(&other);
+
+    struct process* process = process_at(0, MIN_PRIORITY_LEVEL, 10);
+    ready_queue_push(&queue, process);
+
+    // The process is not in the other queue
+    ck_assert_int_eq(ready_queue_remove(&other, process), 0);
+    ck_assert_int_eq(ready_queue_size(&queue), 1);
+
+    // A popped process cannot be removed
+    ck_assert_ptr_eq(ready_queue_pop(&queue), process);
+    ck_assert_int_eq(ready_queue_remove(&queue, process), 0);
+    ck_assert_int_eq(ready_queue_size(&queue), 0);
+
+    destroy_process(process);
+    ready_queue_destroy(&other);
+    ready_queue_destroy(&queue);
+}
+END_TEST
+
+START_TEST(test_ready_queue_remove_push_again)
+{
+    struct ready_queue queue;
+    ready_queue_init(&queue);
+
+    // The removal uses the level of the push, even if the priority level changed since
+    struct process* process = process_at(0, MIN_PRIORITY_LEVEL, 10);
+    struct process* other = process_at(1, MIN_PRIORITY_LEVEL, 20);
+    ready_queue_push(&queue, process);
+    ready_queue_push(&queue, other);
+    process->priority_level = MAX_PRIORITY_LEVEL + 1;
+    ck_assert_int_eq(ready_queue_remove(&queue, process), 1);
+
+    // A removed process can be pushed again, on its new level
+    ready_queue_push(&queue, process);
+    ck_assert_int_eq(ready_queue_size(&queue), 2);
+    ck_assert_ptr_eq(ready_queue_pop(&queue), process);
+    ck_assert_ptr_eq(ready_queue_pop(&queue), other);
+    ck_assert_int_eq(ready_queue_size(&queue), 0);
+
+    destroy_process(process);
+    destroy_process(other);
+    ready_queue_destroy(&queue);
+}
+END_TEST
+
 int main(void)
 {
     // Print amount of tests passed and failed
@@ -180,6 +692,23 @@ int main(void)
     tcase_add_test(tc, test_ready_queue_push_pop_multiple);
     tcase_add_test(tc, test_ready_queue_push_push_pop_poison_pill);
     tcase_add_test(tc, test_ready_queue_pop_blocks);
+    tcase_add_test(tc, test_ring_push_pop_fifo);
+    tcase_add_test(tc, test_ring_full);
+    tcase_add_test(tc, test_ring_concurrent);
+    tcase_add_test(tc, test_ready_queue_ring_overflow);
+    tcase_add_test(tc, test_worker_next_best_level);
+    tcase_add_test(tc, test_worker_next_local_first);
+    tcase_add_test(tc, test_worker_next_steals);
+    tcase_add_test(tc, test_worker_next_steal_after_shared);
+    tcase_add_test(tc, test_ready_queue_node_reuse);
+    tcase_add_test(tc, test_ready_queue_node_chunks_grow);
+    tcase_add_test(tc, test_ready_queue_sorted_level_order);
+    tcase_add_test(tc, test_ready_queue_max_level_fifo);
+    tcase_add_test(tc, test_ready_queue_levels_order);
+    tcase_add_test(tc, test_ready_queue_overflow_fifo);
+    tcase_add_test(tc, test_ready_queue_remove_sorted);
+    tcase_add_test(tc, test_ready_queue_remove_not_queued);
+    tcase_add_test(tc, test_ready_queue_remove_push_again);
     suite_add_tcase(s, tc);
 
     SRunner *sr = srunner_create(s);